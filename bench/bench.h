@@ -0,0 +1,47 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef __KSXT_BENCH
+#define __KSXT_BENCH
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// KernelShark.v2-Beta
+#include "libkshark.h"
+#include "libkshark-plugin.h"
+
+/*
+ * Load benchmark of the input plugin.
+ */
+
+// Stream returned by "kshark_get_data_stream"
+extern struct kshark_data_stream *bench_stream;
+// Calls to "kshark_hash_id_add"
+extern uint64_t bench_tasks_added;
+
+// Input plugin (ks-xentrace.c)
+bool KSHARK_INPUT_CHECK(const char *file, char **format);
+int KSHARK_INPUT_INITIALIZER(struct kshark_data_stream *stream);
+void KSHARK_INPUT_DEINITIALIZER(struct kshark_data_stream *stream);
+
+#endif
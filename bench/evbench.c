@@ -0,0 +1,390 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef _GNU_SOURCE
+/** Use GNU C Library. */
+#define _GNU_SOURCE
+#endif // _GNU_SOURCE
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Events formatting
+#include "events/events.h"
+
+/*
+ * Microbenchmark of the event decoders: every event known to the
+ * "get_*cls_evname" functions is formatted with random (but realistic)
+ * payloads, reporting ns per call and bytes produced per event and
+ * per subclass. The results can be stored as a baseline, and compared
+ * to it, failing when an event got slower than a threshold.
+ */
+
+#define DEFAULT_CALLS 2000
+#define DEFAULT_RUNS 10
+#define DEFAULT_THRESHOLD 25.0
+// Differences below it are noise, whatever the threshold
+#define MIN_DELTA_NS 5.0
+#define PAYLOADS 64
+#define MAX_EVENTS 4096
+
+struct decoder_class {
+    const char *name;
+    uint32_t cls;
+    int (*evname)(const uint32_t, char *);
+    int (*evinfo)(const uint32_t, const uint32_t *, char *);
+};
+
+static const struct decoder_class classes[] = {
+    { "gen", TRC_GEN, get_basecls_evname, get_basecls_evinfo },
+    { "sched", TRC_SCHED, get_schedcls_evname, get_schedcls_evinfo },
+    { "dom0", TRC_DOM0OP, get_dom0cls_evname, get_dom0cls_evinfo },
+    { "hvm", TRC_HVM, get_hvmcls_evname, get_hvmcls_evinfo },
+    { "mem", TRC_MEM, get_memcls_evname, get_memcls_evinfo },
+    { "pv", TRC_PV, get_pvcls_evname, get_pvcls_evinfo },
+    { "shadow", TRC_SHADOW, get_shdwcls_evname, get_shdwcls_evinfo },
+    { "hw", TRC_HW, get_hwcls_evname, get_hwcls_evinfo }
+};
+
+#define N_CLASSES (sizeof(classes) / sizeof(*classes))
+
+struct event_result {
+    uint32_t id;
+    const struct decoder_class *cls;
+    char name[STR_EVNAME_MAXLEN];
+    // Best of the runs
+    double evname_ns,
+           evinfo_ns,
+           // Average length of the info
+           evinfo_bytes;
+};
+
+static struct {
+    struct event_result events[MAX_EVENTS];
+    size_t n_events;
+    uint32_t payloads[PAYLOADS][TRACE_EXTRA_MAX];
+    uint64_t state;
+    // ns per call of a fixed formatting, to scale the baseline
+    // to the speed of the machine
+    double calibration_ns;
+} E;
+
+static uint64_t rnd()
+{
+    // xorshift64*
+    E.state ^= E.state >> 12;
+    E.state ^= E.state << 25;
+    E.state ^= E.state >> 27;
+    return E.state * 0x2545f4914f6cdd1dULL;
+}
+
+/**
+ * Fills the payloads with the kind of words found in the records:
+ * small numbers, domain/vCPU pairs, addresses and random values.
+ */
+static void fill_payloads()
+{
+    for (int p = 0; p < PAYLOADS; ++p)
+        for (int w = 0; w < TRACE_EXTRA_MAX; ++w) {
+            uint64_t r = rnd();
+            switch (r & 3) {
+                case 0:
+                    E.payloads[p][w] = (r >> 8) & 0xff;
+                    break;
+                case 1:
+                    E.payloads[p][w] = ((r >> 8) & 0x3f) << 16 | ((r >> 16) & 0xf);
+                    break;
+                case 2:
+                    E.payloads[p][w] = (r >> 32) & ~0xfffu;
+                    break;
+                default:
+                    E.payloads[p][w] = r >> 32;
+                    break;
+            }
+        }
+}
+
+/**
+ * Whether a decoder ignores the subclass of an event, already found
+ * (with the same name) in another subclass of the class.
+ */
+static int is_alias(size_t first, uint32_t id, const char *name)
+{
+    for (size_t i = first; i < E.n_events; ++i)
+        if ((E.events[i].id & 0xfff) == (id & 0xfff) && !strcmp(E.events[i].name, name))
+            return 1;
+    return 0;
+}
+
+/**
+ * Collects the events that have a name.
+ */
+static void find_events()
+{
+    char name[STR_EVNAME_MAXLEN];
+
+    for (size_t c = 0; c < N_CLASSES; ++c) {
+        size_t first = E.n_events;
+        for (uint32_t low = 0; low < 0x10000; ++low) {
+            uint32_t id = (classes[c].cls & 0x0fff0000) | low;
+            if (classes[c].evname(id, name) < 1 || E.n_events == MAX_EVENTS ||
+                    is_alias(first, id, name))
+                continue;
+
+            struct event_result *ev = &E.events[E.n_events++];
+            ev->id = id;
+            ev->cls = &classes[c];
+            memcpy(ev->name, name, sizeof(name));
+        }
+    }
+}
+
+static double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * Measures an event ("first" run if "first" is set),
+ * keeping the fastest of the runs.
+ */
+static void run_event(struct event_result *ev, int n_calls, int first)
+{
+    char name[STR_EVNAME_MAXLEN],
+         info[STR_EVINFO_MAXLEN];
+    uint64_t bytes = 0;
+
+    double t0 = now_ns();
+    for (int i = 0; i < n_calls; ++i)
+        ev->cls->evname(ev->id, name);
+
+    double t1 = now_ns();
+    for (int i = 0; i < n_calls; ++i) {
+        int len = ev->cls->evinfo(ev->id, E.payloads[i % PAYLOADS], info);
+        bytes += (len < STR_EVINFO_MAXLEN) ? len : STR_EVINFO_MAXLEN - 1;
+    }
+
+    double t2 = now_ns(),
+           name_ns = (t1 - t0) / n_calls,
+           info_ns = (t2 - t1) / n_calls;
+    if (first || name_ns < ev->evname_ns)
+        ev->evname_ns = name_ns;
+    if (first || info_ns < ev->evinfo_ns)
+        ev->evinfo_ns = info_ns;
+    ev->evinfo_bytes = (double)bytes / n_calls;
+}
+
+static void run_calibration(int n_calls, int first)
+{
+    char info[STR_EVINFO_MAXLEN];
+
+    double t0 = now_ns();
+    for (int i = 0; i < n_calls; ++i) {
+        const uint32_t *extra = E.payloads[i % PAYLOADS];
+        EVINFO(info, "a = 0x%08x, b = %u, c = %d", extra[0], extra[1], extra[2]);
+    }
+
+    double ns = (now_ns() - t0) / n_calls;
+    if (first || ns < E.calibration_ns)
+        E.calibration_ns = ns;
+}
+
+static void report(FILE *fp, int n_calls, int n_runs)
+{
+    fprintf(fp, "# evbench: %d calls, best of %d runs\n", n_calls, n_runs);
+    fprintf(fp, "# calibration_ns %.1f\n", E.calibration_ns);
+    fprintf(fp, "# id evname_ns evinfo_ns evinfo_bytes class name\n");
+    for (size_t i = 0; i < E.n_events; ++i) {
+        const struct event_result *ev = &E.events[i];
+        fprintf(fp, "0x%08x %.1f %.1f %.1f %s %s\n", ev->id, ev->evname_ns,
+                    ev->evinfo_ns, ev->evinfo_bytes, ev->cls->name, ev->name);
+    }
+
+    fprintf(fp, "# per subclass: subclass events evname_ns evinfo_ns evinfo_bytes class\n");
+    for (size_t i = 0; i < E.n_events;) {
+        uint32_t sub = GET_EVENT_SUBCLS(E.events[i].id);
+        double name_ns = 0,
+               info_ns = 0,
+               bytes = 0;
+        size_t n = 0;
+
+        for (; i + n < E.n_events && GET_EVENT_SUBCLS(E.events[i + n].id) == sub; ++n) {
+            name_ns += E.events[i + n].evname_ns;
+            info_ns += E.events[i + n].evinfo_ns;
+            bytes += E.events[i + n].evinfo_bytes;
+        }
+
+        fprintf(fp, "# 0x%05x %zu %.1f %.1f %.1f %s\n", sub, n, name_ns / n,
+                    info_ns / n, bytes / n, E.events[i].cls->name);
+        i += n;
+    }
+}
+
+static const struct event_result *find_result(uint32_t id)
+{
+    for (size_t i = 0; i < E.n_events; ++i)
+        if (E.events[i].id == id)
+            return &E.events[i];
+    return NULL;
+}
+
+static int is_regression(double ns, double base_ns, double threshold)
+{
+    return ns - base_ns > MIN_DELTA_NS && ns > base_ns * (1 + threshold / 100);
+}
+
+/**
+ * Compares the results with a baseline (written by "-o"), scaled by
+ * the calibrations. Returns the number of regressions, or a negative errno.
+ */
+static int compare(const char *path, double threshold)
+{
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return -errno;
+
+    char line[256];
+    int regressions = 0;
+    double scale = 1;
+    while (fgets(line, sizeof(line), fp)) {
+        uint32_t id;
+        double name_ns, info_ns, calibration_ns;
+        if (sscanf(line, "# calibration_ns %lf", &calibration_ns) == 1 && calibration_ns > 0)
+            scale = E.calibration_ns / calibration_ns;
+        if (sscanf(line, "0x%x %lf %lf", &id, &name_ns, &info_ns) != 3)
+            continue;
+
+        name_ns *= scale;
+        info_ns *= scale;
+
+        const struct event_result *ev = find_result(id);
+        if (!ev)
+            continue;
+
+        if (is_regression(ev->evname_ns, name_ns, threshold)) {
+            fprintf(stderr, "REGRESSION 0x%08x %s: evname %.1f ns (baseline %.1f ns)\n",
+                        id, ev->name, ev->evname_ns, name_ns);
+            regressions++;
+        }
+        if (is_regression(ev->evinfo_ns, info_ns, threshold)) {
+            fprintf(stderr, "REGRESSION 0x%08x %s: evinfo %.1f ns (baseline %.1f ns)\n",
+                        id, ev->name, ev->evinfo_ns, info_ns);
+            regressions++;
+        }
+    }
+
+    fclose(fp);
+    return regressions;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [options]\n"
+                    "  -n calls      calls per event and run (default %d)\n"
+                    "  -r runs       runs, the fastest is kept (default %d)\n"
+                    "  -o file       writes the results to a file (e.g. a baseline)\n"
+                    "  -b file       compares the results with a baseline\n"
+                    "  -t percent    regression threshold (default %.0f)\n"
+                    "  -s seed       random seed (default 1)\n", name,
+                    DEFAULT_CALLS, DEFAULT_RUNS, DEFAULT_THRESHOLD);
+}
+
+int main(int argc, char **argv)
+{
+    int n_calls = DEFAULT_CALLS,
+        n_runs = DEFAULT_RUNS;
+    double threshold = DEFAULT_THRESHOLD;
+    const char *out_path = NULL,
+               *baseline = NULL;
+
+    E.state = 1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:r:o:b:t:s:h")) != -1) {
+        switch (opt) {
+            case 'n':
+                n_calls = atoi(optarg);
+                break;
+            case 'r':
+                n_runs = atoi(optarg);
+                break;
+            case 'o':
+                out_path = optarg;
+                break;
+            case 'b':
+                baseline = optarg;
+                break;
+            case 't':
+                threshold = strtod(optarg, NULL);
+                break;
+            case 's':
+                E.state = strtoull(optarg, NULL, 0) | 1;
+                break;
+            default:
+                usage(argv[0]);
+                return opt != 'h';
+        }
+    }
+
+    if (optind != argc || n_calls < 1 || n_runs < 1 || threshold < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    fill_payloads();
+    find_events();
+    // The runs go over all the events, so that a slow
+    // period of the machine does not hit a single event
+    for (int r = 0; r < n_runs; ++r) {
+        run_calibration(n_calls, !r);
+        for (size_t i = 0; i < E.n_events; ++i)
+            run_event(&E.events[i], n_calls, !r);
+    }
+
+    FILE *out = out_path ? fopen(out_path, "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "Cannot create \"%s\": %s\n", out_path, strerror(errno));
+        return 1;
+    }
+    report(out, n_calls, n_runs);
+    if (out != stdout)
+        fclose(out);
+
+    if (!baseline)
+        return 0;
+
+    int ret = compare(baseline, threshold);
+    if (ret < 0) {
+        fprintf(stderr, "Cannot read the baseline \"%s\": %s\n", baseline, strerror(-ret));
+        return 1;
+    }
+
+    fprintf(stderr, "%d regression(s) over %.0f%% against \"%s\" (scaled by the calibration).\n",
+                ret, threshold, baseline);
+    return !!ret;
+}
@@ -0,0 +1,384 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef _GNU_SOURCE
+/** Use GNU C Library. */
+#define _GNU_SOURCE
+#endif // _GNU_SOURCE
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+// Progressive load
+#include "store/store.h"
+
+#include "bench.h"
+
+/*
+ * Drives the input plugin as KernelShark does (check, initializer,
+ * load_entries, deinitializer) on a trace and reports the load
+ * throughput, the peak RSS and the allocations as JSON.
+ * The stress mode then calls the stream callbacks on all the
+ * entries from several threads and checks their results.
+ * With "XEN_PREVIEW" set, the first load returns the beginning of
+ * the trace: the whole trace is loaded again once it is ready.
+ */
+
+#define STRESS_MAX_THREADS 64
+
+// Allocator counters (glibc entry points)
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static struct {
+    uint64_t mallocs,
+             callocs,
+             reallocs,
+             frees,
+             bytes;
+} A;
+
+#define COUNT(_counter, _val) __atomic_fetch_add(&(_counter), (_val), __ATOMIC_RELAXED)
+
+void *malloc(size_t size)
+{
+    COUNT(A.mallocs, 1);
+    COUNT(A.bytes, size);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+    COUNT(A.callocs, 1);
+    COUNT(A.bytes, n * size);
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    COUNT(A.reallocs, 1);
+    COUNT(A.bytes, size);
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+    if (ptr)
+        COUNT(A.frees, 1);
+    __libc_free(ptr);
+}
+
+// A load of the trace
+struct bench_run {
+    int64_t check_ns,
+            init_ns,
+            load_ns;
+    ssize_t records;
+    // Progressive load: initializer and first "load_entries",
+    // background load and records of the first load
+    int64_t first_screen_ns,
+            background_ns;
+    ssize_t preview_records;
+    uint64_t allocs,
+             reallocs,
+             frees,
+             alloc_bytes;
+};
+
+// Concurrent calls of the stream callbacks
+struct stress_run {
+    int threads;
+    uint64_t calls,
+             mismatches;
+    int64_t ns;
+};
+
+struct stress_job {
+    struct kshark_data_stream *stream;
+    struct kshark_entry **rows;
+    ssize_t n_rows,
+            first;
+    uint64_t digest;
+};
+
+static int64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static uint64_t digest_add(uint64_t digest, uint64_t val)
+{
+    digest ^= val;
+    return digest * 0x100000001b3ULL;
+}
+
+/**
+ * Digest of a string returned by a callback, which is freed.
+ */
+static uint64_t digest_str(uint64_t digest, char *str)
+{
+    if (!str)
+        return digest_add(digest, 0xff);
+
+    for (const char *c = str; *c; ++c)
+        digest = digest_add(digest, (uint8_t)*c);
+    free(str);
+    return digest;
+}
+
+/**
+ * Calls every read callback on the entries, starting from "first"
+ * (so that the threads do not walk in step). The digest does not
+ * depend on the order of the entries.
+ */
+static void *stress_worker(void *arg)
+{
+    struct stress_job *job = arg;
+    struct kshark_generic_stream_interface *interface = job->stream->interface;
+    job->digest = 0;
+
+    for (ssize_t i = 0; i < job->n_rows; ++i) {
+        const struct kshark_entry *entry = job->rows[(job->first + i) % job->n_rows];
+        if (!entry)
+            continue;
+
+        uint64_t digest = digest_add(0xcbf29ce484222325ULL, entry->offset);
+        digest = digest_add(digest, (uint32_t)interface->get_pid(job->stream, entry));
+        digest = digest_add(digest, (uint32_t)interface->get_event_id(job->stream, entry));
+        digest = digest_str(digest, interface->get_task(job->stream, entry));
+        digest = digest_str(digest, interface->get_event_name(job->stream, entry));
+        digest = digest_str(digest, interface->get_info(job->stream, entry));
+        digest = digest_str(digest, interface->dump_entry(job->stream, entry));
+        job->digest += digest;
+    }
+
+    return NULL;
+}
+
+/**
+ * Checks the callbacks called by "n_threads" threads at once
+ * against a single-threaded pass.
+ */
+static int stress(struct kshark_data_stream *stream, struct kshark_entry **rows,
+                    ssize_t n_rows, struct stress_run *run)
+{
+    struct stress_job reference = {
+        .stream = stream,
+        .rows = rows,
+        .n_rows = n_rows
+    }, jobs[STRESS_MAX_THREADS];
+    stress_worker(&reference);
+
+    pthread_t threads[STRESS_MAX_THREADS];
+    int started = 0;
+    int64_t t0 = now_ns();
+    for (; started < run->threads; ++started) {
+        jobs[started] = reference;
+        jobs[started].first = n_rows / run->threads * started;
+        if (pthread_create(&threads[started], NULL, stress_worker, &jobs[started]))
+            break;
+    }
+    for (int t = 0; t < started; ++t)
+        pthread_join(threads[t], NULL);
+
+    run->ns = now_ns() - t0;
+    run->calls = (uint64_t)started * n_rows * 6;
+    for (int t = 0; t < started; ++t)
+        run->mismatches += jobs[t].digest != reference.digest;
+    return (started < run->threads) ? -EAGAIN : 0;
+}
+
+static int run_once(const char *path, struct bench_run *run, struct stress_run *stress_run)
+{
+    struct kshark_data_stream stream = { 0 };
+    struct kshark_entry **rows = NULL;
+
+    stream.file = (char *)path;
+    bench_stream = &stream;
+    memset(&A, 0, sizeof(A));
+
+    int64_t t0 = now_ns();
+    if (!KSHARK_INPUT_CHECK(path, NULL))
+        return -EINVAL;
+
+    int64_t t1 = now_ns();
+    int ret = KSHARK_INPUT_INITIALIZER(&stream);
+    if (ret)
+        return ret;
+
+    int64_t t2 = now_ns();
+    struct kshark_generic_stream_interface *interface = stream.interface;
+    run->records = interface->load_entries(&stream, NULL, &rows);
+    int64_t t3 = now_ns();
+    run->check_ns = t1 - t0;
+    run->init_ns = t2 - t1;
+
+    // Progressive load: reload the stream once the whole trace is ready
+    struct xtbg_progress progress;
+    xtbg_progress(&progress);
+    if (progress.state != XTBG_IDLE && run->records >= 0) {
+        run->first_screen_ns = t3 - t1;
+        run->preview_records = run->records;
+        while (progress.state == XTBG_PARSING || progress.state == XTBG_PACKING) {
+            usleep(1000);
+            xtbg_progress(&progress);
+        }
+        run->background_ns = progress.elapsed_ns;
+
+        for (ssize_t i = 0; i < run->records; ++i)
+            free(rows[i]);
+        free(rows);
+        rows = NULL;
+
+        t2 = now_ns();
+        run->records = interface->load_entries(&stream, NULL, &rows);
+        t3 = now_ns();
+    }
+
+    run->load_ns = t3 - t2;
+    run->allocs = A.mallocs + A.callocs;
+    run->reallocs = A.reallocs;
+    run->frees = A.frees;
+    run->alloc_bytes = A.bytes;
+
+    if (stress_run && run->records > 0)
+        ret = stress(&stream, rows, run->records, stress_run);
+
+    for (ssize_t i = 0; i < run->records; ++i)
+        free(rows[i]);
+    free(rows);
+    KSHARK_INPUT_DEINITIALIZER(&stream);
+    free(stream.interface);
+
+    return (run->records < 0) ? run->records : ret;
+}
+
+static void report(const char *path, const struct bench_run *run, int n_runs,
+                    const struct stress_run *stress_run)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    int64_t total_ns = run->init_ns + run->load_ns;
+    double secs = total_ns / 1e9;
+
+    printf("{\n"
+            "  \"trace\": \"%s\",\n"
+            "  \"runs\": %d,\n"
+            "  \"records\": %zd,\n"
+            "  \"check_ns\": %"PRId64",\n"
+            "  \"init_ns\": %"PRId64",\n"
+            "  \"load_ns\": %"PRId64",\n"
+            "  \"total_ns\": %"PRId64",\n"
+            "  \"records_per_sec\": %.0f,\n"
+            "  \"ns_per_record\": %.2f,\n"
+            "  \"peak_rss_kb\": %ld,\n"
+            "  \"allocs\": %"PRIu64",\n"
+            "  \"reallocs\": %"PRIu64",\n"
+            "  \"frees\": %"PRIu64",\n"
+            "  \"alloc_bytes\": %"PRIu64"%s\n", path, n_runs, run->records, run->check_ns, run->init_ns,
+            run->load_ns, total_ns, secs > 0 ? run->records / secs : 0,
+            run->records ? (double)total_ns / run->records : 0,
+            usage.ru_maxrss, run->allocs, run->reallocs, run->frees,
+            run->alloc_bytes, (stress_run || run->preview_records) ? "," : "");
+
+    if (run->preview_records)
+        printf("  \"preview_records\": %zd,\n"
+                "  \"first_screen_ns\": %"PRId64",\n"
+                "  \"background_ns\": %"PRId64"%s\n", run->preview_records,
+                run->first_screen_ns, run->background_ns, stress_run ? "," : "");
+
+    if (stress_run)
+        printf("  \"stress_threads\": %d,\n"
+                "  \"stress_calls\": %"PRIu64",\n"
+                "  \"stress_ns_per_call\": %.2f,\n"
+                "  \"stress_mismatches\": %"PRIu64"\n", stress_run->threads,
+                stress_run->calls, stress_run->calls ?
+                    (double)stress_run->ns / stress_run->calls : 0,
+                stress_run->mismatches);
+    printf("}\n");
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-r runs] [-t threads] <trace.xen>\n"
+                    "  -r runs     loads of the trace, the fastest is reported (default 1)\n"
+                    "  -t threads  after the last load, calls the stream callbacks on all\n"
+                    "              the entries from \"threads\" threads (max %d) at once\n",
+                    name, STRESS_MAX_THREADS);
+}
+
+int main(int argc, char **argv)
+{
+    int n_runs = 1,
+        n_threads = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "r:t:h")) != -1) {
+        switch (opt) {
+            case 'r':
+                n_runs = atoi(optarg);
+                break;
+            case 't':
+                n_threads = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return opt != 'h';
+        }
+    }
+
+    if (argc - optind != 1 || n_runs < 1 || n_threads < 0 ||
+            n_threads > STRESS_MAX_THREADS) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    struct bench_run best = { 0 };
+    struct stress_run stress_run = { .threads = n_threads };
+    for (int i = 0; i < n_runs; ++i) {
+        struct bench_run run = { 0 };
+        bool last = i == n_runs - 1;
+        int ret = run_once(argv[optind], &run, (n_threads && last) ? &stress_run : NULL);
+        if (ret) {
+            fprintf(stderr, "Cannot load \"%s\": %s\n", argv[optind], strerror(-ret));
+            return 1;
+        }
+
+        if (!i || run.init_ns + run.load_ns < best.init_ns + best.load_ns)
+            best = run;
+    }
+
+    report(argv[optind], &best, n_runs, n_threads ? &stress_run : NULL);
+    return stress_run.mismatches != 0;
+}
@@ -0,0 +1,165 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef _GNU_SOURCE
+/** Use GNU C Library. */
+#define _GNU_SOURCE
+#endif // _GNU_SOURCE
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+// KernelShark.v2-Beta
+#include "libkshark.h"
+#include "libkshark-plugin.h"
+// Plot plugin
+#include "plot/plot.h"
+
+#include "bench.h"
+
+/*
+ * Stand-ins for the parts of KernelShark used by the C sources of
+ * the plugin, so that the input plugin can be driven without the GUI.
+ */
+
+struct kshark_data_stream *bench_stream;
+uint64_t bench_tasks_added;
+
+/*
+ * Id sets are a single list, and only the ones made by
+ * "kshark_hash_id_alloc" keep their ids (the task set of the
+ * benchmarks only counts the additions).
+ */
+
+struct kshark_hash_id *kshark_hash_id_alloc(size_t n_bits)
+{
+    struct kshark_hash_id *hash = calloc(1, sizeof(*hash));
+    if (hash && !(hash->hash = calloc(1, sizeof(*hash->hash)))) {
+        free(hash);
+        return NULL;
+    }
+    return hash;
+}
+
+bool kshark_hash_id_find(struct kshark_hash_id *hash, int id)
+{
+    if (!hash || !hash->hash)
+        return false;
+
+    for (struct kshark_hash_id_item *item = hash->hash[0]; item; item = item->next)
+        if (item->id == id)
+            return true;
+    return false;
+}
+
+int kshark_hash_id_add(struct kshark_hash_id *hash, int id)
+{
+    bench_tasks_added++;
+    if (!hash || !hash->hash)
+        return 1;
+    if (kshark_hash_id_find(hash, id))
+        return 0;
+
+    struct kshark_hash_id_item *item = malloc(sizeof(*item));
+    if (!item)
+        return -ENOMEM;
+
+    *item = (struct kshark_hash_id_item) { .next = hash->hash[0], .id = id };
+    hash->hash[0] = item;
+    hash->count++;
+    return 1;
+}
+
+int *kshark_hash_ids(struct kshark_hash_id *hash)
+{
+    if (!hash || !hash->count)
+        return NULL;
+
+    int *ids = malloc(hash->count * sizeof(*ids)),
+        i = 0;
+    if (!ids)
+        return NULL;
+
+    for (struct kshark_hash_id_item *item = hash->hash[0]; item; item = item->next)
+        ids[i++] = item->id;
+    return ids;
+}
+
+void kshark_hash_id_free(struct kshark_hash_id *hash)
+{
+    if (!hash)
+        return;
+
+    struct kshark_hash_id_item *item = hash->hash ? hash->hash[0] : NULL;
+    while (item) {
+        struct kshark_hash_id_item *next = item->next;
+        free(item);
+        item = next;
+    }
+    free(hash->hash);
+    free(hash);
+}
+
+bool kshark_this_filter_is_set(struct kshark_hash_id *filter)
+{
+    return filter && filter->count;
+}
+
+struct kshark_data_stream *kshark_get_data_stream(struct kshark_context *kshark_ctx, int sd)
+{
+    return bench_stream;
+}
+
+int kshark_register_draw_handler(struct kshark_data_stream *stream,
+                                    kshark_plugin_draw_handler_func draw_func)
+{
+    return 0;
+}
+
+void kshark_unregister_draw_handler(struct kshark_data_stream *stream,
+                                    kshark_plugin_draw_handler_func draw_func)
+{
+}
+
+// Draw handlers (plot/*.cpp)
+
+void draw_pcpu_occupancy(struct kshark_cpp_argv *argv_c, int sd,
+                            int cpu, int draw_action)
+{
+}
+
+void draw_csched2_series(struct kshark_cpp_argv *argv_c, int sd,
+                            int val, int draw_action)
+{
+}
+
+void draw_lossy_windows(struct kshark_cpp_argv *argv_c, int sd,
+                            int cpu, int draw_action)
+{
+}
+
+void draw_power_tracks(struct kshark_cpp_argv *argv_c, int sd,
+                        int cpu, int draw_action)
+{
+}
@@ -0,0 +1,831 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef _GNU_SOURCE
+/** Use GNU C Library. */
+#define _GNU_SOURCE
+#endif // _GNU_SOURCE
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// KernelShark.v2-Beta
+#include "libkshark.h"
+// Xen Project
+#include <trace.h>
+// Load-time analyses
+#include "analysis/analysis.h"
+// Entry indexes
+#include "index/index.h"
+// Record store
+#include "store/store.h"
+
+#include "bench.h"
+
+/*
+ * Regression checks of the plugin, driven (as "ksbench") against
+ * stubs of KernelShark. Each check prints what failed; the exit
+ * status is 1 if any of them failed.
+ */
+
+#define CSCHED2_EVT(_e) TRC_SCHED_CLASS_EVT(CSCHED2, _e)
+
+static int failures;
+
+static void expect(bool cond, const char *check, const char *format, ...)
+{
+    if (cond)
+        return;
+
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "%s: ", check);
+    vfprintf(stderr, format, args);
+    fputc('\n', stderr);
+    va_end(args);
+    failures++;
+}
+
+static xt_event make_event(uint16_t cpu, uint32_t id, uint64_t tsc, int n_extra, ...)
+{
+    xt_event event = { .cpu = cpu };
+    (event.rec).id = id;
+    (event.rec).tsc = tsc;
+
+    va_list args;
+    va_start(args, n_extra);
+    for (int i = 0; i < n_extra; ++i)
+        (event.rec).extra[i] = va_arg(args, uint32_t);
+    va_end(args);
+    return event;
+}
+
+//
+// Credit2
+//
+
+/**
+ * A "csched2:schedule" record carries the pCPU in the low
+ * half of its first word and the runqueue in the high half.
+ */
+static void check_csched2_schedule()
+{
+    const char *check = "csched2_schedule";
+    csched2_init(4);
+
+    // Load of runqueues 1 and 3 (rq_load[16]:rq_id[8]:shift[8], shift 0)
+    xt_event rq1 = make_event(0, CSCHED2_EVT(12), 100, 5, 10u, 0u, 0u, 0u, 1u << 16),
+             rq3 = make_event(0, CSCHED2_EVT(12), 200, 5, 30u, 0u, 0u, 0u, 3u << 16),
+             // pCPU 3 schedules on runqueue 1
+             sched = make_event(3, CSCHED2_EVT(20), 300, 1, 1u << 16 | 3u);
+    csched2_feed(&rq1, 100);
+    csched2_feed(&rq3, 200);
+    csched2_feed(&sched, 300);
+    csched2_finish();
+
+    const struct time_series *s = csched2_series(CS2_RUNQ_LOAD, 3);
+    expect(s && s->levels[0].size == 1 && s->levels[0].val[0] == 10.0, check,
+            "pCPU 3 is not on runqueue 1 (load %g)", s ? s->levels[0].val[0] : -1.0);
+    expect(!csched2_series(CS2_RUNQ_LOAD, 1), check, "pCPU 1 got a runqueue");
+    csched2_free();
+}
+
+//
+// Time series
+//
+
+#define SERIES_POINTS 20000
+#define SERIES_WINDOWS 5
+
+/**
+ * A decimation given back by the cache of a series is the one
+ * computed without it, as the window and the number of points change.
+ */
+static void check_series_cache()
+{
+    const char *check = "series_cache";
+    struct time_series s = { 0 };
+    for (int64_t i = 0; i < SERIES_POINTS; ++i)
+        series_append(&s, 1000 * i, (double)(i * 7919 % 1009));
+    series_build_levels(&s);
+    expect(s.cache, check, "no cache");
+
+    struct time_series uncached = s;
+    uncached.cache = NULL;
+
+    // Same window twice, another window, fewer points and back
+    const struct {
+        int64_t from, to;
+        size_t n_out;
+    } windows[SERIES_WINDOWS] = {
+        { 0, 1000 * SERIES_POINTS, 500 },
+        { 0, 1000 * SERIES_POINTS, 500 },
+        { 1000 * 3000, 1000 * 5000, 500 },
+        { 1000 * 3000, 1000 * 5000, 100 },
+        { 0, 1000 * SERIES_POINTS, 500 },
+    };
+    int64_t ts[500], ref_ts[500];
+    double val[500], ref_val[500];
+    for (int w = 0; w < SERIES_WINDOWS; ++w) {
+        size_t n = series_decimate(&s, windows[w].from, windows[w].to, windows[w].n_out,
+                                    ts, val),
+               ref_n = series_decimate(&uncached, windows[w].from, windows[w].to,
+                                        windows[w].n_out, ref_ts, ref_val);
+        expect(n == ref_n && n && !memcmp(ts, ref_ts, n * sizeof(*ts)) &&
+                !memcmp(val, ref_val, n * sizeof(*val)), check,
+                "window %d: %zu points, %zu expected", w, n, ref_n);
+    }
+
+    series_free(&s);
+}
+
+//
+// Filters
+//
+
+#define FILTER_ENTRIES 64
+
+// "kshark_show_*" of KernelShark
+static bool ref_show(struct kshark_hash_id *show, struct kshark_hash_id *hide, int id)
+{
+    return (!show || !show->count || kshark_hash_id_find(show, id)) &&
+            (!hide || !hide->count || !kshark_hash_id_find(hide, id));
+}
+
+// "kshark_filter_stream_entries" of KernelShark, for a single entry
+static void ref_filter(struct kshark_context *kshark_ctx,
+                        struct kshark_data_stream *stream, struct kshark_entry *entry)
+{
+    entry->visible = 0xff;
+    if (!ref_show(stream->show_event_filter, stream->hide_event_filter, entry->event_id))
+        entry->visible &= ~((kshark_ctx->filter_mask & ~KS_GRAPH_VIEW_FILTER_MASK) |
+                                KS_EVENT_VIEW_FILTER_MASK);
+    if (!ref_show(stream->show_cpu_filter, stream->hide_cpu_filter, entry->cpu))
+        entry->visible &= ~kshark_ctx->filter_mask;
+    if (!ref_show(stream->show_task_filter, stream->hide_task_filter, entry->pid))
+        entry->visible &= ~kshark_ctx->filter_mask;
+}
+
+static void set_filter(struct kshark_hash_id **filter, int n_ids, const int *ids)
+{
+    kshark_hash_id_free(*filter);
+    *filter = kshark_hash_id_alloc(4);
+    for (int i = 0; i < n_ids; ++i)
+        kshark_hash_id_add(*filter, ids[i]);
+}
+
+// Entries not as KernelShark would filter them
+static int filter_mismatches(struct kshark_context *kshark_ctx,
+                                struct kshark_data_stream *stream,
+                                const struct kshark_entry *entries)
+{
+    int mismatches = 0;
+    for (int i = 0; i < FILTER_ENTRIES; ++i) {
+        struct kshark_entry ref = entries[i];
+        ref_filter(kshark_ctx, stream, &ref);
+        mismatches += ((ref.visible ^ entries[i].visible) & ~XTI_APPLIED_MASK) != 0;
+    }
+    return mismatches;
+}
+
+/**
+ * The visibility set by the bitmap filters is the one KernelShark
+ * would set, for each filter mask and when the filters change.
+ */
+static void check_filter_visibility()
+{
+    const char *check = "filter_visibility";
+    struct kshark_data_stream stream = { 0 };
+    struct kshark_context kshark_ctx = { 0 };
+    struct kshark_entry entries[FILTER_ENTRIES] = { 0 };
+    bench_stream = &stream;
+
+    xti_init(0, NULL);
+    for (int i = 0; i < FILTER_ENTRIES; ++i) {
+        entries[i] = (struct kshark_entry) {
+            .visible = 0xff,
+            .event_id = i % 5,
+            .cpu = i % 4,
+            .pid = i % 3 + 1
+        };
+        xti_feed(i, &entries[i], 0);
+    }
+    xti_finish(FILTER_ENTRIES);
+
+    const int some_events[] = { 1, 2 },
+              an_event[] = { 3 },
+              a_task[] = { 2 },
+              some_cpus[] = { 0, 1 };
+    const uint8_t masks[] = {
+        KS_TEXT_VIEW_FILTER_MASK | KS_GRAPH_VIEW_FILTER_MASK | KS_EVENT_VIEW_FILTER_MASK,
+        KS_TEXT_VIEW_FILTER_MASK | KS_GRAPH_VIEW_FILTER_MASK,
+        KS_TEXT_VIEW_FILTER_MASK
+    };
+
+    for (size_t m = 0; m < sizeof(masks) / sizeof(masks[0]); ++m) {
+        kshark_ctx.filter_mask = masks[m];
+        for (int step = 0; step < 4; ++step) {
+            switch (step) {
+                case 0:
+                    set_filter(&stream.show_event_filter, 2, some_events);
+                    break;
+                case 1:
+                    set_filter(&stream.show_event_filter, 0, NULL);
+                    set_filter(&stream.hide_event_filter, 1, an_event);
+                    set_filter(&stream.hide_task_filter, 1, a_task);
+                    break;
+                case 2:
+                    set_filter(&stream.hide_task_filter, 0, NULL);
+                    set_filter(&stream.show_cpu_filter, 2, some_cpus);
+                    break;
+                case 3:
+                    set_filter(&stream.hide_event_filter, 0, NULL);
+                    set_filter(&stream.show_cpu_filter, 0, NULL);
+                    break;
+            }
+
+            xti_apply_filters(&kshark_ctx);
+            int mismatches = filter_mismatches(&kshark_ctx, &stream, entries);
+            expect(!mismatches, check, "mask 0x%x, filters %d: %d entries differ",
+                    masks[m], step, mismatches);
+        }
+    }
+
+    // Same filters, another mask
+    set_filter(&stream.show_event_filter, 2, some_events);
+    set_filter(&stream.hide_task_filter, 1, a_task);
+    xti_apply_filters(&kshark_ctx);
+    kshark_ctx.filter_mask = masks[0];
+    xti_apply_filters(&kshark_ctx);
+    int mismatches = filter_mismatches(&kshark_ctx, &stream, entries);
+    expect(!mismatches, check, "mask changed: %d entries differ", mismatches);
+
+    // Filters applied by KernelShark in between
+    set_filter(&stream.show_cpu_filter, 2, some_cpus);
+    for (int i = 0; i < FILTER_ENTRIES; ++i)
+        ref_filter(&kshark_ctx, &stream, &entries[i]);
+    set_filter(&stream.show_cpu_filter, 0, NULL);
+    xti_apply_filters(&kshark_ctx);
+    mismatches = filter_mismatches(&kshark_ctx, &stream, entries);
+    expect(!mismatches, check, "applied by KernelShark: %d entries differ", mismatches);
+
+    // Cleared by KernelShark in between
+    for (int i = 0; i < FILTER_ENTRIES; ++i)
+        entries[i].visible = 0xff;
+    xti_apply_filters(&kshark_ctx);
+    mismatches = filter_mismatches(&kshark_ctx, &stream, entries);
+    expect(!mismatches, check, "cleared by KernelShark: %d entries differ", mismatches);
+
+    kshark_hash_id_free(stream.show_event_filter);
+    kshark_hash_id_free(stream.hide_event_filter);
+    kshark_hash_id_free(stream.hide_task_filter);
+    kshark_hash_id_free(stream.show_cpu_filter);
+    xti_free();
+    bench_stream = NULL;
+}
+
+#define INDEX_ENTRIES 10000
+
+// Record of the entry at a position: first word set on odd positions
+static const xt_event *index_event(size_t pos, xt_event *buf)
+{
+    memset(buf, 0, sizeof(*buf));
+    (buf->rec).extra[0] = pos & 1;
+    return buf;
+}
+
+/**
+ * The entries at the end of the 32-bit positions are filtered and
+ * found (no position wraps around past UINT32_MAX).
+ */
+static void check_index_positions()
+{
+    const char *check = "index_positions";
+    const uint32_t first = UINT32_MAX - INDEX_ENTRIES;
+    struct kshark_data_stream stream = { 0 };
+    struct kshark_context kshark_ctx = { .filter_mask = KS_TEXT_VIEW_FILTER_MASK };
+    struct kshark_entry *entries = calloc(INDEX_ENTRIES, sizeof(*entries));
+    expect(entries, check, "cannot allocate the entries");
+    if (!entries)
+        return;
+    bench_stream = &stream;
+
+    xti_init_at(0, index_event, first);
+    xzm_init_at(first);
+    for (uint32_t i = 0; i < INDEX_ENTRIES; ++i) {
+        // Event 7 only at the last position
+        entries[i] = (struct kshark_entry) {
+            .visible = 0xff,
+            .event_id = (i == INDEX_ENTRIES - 1) ? 7 : i % 5,
+            .ts = i
+        };
+        xti_feed(first + i, &entries[i], 0);
+        xzm_feed(first + i, &entries[i], 0, 0);
+    }
+    xti_finish(UINT32_MAX);
+    xzm_finish();
+
+    struct xtf_expr *expr = xtf_compile("w0 == 1", NULL, 0);
+    ssize_t matching = expr ? xti_set_field_filter(expr) : -1;
+    expect(matching == INDEX_ENTRIES / 2, check, "%zd entries match the field filter", matching);
+    xtf_free(expr);
+
+    // Then again over all the entries, cleared by KernelShark
+    for (int pass = 0; pass < 2; ++pass) {
+        if (pass)
+            for (uint32_t i = 0; i < INDEX_ENTRIES; ++i)
+                entries[i].visible = 0xff;
+
+        ssize_t updated = xti_apply_filters(&kshark_ctx);
+        int wrong = 0;
+        for (uint32_t i = 0; i < INDEX_ENTRIES; ++i)
+            wrong += !(entries[i].visible & KS_TEXT_VIEW_FILTER_MASK) != !((first + i) & 1);
+        expect(updated == (pass ? INDEX_ENTRIES : INDEX_ENTRIES / 2) && !wrong, check,
+                "pass %d: %zd entries updated, %d wrong", pass, updated, wrong);
+    }
+
+    struct xzm_query query = { .events = { 7 }, .n_events = 1, .dom = -1 };
+    ssize_t next = xzm_find(&query, first - 1, true),
+            prev = xzm_find(&query, UINT32_MAX, false),
+            at_ts = xzm_find_ts(INDEX_ENTRIES - 1);
+    expect(next == UINT32_MAX - 1 && prev == UINT32_MAX - 1 && at_ts == UINT32_MAX - 1,
+            check, "last entry found at %zd (forward), %zd (backward), %zd (time)",
+            next, prev, at_ts);
+
+    xzm_free();
+    xti_free();
+    free(entries);
+    bench_stream = NULL;
+}
+
+//
+// Power
+//
+
+/**
+ * "cpu_idle_exit" leaves the C-state entered by the last
+ * "cpu_idle_entry" (its first word is the type of the C-state):
+ * before the first entry of a pCPU the C-state is unknown.
+ */
+static void check_power_idle_exit()
+{
+    const char *check = "power_idle_exit";
+    power_init(2);
+
+    // pCPU 0: C3 in [100, 200] (exit record of type 2), C0 until 300
+    xt_event events[] = {
+        make_event(0, TRC_PM_IDLE_ENTRY, 100, 1, 3u),
+        make_event(0, TRC_PM_IDLE_EXIT, 200, 1, 2u),
+        make_event(0, TRC_PM_IDLE_ENTRY, 300, 1, 3u),
+        // pCPU 1: unknown until 100, C0 until 200, C2 until 300
+        make_event(1, TRC_PM_IDLE_EXIT, 100, 1, 1u),
+        make_event(1, TRC_PM_IDLE_ENTRY, 200, 1, 2u),
+        make_event(1, TRC_PM_IDLE_EXIT, 300, 1, 2u),
+    };
+    // One record before the idle ones on pCPU 1
+    xt_event first = make_event(1, TRC_SCHED_MIN, 0, 0);
+    power_feed(&first, 0);
+    for (size_t i = 0; i < sizeof(events) / sizeof(events[0]); ++i)
+        power_feed(&events[i], (events[i].rec).tsc);
+    power_finish();
+
+    int64_t c3 = power_residency(0, POWER_CSTATE, 3, 0, 300),
+            c2 = power_residency(0, POWER_CSTATE, 2, 0, 300);
+    expect(c3 == 100 && c2 == 0, check, "pCPU 0: C3 %"PRId64" ns, C2 %"PRId64" ns", c3, c2);
+
+    int64_t c0 = power_residency(1, POWER_CSTATE, 0, 0, 300),
+            c1 = power_residency(1, POWER_CSTATE, 1, 0, 300);
+    c2 = power_residency(1, POWER_CSTATE, 2, 0, 300);
+    expect(c0 == 100 && c1 == 0 && c2 == 100, check,
+            "pCPU 1: C0 %"PRId64" ns, C1 %"PRId64" ns, C2 %"PRId64" ns", c0, c1, c2);
+    power_free();
+}
+
+//
+// Raw trace probe
+//
+
+#define PROBE_WINDOWS 24
+#define PROBE_WINDOW_RECORDS 1000
+
+/**
+ * The end of a trace is read from a 4 bytes aligned offset, up to 3
+ * bytes before the last 256 KiB: a truncated file larger than them,
+ * whose size is not a multiple of 4, must not overflow the buffer
+ * (run under AddressSanitizer to tell) and is reported as truncated.
+ */
+static void check_probe_unaligned_tail()
+{
+    const char *check = "probe_unaligned_tail";
+    char path[] = "/tmp/xtcheck-XXXXXX";
+    int fd = mkstemp(path);
+    FILE *fp = (fd < 0) ? NULL : fdopen(fd, "w");
+    expect(fp, check, "cannot create a trace");
+    if (!fp)
+        return;
+
+    // pCPUs 0 and 1, records with a TSC and one extra word
+    uint64_t tsc = 1000;
+    for (int w = 0; w < PROBE_WINDOWS; ++w) {
+        uint32_t header[3] = {
+            TRC_TRACE_CPU_CHANGE | (2 << TRACE_EXTRA_SHIFT),
+            w % 2,
+            PROBE_WINDOW_RECORDS * 4 * sizeof(uint32_t)
+        };
+        fwrite(header, sizeof(header), 1, fp);
+        for (int r = 0; r < PROBE_WINDOW_RECORDS; ++r) {
+            tsc += 100;
+            uint32_t record[4] = {
+                TRC_SCHED_MIN | (1 << TRACE_EXTRA_SHIFT) | TRC_HD_CYCLE_FLAG,
+                tsc, tsc >> 32, r
+            };
+            fwrite(record, sizeof(record), 1, fp);
+        }
+    }
+    fflush(fp);
+
+    // Cut in the middle of a record, 3 bytes past a word
+    off_t size = ftello(fp) - 2 * sizeof(uint32_t) - 1;
+    expect(size > XTR_PROBE_TAIL && size % 4, check, "bad trace size %jd", (intmax_t)size);
+    expect(!ftruncate(fd, size), check, "cannot truncate the trace");
+    fclose(fp);
+
+    struct xtr_probe probe;
+    int ret = xtr_probe(path, &probe);
+    unlink(path);
+
+    expect(!ret, check, "probe failed (%d)", ret);
+    expect(!ret && probe.truncated && probe.n_cpus == 2 && probe.file_size == (uint64_t)size,
+            check, "truncated %d, %d pCPUs, %"PRIu64" bytes", probe.truncated,
+            probe.n_cpus, probe.file_size);
+}
+
+//
+// Record store
+//
+
+#define STORE_RECORDS 3000
+
+// Writes the trace of the store checks in "path" (a "mkstemp" template)
+static bool write_store_trace(const char *check, char *path)
+{
+    int fd = mkstemp(path);
+    FILE *fp = (fd < 0) ? NULL : fdopen(fd, "w");
+    expect(fp, check, "cannot create a trace");
+    if (!fp)
+        return false;
+
+    // A window of pCPU 1, with TSC gaps not fitting 32 bits
+    uint32_t header[3] = {
+        TRC_TRACE_CPU_CHANGE | (2 << TRACE_EXTRA_SHIFT), 1,
+        STORE_RECORDS * 5 * sizeof(uint32_t)
+    };
+    fwrite(header, sizeof(header), 1, fp);
+    uint64_t tsc = 1000;
+    for (int r = 0; r < STORE_RECORDS; ++r) {
+        tsc += (r % 700) ? 100 : (1ULL << 33);
+        uint32_t record[5] = {
+            TRC_SCHED_MIN | (2 << TRACE_EXTRA_SHIFT) | TRC_HD_CYCLE_FLAG,
+            tsc, tsc >> 32, r, (r % 3) ? 0 : 0xdead0000 | r
+        };
+        fwrite(record, sizeof(record), 1, fp);
+    }
+    fclose(fp);
+    return true;
+}
+
+/**
+ * Records at positions past INT32_MAX and at arena offsets past 32
+ * bits (high byte set) are read back as the parser gives them.
+ */
+static void check_store_positions()
+{
+    const char *check = "store_positions";
+    char path[] = "/tmp/xtcheck-XXXXXX";
+    if (!write_store_trace(check, path))
+        return;
+
+    xentrace_parser parser = xtp_init(path);
+    size_t n = parser ? xtp_execute(parser) : 0;
+    unlink(path);
+    expect(n == STORE_RECORDS, check, "%zu records parsed", n);
+
+    // Not aligned to a block, just below the end of the 40-bit offsets
+    const size_t first = (size_t)INT32_MAX + 77;
+    const uint64_t arena_off = (0xffULL << 32) + 5;
+    int ret = n ? xts_build_at(parser, first, arena_off) : -1;
+    expect(!ret, check, "cannot build the store (%d)", ret);
+
+    xt_event buf;
+    size_t mismatches = 0;
+    for (size_t i = 0; !ret && i < n; ++i) {
+        const xt_event *expected = xtp_get_event(parser, i),
+                       *got = xts_get(first + i, &buf);
+        mismatches += !got || got->cpu != expected->cpu ||
+                        (got->dom).u32 != (expected->dom).u32 ||
+                        (got->rec).id != (expected->rec).id ||
+                        (got->rec).tsc != (expected->rec).tsc ||
+                        memcmp((got->rec).extra, (expected->rec).extra,
+                                sizeof((got->rec).extra));
+    }
+    expect(!mismatches, check, "%zu records differ", mismatches);
+    expect(!ret && xts_count() == first + n && !xts_get(first - 1, &buf) &&
+            !xts_get(first + n, &buf), check, "wrong range of positions");
+
+    if (parser)
+        xtp_free(parser);
+    xts_free();
+}
+
+/**
+ * A commit running out of 40-bit offsets part-way leaves the records
+ * read as they were and keeps those set aside, whole, for the next one.
+ */
+static void check_store_commit_rollback()
+{
+    const char *check = "store_commit_rollback";
+    char path[] = "/tmp/xtcheck-XXXXXX";
+    if (!write_store_trace(check, path))
+        return;
+
+    xentrace_parser parser = xtp_init(path),
+                    pending = xtp_init(path);
+    size_t n = parser ? xtp_execute(parser) : 0,
+           n_pending = pending ? xtp_execute(pending) : 0;
+    unlink(path);
+    expect(n == STORE_RECORDS && n_pending == STORE_RECORDS, check,
+            "%zu and %zu records parsed", n, n_pending);
+
+    // Room for the records read, but not for twice them
+    const size_t first = 1000;
+    int ret = n ? xts_build_at(parser, first, (1ULL << 40) - 30 * STORE_RECORDS) : -1;
+    if (!ret)
+        ret = n_pending ? xts_build_pending(pending, NULL, 7, NULL) : -1;
+    expect(!ret, check, "cannot build the store (%d)", ret);
+
+    uint64_t mark = 0;
+    for (int commit = 0; !ret && commit < 2; ++commit) {
+        ssize_t appended = xts_commit(&mark);
+        expect(appended < 0 && mark == 7, check, "commit %d gave %zd (mark %"PRIu64")",
+                commit, appended, mark);
+        expect(xts_count() == first + n, check, "%zu records after commit %d",
+                xts_count() - first, commit);
+    }
+
+    xt_event buf;
+    size_t mismatches = 0;
+    for (size_t i = 0; !ret && i < n; ++i) {
+        const xt_event *expected = xtp_get_event(parser, i),
+                       *got = xts_get(first + i, &buf);
+        mismatches += !got || (got->rec).id != (expected->rec).id ||
+                        (got->rec).tsc != (expected->rec).tsc;
+    }
+    expect(!mismatches, check, "%zu records differ", mismatches);
+
+    if (parser)
+        xtp_free(parser);
+    if (pending)
+        xtp_free(pending);
+    xts_free();
+}
+
+//
+// Progressive load
+//
+
+#define BGLOAD_CPUS 4
+#define BGLOAD_WINDOWS 120
+#define BGLOAD_WINDOW_RECORDS 500
+
+/**
+ * Writes a trace whose pCPUs fill their windows at different paces
+ * (written once full, in the order they filled), switching domain
+ * every few records.
+ */
+static bool write_bgload_trace(FILE *fp)
+{
+    uint64_t next_tsc[BGLOAD_CPUS];
+    int n_windows[BGLOAD_CPUS] = { 0 };
+    for (int cpu = 0; cpu < BGLOAD_CPUS; ++cpu)
+        next_tsc[cpu] = 1000 + cpu;
+
+    for (int w = 0; w < BGLOAD_WINDOWS; ++w) {
+        // The pCPU filling its window first: pCPU N writes a record
+        // every (N + 1) * 8 cycles (distinct TSCs)
+        int cpu = 0;
+        for (int c = 1; c < BGLOAD_CPUS; ++c) {
+            if (next_tsc[c] + BGLOAD_WINDOW_RECORDS * (c + 1) * 8 <
+                    next_tsc[cpu] + BGLOAD_WINDOW_RECORDS * (cpu + 1) * 8)
+                cpu = c;
+        }
+
+        uint32_t header[3] = {
+            TRC_TRACE_CPU_CHANGE | (2 << TRACE_EXTRA_SHIFT), cpu,
+            BGLOAD_WINDOW_RECORDS * 7 * sizeof(uint32_t)
+        };
+        fwrite(header, sizeof(header), 1, fp);
+        for (int r = 0; r < BGLOAD_WINDOW_RECORDS; ++r) {
+            uint64_t tsc = next_tsc[cpu];
+            next_tsc[cpu] += (cpu + 1) * 8;
+            // Domain 1 + N on pCPU N, vCPU changing every window
+            uint32_t id = (r == 100) ? TRC_SCHED_SWITCH : TRC_SCHED_MIN,
+                     record[7] = {
+                id | (4 << TRACE_EXTRA_SHIFT) | TRC_HD_CYCLE_FLAG,
+                tsc, tsc >> 32, 0, 0, 1 + cpu, n_windows[cpu]
+            };
+            fwrite(record, sizeof(record), 1, fp);
+        }
+        n_windows[cpu]++;
+    }
+    return !ferror(fp);
+}
+
+/**
+ * Records loaded by a preview and then appended chunk by chunk are
+ * the ones of the whole trace loaded at once.
+ */
+static void check_bgload_chunks()
+{
+    const char *check = "bgload_chunks";
+    char path[] = "/tmp/xtcheck-XXXXXX";
+    int fd = mkstemp(path);
+    FILE *fp = (fd < 0) ? NULL : fdopen(fd, "w");
+    expect(fp, check, "cannot create a trace");
+    if (!fp)
+        return;
+    expect(write_bgload_trace(fp), check, "cannot write the trace");
+    off_t size = ftello(fp);
+    fclose(fp);
+
+    xentrace_parser parser = xtp_init(path);
+    size_t n = parser ? xtp_execute(parser) : 0;
+    expect(n == BGLOAD_WINDOWS * BGLOAD_WINDOW_RECORDS, check, "%zu records parsed", n);
+    xt_event *expected = calloc(n ? n : 1, sizeof(*expected));
+    for (size_t i = 0; expected && i < n; ++i)
+        expected[i] = *xtp_get_event(parser, i);
+    if (parser)
+        xtp_free(parser);
+
+    // A tenth of the trace in the preview, the rest in about 8 chunks
+    struct xtbg_limit limit = { 0, size / 10 };
+    int n_cpus = 0,
+        ret = xtbg_preview(path, &limit, &n_cpus);
+    expect(!ret && xts_count() < n, check, "preview failed (%d, %zu records)", ret, xts_count());
+    if (!ret)
+        ret = xtbg_start(path, size / 8);
+    expect(!ret, check, "cannot start the background load (%d)", ret);
+
+    // Appended while the load goes on, as at each reload of the stream
+    struct xtbg_progress progress = { .state = XTBG_PARSING };
+    int n_commits = 0;
+    while (!ret && progress.state != XTBG_IDLE) {
+        xtbg_progress(&progress);
+        ret = xtbg_commit(&n_cpus);
+        if (ret > 0)
+            n_commits++;
+        ret = (ret < 0) ? ret : 0;
+        usleep(100);
+    }
+    expect(!ret && !xtbg_preview_end() && n_commits > 1, check,
+            "background load failed (%d, %d commits, %"PRIu64" bytes held)",
+            ret, n_commits, xtbg_preview_end());
+    expect(n_cpus == BGLOAD_CPUS, check, "%d pCPUs", n_cpus);
+
+    xt_event buf;
+    size_t mismatches = 0;
+    for (size_t i = 0; expected && i < n; ++i) {
+        const xt_event *got = xts_get(i, &buf);
+        mismatches += !got || got->cpu != expected[i].cpu ||
+                        (got->dom).u32 != (expected[i].dom).u32 ||
+                        (got->rec).id != (expected[i].rec).id ||
+                        (got->rec).tsc != (expected[i].rec).tsc ||
+                        memcmp((got->rec).extra, (expected[i].rec).extra,
+                                sizeof((got->rec).extra));
+    }
+    expect(xts_count() == n && !mismatches, check, "%zu records, %zu differ",
+            xts_count(), mismatches);
+
+    // Stopped while it goes on
+    limit.bytes = size / 10;
+    if (!xtbg_preview(path, &limit, &n_cpus) && !xtbg_start(path, size / 8))
+        xtbg_stop();
+    expect(xtbg_preview_end() == 0, check, "preview not forgotten");
+
+    unlink(path);
+    free(expected);
+    xtbg_stop();
+    xts_free();
+}
+
+//
+// Trace loss
+//
+
+static int64_t tsc_identity(uint64_t tsc)
+{
+    return tsc;
+}
+
+/**
+ * Records out of the time span of the trace (e.g. the ones found
+ * before the first TSC of their pCPU) are not accounted, and a pCPU
+ * silent for more than TLOSS_GAP_NS has a gap.
+ */
+static void check_tloss_range_gaps()
+{
+    const char *check = "tloss_range_gaps";
+    const int64_t base = 5 * TLOSS_GAP_NS;
+    tloss_init(2, tsc_identity, base, base + 10 * TLOSS_GAP_NS);
+
+    struct xtr_record rec = { .id = TRC_LOST_RECORDS, .n_extra = 4, .cpu = 0 };
+    rec.extra[0] = 1000;
+    // Before the trace (no TSC yet) and far after it
+    tloss_feed(&rec, 0);
+    tloss_feed(&rec, INT64_MAX / 2);
+    expect(tloss_total_lost() == 0, check, "%"PRIu64" records lost out of the trace",
+            tloss_total_lost());
+
+    // pCPU 1: records every 10ms, then silent for 3 gaps
+    rec = (struct xtr_record) { .id = TRC_SCHED_MIN, .cpu = 1 };
+    for (int64_t ts = base; ts < base + TLOSS_GAP_NS; ts += TLOSS_GAP_NS / 10)
+        tloss_feed(&rec, ts);
+    tloss_feed(&rec, base + 4 * TLOSS_GAP_NS);
+    tloss_finish();
+
+    expect(tloss_gaps(0) == 0, check, "pCPU 0 has %zu gaps", tloss_gaps(0));
+    expect(tloss_gaps(1) == 1, check, "pCPU 1 has %zu gaps", tloss_gaps(1));
+    tloss_free();
+
+    // A record at time 0 is a previous record like any other
+    tloss_init(1, tsc_identity, 0, 10 * TLOSS_GAP_NS);
+    rec = (struct xtr_record) { .id = TRC_SCHED_MIN, .cpu = 0 };
+    tloss_feed(&rec, 0);
+    tloss_feed(&rec, 2 * TLOSS_GAP_NS);
+    tloss_finish();
+    expect(tloss_gaps(0) == 1, check, "%zu gaps after a record at 0", tloss_gaps(0));
+    tloss_free();
+}
+
+static const struct {
+    const char *name;
+    void (*run)();
+} checks[] = {
+    { "bgload_chunks", check_bgload_chunks },
+    { "csched2_schedule", check_csched2_schedule },
+    { "filter_visibility", check_filter_visibility },
+    { "index_positions", check_index_positions },
+    { "power_idle_exit", check_power_idle_exit },
+    { "probe_unaligned_tail", check_probe_unaligned_tail },
+    { "series_cache", check_series_cache },
+    { "store_commit_rollback", check_store_commit_rollback },
+    { "store_positions", check_store_positions },
+    { "tloss_range_gaps", check_tloss_range_gaps },
+};
+
+int main(int argc, char **argv)
+{
+    int n_run = 0;
+    for (size_t i = 0; i < sizeof(checks) / sizeof(checks[0]); ++i) {
+        // Only the checks named on the command line (if any)
+        bool selected = argc < 2;
+        for (int a = 1; a < argc; ++a)
+            selected |= !strcmp(argv[a], checks[i].name);
+        if (!selected)
+            continue;
+
+        int before = failures;
+        checks[i].run();
+        printf("%-24s %s\n", checks[i].name, (failures == before) ? "ok" : "FAILED");
+        n_run++;
+    }
+
+    if (!n_run) {
+        fprintf(stderr, "Usage: %s [check...]\n", argv[0]);
+        return 1;
+    }
+    return failures != 0;
+}
@@ -0,0 +1,272 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef _GNU_SOURCE
+/** Use GNU C Library. */
+#define _GNU_SOURCE
+#endif // _GNU_SOURCE
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Xen Project
+#include <trace.h>
+// XenTrace-Parser
+#include "xentrace-event.h"
+// Entry indexes
+#include "index/index.h"
+
+#include "bench.h"
+
+/*
+ * Loads a trace through the input plugin (as KernelShark does, but
+ * without the GUI) and prints a summary of its content: records per
+ * event class and subclass, per pCPU and per domain, duration and rates.
+ */
+
+#define NS_PER_SEC 1000000000LL
+#define MAX_CPUS 4096
+#define MAX_DOMS 0x8000
+// Subclasses: class (12 bits) and subclass (4 bits)
+#define MAX_SUBCLS 0x10000
+#define TOP_EVENTS 20
+
+static const struct {
+    uint32_t cls;
+    const char *name;
+} class_names[] = {
+    { TRC_GEN, "gen" },
+    { TRC_SCHED, "sched" },
+    { TRC_DOM0OP, "dom0" },
+    { TRC_HVM, "hvm" },
+    { TRC_MEM, "mem" },
+    { TRC_PV, "pv" },
+    { TRC_SHADOW, "shadow" },
+    { TRC_HW, "hw" },
+    { TRC_GUEST, "guest" }
+};
+
+static struct {
+    uint64_t subcls[MAX_SUBCLS],
+             cpus[MAX_CPUS],
+             doms[MAX_DOMS],
+             idle,
+             dflt,
+             *events;
+    int n_events;
+    int64_t first_ts,
+            last_ts;
+} T;
+
+static int64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+static const char *class_name(uint32_t subcls)
+{
+    for (size_t i = 0; i < sizeof(class_names) / sizeof(*class_names); ++i)
+        if ((class_names[i].cls >> TRC_SUBCLS_SHIFT) >> 4 == subcls >> 4)
+            return class_names[i].name;
+    return "unknown";
+}
+
+/**
+ * Accounts an entry. The task id of the entry is the domain/vCPU
+ * pair plus one (0 for the idle domain).
+ */
+static void account(const struct kshark_entry *entry)
+{
+    uint32_t id = evids_full(entry->event_id);
+    T.subcls[(id >> TRC_SUBCLS_SHIFT) & (MAX_SUBCLS - 1)]++;
+    if (entry->event_id >= 0 && entry->event_id < T.n_events)
+        T.events[entry->event_id]++;
+    if (entry->cpu >= 0 && entry->cpu < MAX_CPUS)
+        T.cpus[entry->cpu]++;
+
+    if (!entry->pid)
+        T.idle++;
+    else if (entry->pid == XEN_DOM_DFLT)
+        T.dflt++;
+    else
+        T.doms[((uint32_t)(entry->pid - 1) >> 16) & (MAX_DOMS - 1)]++;
+}
+
+static double rate(uint64_t count, double secs)
+{
+    return (secs > 0) ? count / secs : 0;
+}
+
+static void print_summary(struct kshark_data_stream *stream, ssize_t n_rows,
+                            int64_t init_ns, int64_t load_ns)
+{
+    struct kshark_generic_stream_interface *interface = stream->interface;
+    double secs = (double)(T.last_ts - T.first_ts) / NS_PER_SEC;
+
+    printf("trace: %s\n", stream->file);
+    printf("records: %zd, events: %d, pCPUs: %d\n", n_rows, T.n_events, stream->n_cpus);
+    printf("duration: %.6f s, rate: %.0f records/s\n", secs, rate(n_rows, secs));
+    printf("load: %.3f s (parse %.3f s, entries %.3f s), %.1f ns/record\n",
+            (init_ns + load_ns) / 1e9, init_ns / 1e9, load_ns / 1e9,
+            n_rows ? (double)(init_ns + load_ns) / n_rows : 0);
+
+    printf("\n# class records %% records/s\n");
+    for (int cls = 0; cls < MAX_SUBCLS; cls += 16) {
+        uint64_t count = 0;
+        for (int sub = 0; sub < 16; ++sub)
+            count += T.subcls[cls + sub];
+        if (count)
+            printf("%-8s %"PRIu64" %.2f %.0f\n", class_name(cls), count,
+                    100.0 * count / n_rows, rate(count, secs));
+    }
+
+    printf("\n# subclass class records %% records/s\n");
+    for (int sub = 0; sub < MAX_SUBCLS; ++sub)
+        if (T.subcls[sub])
+            printf("0x%05x %-8s %"PRIu64" %.2f %.0f\n", sub, class_name(sub), T.subcls[sub],
+                    100.0 * T.subcls[sub] / n_rows, rate(T.subcls[sub], secs));
+
+    printf("\n# pcpu records %% records/s\n");
+    for (int cpu = 0; cpu < MAX_CPUS; ++cpu)
+        if (T.cpus[cpu])
+            printf("%d %"PRIu64" %.2f %.0f\n", cpu, T.cpus[cpu],
+                    100.0 * T.cpus[cpu] / n_rows, rate(T.cpus[cpu], secs));
+
+    printf("\n# domain records %% records/s\n");
+    if (T.idle)
+        printf("idle %"PRIu64" %.2f %.0f\n", T.idle, 100.0 * T.idle / n_rows, rate(T.idle, secs));
+    if (T.dflt)
+        printf("default %"PRIu64" %.2f %.0f\n", T.dflt, 100.0 * T.dflt / n_rows, rate(T.dflt, secs));
+    for (int dom = 0; dom < MAX_DOMS; ++dom)
+        if (T.doms[dom])
+            printf("d%d %"PRIu64" %.2f %.0f\n", dom, T.doms[dom],
+                    100.0 * T.doms[dom] / n_rows, rate(T.doms[dom], secs));
+
+    printf("\n# top events: event records %%\n");
+    for (int n = 0; n < TOP_EVENTS; ++n) {
+        int top = -1;
+        for (int i = 0; i < T.n_events; ++i)
+            if (T.events[i] && (top < 0 || T.events[i] > T.events[top]))
+                top = i;
+        if (top < 0)
+            break;
+
+        struct kshark_entry entry = { .event_id = top };
+        char *name = interface->get_event_name(stream, &entry);
+        printf("%s %"PRIu64" %.2f\n", name ? name : "?", T.events[top],
+                100.0 * T.events[top] / n_rows);
+        free(name);
+        T.events[top] = 0;
+    }
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-d] <trace.xen>\n"
+                    "  -d  prints every record (as KernelShark \"dump_entry\")\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    int dump = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "dh")) != -1) {
+        switch (opt) {
+            case 'd':
+                dump = 1;
+                break;
+            default:
+                usage(argv[0]);
+                return opt != 'h';
+        }
+    }
+
+    if (argc - optind != 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    struct kshark_data_stream stream = { .file = argv[optind] };
+    struct kshark_entry **rows = NULL;
+    bench_stream = &stream;
+
+    if (!KSHARK_INPUT_CHECK(stream.file, NULL)) {
+        fprintf(stderr, "\"%s\" is not a XenTrace file.\n", stream.file);
+        return 1;
+    }
+
+    int64_t t0 = now_ns();
+    int ret = KSHARK_INPUT_INITIALIZER(&stream);
+    if (ret) {
+        fprintf(stderr, "Cannot load \"%s\": %s\n", stream.file, strerror(-ret));
+        return 1;
+    }
+
+    int64_t t1 = now_ns();
+    struct kshark_generic_stream_interface *interface = stream.interface;
+    ssize_t n_rows = interface->load_entries(&stream, NULL, &rows);
+    int64_t t2 = now_ns();
+    if (n_rows < 0) {
+        fprintf(stderr, "Cannot load \"%s\": %s\n", stream.file, strerror(-n_rows));
+        KSHARK_INPUT_DEINITIALIZER(&stream);
+        return 1;
+    }
+
+    T.n_events = evids_count();
+    T.events = calloc(T.n_events ? T.n_events : 1, sizeof(*T.events));
+    for (ssize_t i = 0; i < n_rows; ++i) {
+        if (!rows[i])
+            continue;
+
+        if (i == 0 || rows[i]->ts < T.first_ts)
+            T.first_ts = rows[i]->ts;
+        if (rows[i]->ts > T.last_ts)
+            T.last_ts = rows[i]->ts;
+        if (T.events)
+            account(rows[i]);
+
+        if (dump) {
+            char *line = interface->dump_entry(&stream, rows[i]);
+            if (line)
+                puts(line);
+            free(line);
+        }
+    }
+
+    if (!dump && T.events)
+        print_summary(&stream, n_rows, t1 - t0, t2 - t1);
+
+    for (ssize_t i = 0; i < n_rows; ++i)
+        free(rows[i]);
+    free(rows);
+    free(T.events);
+    KSHARK_INPUT_DEINITIALIZER(&stream);
+    free(stream.interface);
+    return 0;
+}
@@ -0,0 +1,386 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef __KSXT_ANALYSIS
+#define __KSXT_ANALYSIS
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+// XenTrace-Parser
+#include "xentrace-event.h"
+// Raw trace reader
+#include "raw/xtraw.h"
+// Timestamp column
+#include "store/store.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Reassembles a 64-bit value split in two 32-bit words
+#define U64_FROM_WORDS(_hi, _lo) (((uint64_t)(_hi) << 32) | (uint32_t)(_lo))
+
+/**
+ * Returns the KernelShark task id (PID) of a domain/vCPU pair.
+ * The idle domain is mapped to 0 (the stream "idle_pid").
+ */
+static inline int get_task_id(xt_domain dom)
+{
+    if (dom.id == XEN_DOM_IDLE)
+        return 0;
+    return (dom.id == XEN_DOM_DFLT) ? XEN_DOM_DFLT : dom.u32 + 1;
+}
+
+//
+// pCPU occupancy | occupancy.c
+//
+
+// Interval of time in which a (non idle)
+// domain/vCPU was running on a pCPU.
+struct run_interval {
+    int64_t start,
+            end;
+    int task_id;
+};
+
+int occupancy_init(int n_cpus);
+void occupancy_feed(const xt_event *event, int64_t ts);
+void occupancy_finish();
+ssize_t occupancy_get(int cpu, const struct run_interval **intervals);
+ssize_t occupancy_find(int cpu, int64_t ts);
+void occupancy_free();
+
+//
+// Decimated time series | series.c
+//
+
+#define SERIES_MAX_LEVELS 8
+// Points of a level over the points of the next one
+#define SERIES_LEVEL_FACTOR 8
+// A level is not built if it would have fewer points
+#define SERIES_MIN_POINTS 1024
+
+struct series_points {
+    struct ts_column ts;
+    double *val;
+    size_t size,
+           capacity;
+};
+
+// Last decimation of a series, reused while the window does not change
+struct series_cache {
+    int64_t from,
+            to;
+    size_t n_out,
+           n;
+    bool valid;
+    int64_t *out_ts;
+    double *out_val;
+    // Timestamps of the window, decoded
+    int64_t *ts;
+    size_t ts_cap;
+};
+
+// Raw points (level 0) and their LTTB downsamplings
+struct time_series {
+    struct series_points levels[SERIES_MAX_LEVELS];
+    // Set by "series_build_levels" (NULL if out of memory)
+    struct series_cache *cache;
+};
+
+struct series_slot {
+    uint32_t key;
+    int used;
+    struct time_series series;
+};
+
+// Hash table of time series
+struct series_set {
+    struct series_slot *slots;
+    size_t size,
+           capacity;
+};
+
+int series_append(struct time_series *s, int64_t ts, double val);
+void series_build_levels(struct time_series *s);
+size_t series_decimate(const struct time_series *s, int64_t from, int64_t to,
+                        size_t n_out, int64_t *out_ts, double *out_val);
+void series_free(struct time_series *s);
+
+struct time_series *series_set_get(struct series_set *set, uint32_t key);
+const struct time_series *series_set_find(const struct series_set *set, uint32_t key);
+void series_set_build_levels(struct series_set *set);
+void series_set_free(struct series_set *set);
+
+//
+// Credit2 runqueue state | csched2.c
+//
+
+enum csched2_series {
+    CS2_VCPU_CREDIT,
+    CS2_VCPU_LOAD,
+    CS2_RUNQ_LOAD,
+    CS2_RUNQ_BLOAD,
+    CS2_N_SERIES
+};
+
+int csched2_init(int n_cpus);
+void csched2_feed(const xt_event *event, int64_t ts);
+void csched2_finish();
+const struct time_series *csched2_series(enum csched2_series kind, int id);
+void csched2_free();
+
+//
+// Trace loss and buffer pressure | tloss.c
+//
+
+struct kshark_context;
+struct kshark_entry;
+
+// Time without records of a pCPU reported as a gap (100ms)
+#define TLOSS_GAP_NS 100000000LL
+
+// Time window in which records of a pCPU were lost
+struct loss_window {
+    int64_t start,
+            end;
+    uint32_t lost;
+};
+
+int tloss_init(int n_cpus, int64_t (*to_ns)(uint64_t), int64_t base_ts, int64_t last_ts);
+void tloss_feed(const struct xtr_record *rec, int64_t ts);
+void tloss_finish();
+uint64_t tloss_total_lost();
+void tloss_report(FILE *fp);
+size_t tloss_gaps(int cpu);
+ssize_t tloss_windows(int cpu, const struct loss_window **windows);
+bool tloss_match_lossy(struct kshark_context *kshark_ctx,
+                        struct kshark_entry *entry, int sd, int *values);
+void tloss_free();
+
+//
+// Log-linear histogram | lhist.c
+//
+
+// Linear sub-buckets per power of two
+#define LHIST_SUB_BITS 3
+#define LHIST_BUCKETS ((64 - LHIST_SUB_BITS + 1) << LHIST_SUB_BITS)
+
+struct lhist {
+    uint64_t counts[LHIST_BUCKETS];
+    uint64_t count,
+             sum,
+             max;
+};
+
+void lhist_add(struct lhist *h, uint64_t val);
+uint64_t lhist_percentile(const struct lhist *h, double p);
+
+//
+// Physical IRQ handling | irqstat.c
+//
+
+// Occurrences kept for the "worst" list
+#define IRQSTAT_WORST 64
+
+enum irqstat_kind {
+    IRQSTAT_IRQ,
+    IRQSTAT_CPU
+};
+
+// A single "do_irq" record
+struct irq_occurrence {
+    int irq,
+        cpu;
+    int64_t ts;
+    uint64_t duration;
+    // Row of the record (NULL if not loaded)
+    struct kshark_entry *entry;
+};
+
+// Statistics of an IRQ or of a pCPU
+struct irq_stats {
+    // Handling time (ns)
+    struct lhist hist;
+    // Vector moves and assignments (IRQs only)
+    uint64_t moves,
+             assigns;
+    int64_t first_ts,
+            last_ts;
+    // Highest number of interrupts in a second
+    uint64_t peak_rate,
+             sec_count;
+    int64_t sec;
+    struct irq_occurrence worst;
+};
+
+int irqstat_init(int64_t (*cycles_to_ns)(uint64_t));
+void irqstat_feed(const xt_event *event, int64_t ts, struct kshark_entry *entry);
+void irqstat_finish();
+int irqstat_count(enum irqstat_kind kind);
+const struct irq_stats *irqstat_get(enum irqstat_kind kind, int id);
+double irqstat_rate(const struct irq_stats *stats);
+size_t irqstat_worst(const struct irq_occurrence **worst);
+void irqstat_free();
+
+//
+// C-state and frequency residency | power.c
+//
+
+enum power_kind {
+    POWER_CSTATE,
+    POWER_FREQ,
+    POWER_N_KINDS
+};
+
+// Interval of time a pCPU spent in a C-state
+// or at a frequency (MHz).
+struct state_interval {
+    int64_t start,
+            end;
+    uint32_t state;
+};
+
+int power_init(int n_cpus);
+void power_feed(const xt_event *event, int64_t ts);
+void power_finish();
+ssize_t power_get(int cpu, enum power_kind kind, const struct state_interval **intervals);
+int power_states(int cpu, enum power_kind kind, uint32_t *states, int max);
+int64_t power_residency(int cpu, enum power_kind kind, uint32_t state,
+                            int64_t from, int64_t to);
+bool power_span(int cpu, int64_t *from, int64_t *to);
+int power_cpus_count();
+void power_free();
+
+//
+// Space-saving top-K summary | topk.c
+//
+
+#define TOPK_SIZE 64
+#define TOPK_INDEX_SIZE (2 * TOPK_SIZE)
+
+struct topk_counter {
+    uint64_t key,
+             count,
+             // Maximum overestimation of "count"
+             error;
+    // First occurrence since the key is tracked
+    int64_t first_ts;
+    struct kshark_entry *first_entry;
+};
+
+struct topk {
+    struct topk_counter counters[TOPK_SIZE];
+    // Min-heap of counters (by count) and position of each counter
+    uint8_t heap[TOPK_SIZE],
+            pos[TOPK_SIZE];
+    // Counter of each key (-1 if empty)
+    int8_t index[TOPK_INDEX_SIZE];
+    int size;
+};
+
+void topk_init(struct topk *t);
+void topk_add(struct topk *t, uint64_t key, int64_t ts, struct kshark_entry *entry);
+size_t topk_sorted(const struct topk *t, struct topk_counter *out);
+
+//
+// Shadow paging heavy hitters | shadow.c
+//
+
+// Shadow event types (low 8 bits of the id), 0 is "all"
+#define SHADOW_TYPES 16
+#define SHADOW_ALL_TYPES 0
+
+enum shadow_key {
+    SHADOW_VA,
+    SHADOW_GFN,
+    SHADOW_N_KEYS
+};
+
+struct shadow_dom {
+    uint16_t dom;
+    struct topk topk[SHADOW_TYPES][SHADOW_N_KEYS];
+};
+
+void shadow_init();
+void shadow_feed(const xt_event *event, int64_t ts, struct kshark_entry *entry);
+int shadow_type_name(int type, char *result_str);
+void shadow_report(FILE *fp);
+int shadow_doms(const struct shadow_dom *const **doms);
+void shadow_free();
+
+//
+// PV hypercall and trap profile | pvprof.c
+//
+
+// Granularity of the windowed counts (10ms)
+#define PVPROF_BUCKET_NS 10000000LL
+
+enum pv_kind {
+    PV_HYPERCALL,
+    PV_SUBCALL,
+    PV_TRAP,
+    PV_OTHER
+};
+
+// Running total at the end of a (non empty) time bucket
+struct pv_bucket {
+    uint32_t index;
+    uint64_t cum;
+};
+
+// Occurrences of a hypercall/subcall (by op),
+// trap (by vector) or other PV entry of a domain
+struct pv_stats {
+    uint16_t dom;
+    uint8_t kind;
+    uint32_t number;
+    uint64_t count;
+    int64_t first_ts,
+            last_ts;
+    struct lhist inter_arrival;
+    struct pv_bucket *buckets;
+    size_t n_buckets,
+           buckets_cap;
+};
+
+struct pv_top {
+    const struct pv_stats *stats;
+    uint64_t count;
+};
+
+void pvprof_init();
+void pvprof_feed(const xt_event *event, int64_t ts);
+size_t pvprof_stats(const struct pv_stats **stats);
+uint64_t pvprof_count(const struct pv_stats *s, int64_t from, int64_t to);
+double pvprof_peak_rate(const struct pv_stats *s);
+size_t pvprof_top(int64_t from, int64_t to, struct pv_top *top, size_t n);
+int pvprof_name(const struct pv_stats *s, char *result_str);
+void pvprof_free();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
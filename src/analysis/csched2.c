@@ -0,0 +1,193 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef _GNU_SOURCE
+/** Use GNU C Library. */
+#define _GNU_SOURCE
+#endif // _GNU_SOURCE
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Xen Project
+#include <trace.h>
+
+#include "analysis.h"
+
+#define CSCHED2_EVT(_e) TRC_SCHED_CLASS_EVT(CSCHED2, _e)
+
+#define TRC_CSCHED2_CREDIT_BURN     CSCHED2_EVT(3)
+#define TRC_CSCHED2_CREDIT_RESET    CSCHED2_EVT(7)
+#define TRC_CSCHED2_UPDATE_VCPU_LOAD CSCHED2_EVT(11)
+#define TRC_CSCHED2_UPDATE_RUNQ_LOAD CSCHED2_EVT(12)
+#define TRC_CSCHED2_LOAD_BALANCE    CSCHED2_EVT(17)
+#define TRC_CSCHED2_SCHEDULE        CSCHED2_EVT(20)
+
+// Xen default "load_precision_shift", used
+// until the one of a runqueue is known.
+#define DEFAULT_LOAD_SHIFT 18
+
+static struct {
+    struct series_set sets[CS2_N_SERIES];
+    // Runqueue of each pCPU (-1 if unknown)
+    int *cpu_runq;
+    int n_cpus;
+    // Last "load_precision_shift" seen
+    int load_shift;
+} C;
+
+/**
+ * Returns the task id of a packed "dom:vcpu" word.
+ */
+static int vcpu_task_id(uint32_t dom_vcpu)
+{
+    xt_domain dom = { .u32 = 0 };
+    dom.id = dom_vcpu >> 16;
+    dom.vcpu = dom_vcpu & 0xffff;
+    return get_task_id(dom);
+}
+
+static void append(int kind, uint32_t key, int64_t ts, double val)
+{
+    struct time_series *s = series_set_get(&C.sets[kind], key);
+    if (s)
+        series_append(s, ts, val);
+}
+
+static double load_value(uint64_t avgload, int shift)
+{
+    return (double)avgload / (double)(1ULL << shift);
+}
+
+static int grow_cpus(int n_cpus)
+{
+    int *tmp = realloc(C.cpu_runq, n_cpus * sizeof(*tmp));
+    if (!tmp)
+        return -ENOMEM;
+
+    for (int i = C.n_cpus; i < n_cpus; ++i)
+        tmp[i] = -1;
+
+    C.cpu_runq = tmp;
+    C.n_cpus = n_cpus;
+    return 0;
+}
+
+static void set_cpu_runq(int cpu, int rq_id, int overwrite)
+{
+    if (cpu >= C.n_cpus && grow_cpus(cpu + 1))
+        return;
+
+    if (overwrite || C.cpu_runq[cpu] < 0)
+        C.cpu_runq[cpu] = rq_id;
+}
+
+int csched2_init(int n_cpus)
+{
+    csched2_free();
+    C.load_shift = DEFAULT_LOAD_SHIFT;
+    return grow_cpus(n_cpus > 0 ? n_cpus : 1);
+}
+
+/**
+ * Reconstructs the credit and the load of each vCPU and the
+ * average load of each runqueue from the csched2 events.
+ * The 64-bit loads are split in two words (low word first).
+ */
+void csched2_feed(const xt_event *event, int64_t ts)
+{
+    const uint32_t *extra = (event->rec).extra;
+
+    switch ((event->rec).id) {
+        case TRC_CSCHED2_CREDIT_BURN:
+            append(CS2_VCPU_CREDIT, vcpu_task_id(extra[0]), ts, (int32_t)extra[1]);
+            break;
+        case TRC_CSCHED2_CREDIT_RESET:
+            append(CS2_VCPU_CREDIT, vcpu_task_id(extra[0]), ts, (int32_t)extra[2]);
+            break;
+        case TRC_CSCHED2_UPDATE_VCPU_LOAD:
+            append(CS2_VCPU_LOAD, vcpu_task_id(extra[2]), ts,
+                    load_value(U64_FROM_WORDS(extra[1], extra[0]), extra[3] & 0x3f));
+            break;
+        case TRC_CSCHED2_UPDATE_RUNQ_LOAD: {
+            // rq_load[16]:rq_id[8]:shift[8]
+            int rq_id = (extra[4] >> 16) & 0xff,
+                shift = (extra[4] >> 24) & 0x3f;
+            C.load_shift = shift;
+            append(CS2_RUNQ_LOAD, rq_id, ts,
+                    load_value(U64_FROM_WORDS(extra[1], extra[0]), shift));
+            append(CS2_RUNQ_BLOAD, rq_id, ts,
+                    load_value(U64_FROM_WORDS(extra[3], extra[2]), shift));
+            set_cpu_runq(event->cpu, rq_id, 0);
+            break;
+        }
+        case TRC_CSCHED2_LOAD_BALANCE: {
+            // lrq_id[16]:orq_id[16]
+            int lrq_id = extra[4] & 0xffff,
+                orq_id = extra[4] >> 16;
+            append(CS2_RUNQ_BLOAD, lrq_id, ts,
+                    load_value(U64_FROM_WORDS(extra[1], extra[0]), C.load_shift));
+            append(CS2_RUNQ_BLOAD, orq_id, ts,
+                    load_value(U64_FROM_WORDS(extra[3], extra[2]), C.load_shift));
+            break;
+        }
+        case TRC_CSCHED2_SCHEDULE:
+            // cpu[16] (low half), rq_id[16] (high half)
+            set_cpu_runq(extra[0] & 0xffff, extra[0] >> 16, 1);
+            break;
+    }
+}
+
+/**
+ * Builds the decimated levels of all the series.
+ */
+void csched2_finish()
+{
+    for (int i = 0; i < CS2_N_SERIES; ++i)
+        series_set_build_levels(&C.sets[i]);
+}
+
+/**
+ * Returns a series of a vCPU (CS2_VCPU_*) given its task id,
+ * or of a runqueue (CS2_RUNQ_*) given a pCPU belonging to it.
+ */
+const struct time_series *csched2_series(enum csched2_series kind, int id)
+{
+    if (kind == CS2_RUNQ_LOAD || kind == CS2_RUNQ_BLOAD) {
+        if (id < 0 || id >= C.n_cpus || C.cpu_runq[id] < 0)
+            return NULL;
+        id = C.cpu_runq[id];
+    }
+
+    return series_set_find(&C.sets[kind], id);
+}
+
+void csched2_free()
+{
+    for (int i = 0; i < CS2_N_SERIES; ++i)
+        series_set_free(&C.sets[i]);
+
+    free(C.cpu_runq);
+    C.cpu_runq = NULL;
+    C.n_cpus = 0;
+}
@@ -0,0 +1,227 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef _GNU_SOURCE
+/** Use GNU C Library. */
+#define _GNU_SOURCE
+#endif // _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Xen Project
+#include <trace.h>
+
+#include "analysis.h"
+
+#define NS_PER_SEC 1000000000LL
+
+// Statistics indexed by IRQ number or pCPU
+struct stats_table {
+    struct irq_stats **stats;
+    int size;
+};
+
+static struct {
+    struct stats_table tables[2];
+    // Worst occurrences, sorted by decreasing duration
+    struct irq_occurrence worst[IRQSTAT_WORST];
+    size_t n_worst;
+    int64_t (*cycles_to_ns)(uint64_t);
+} Q;
+
+static struct irq_stats *get_stats(enum irqstat_kind kind, int id)
+{
+    struct stats_table *table = &Q.tables[kind];
+    if (id < 0)
+        return NULL;
+
+    if (id >= table->size) {
+        int size = table->size ? table->size : 16;
+        while (size <= id)
+            size *= 2;
+
+        struct irq_stats **tmp = realloc(table->stats, size * sizeof(*tmp));
+        if (!tmp)
+            return NULL;
+
+        memset(tmp + table->size, 0, (size - table->size) * sizeof(*tmp));
+        table->stats = tmp;
+        table->size = size;
+    }
+
+    if (!table->stats[id])
+        table->stats[id] = calloc(1, sizeof(struct irq_stats));
+    return table->stats[id];
+}
+
+/**
+ * Closes the current second of an IRQ/pCPU if "ts" is past it.
+ */
+static void account_rate(struct irq_stats *s, int64_t ts)
+{
+    int64_t sec = ts / NS_PER_SEC;
+    if (sec != s->sec) {
+        if (s->sec_count > s->peak_rate)
+            s->peak_rate = s->sec_count;
+        s->sec = sec;
+        s->sec_count = 0;
+    }
+    s->sec_count++;
+}
+
+static void account_handled(struct irq_stats *s, const struct irq_occurrence *occ)
+{
+    if (!s->hist.count)
+        s->first_ts = occ->ts;
+    s->last_ts = occ->ts;
+
+    lhist_add(&s->hist, occ->duration);
+    account_rate(s, occ->ts);
+
+    if (occ->duration >= s->worst.duration)
+        s->worst = *occ;
+}
+
+/**
+ * Inserts an occurrence in the (sorted) list of the worst ones.
+ */
+static void account_worst(const struct irq_occurrence *occ)
+{
+    if (Q.n_worst == IRQSTAT_WORST &&
+            occ->duration <= Q.worst[IRQSTAT_WORST - 1].duration)
+        return;
+
+    size_t i = (Q.n_worst < IRQSTAT_WORST) ? Q.n_worst++ : IRQSTAT_WORST - 1;
+    for (; i > 0 && Q.worst[i - 1].duration < occ->duration; --i)
+        Q.worst[i] = Q.worst[i - 1];
+    Q.worst[i] = *occ;
+}
+
+/**
+ * "cycles_to_ns" converts the (32-bit) cycle counts of "do_irq".
+ */
+int irqstat_init(int64_t (*cycles_to_ns)(uint64_t))
+{
+    irqstat_free();
+    Q.cycles_to_ns = cycles_to_ns;
+    return 0;
+}
+
+/**
+ * Accounts a TRC_HW_IRQ record.
+ */
+void irqstat_feed(const xt_event *event, int64_t ts, struct kshark_entry *entry)
+{
+    const xt_record *rec = &event->rec;
+    struct irq_stats *s;
+
+    switch (rec->id) {
+        case TRC_HW_IRQ_HANDLED: {
+            // irq, began, ended (low 32 bits of the cycle counter)
+            struct irq_occurrence occ = {
+                .irq = rec->extra[0],
+                .cpu = event->cpu,
+                .ts = ts,
+                .duration = Q.cycles_to_ns((uint32_t)(rec->extra[2] - rec->extra[1])),
+                .entry = entry
+            };
+
+            if ((s = get_stats(IRQSTAT_IRQ, occ.irq)))
+                account_handled(s, &occ);
+            if ((s = get_stats(IRQSTAT_CPU, occ.cpu)))
+                account_handled(s, &occ);
+            account_worst(&occ);
+            break;
+        }
+        case TRC_HW_IRQ_MOVE_FINISH:
+            // irq, old vector, old cpu
+            if ((s = get_stats(IRQSTAT_IRQ, rec->extra[0])))
+                s->moves++;
+            break;
+        case TRC_HW_IRQ_ASSIGN_VECTOR:
+            // irq, vector, cpu mask
+            if ((s = get_stats(IRQSTAT_IRQ, rec->extra[0])))
+                s->assigns++;
+            break;
+    }
+}
+
+/**
+ * Closes the last second of every IRQ/pCPU.
+ */
+void irqstat_finish()
+{
+    for (int k = 0; k < 2; ++k)
+        for (int i = 0; i < Q.tables[k].size; ++i) {
+            struct irq_stats *s = Q.tables[k].stats[i];
+            if (s && s->sec_count > s->peak_rate)
+                s->peak_rate = s->sec_count;
+        }
+}
+
+/**
+ * Returns the upper bound of the ids of a table.
+ */
+int irqstat_count(enum irqstat_kind kind)
+{
+    return Q.tables[kind].size;
+}
+
+/**
+ * Returns the statistics of an IRQ or of a pCPU
+ * (NULL if it never appeared in the trace).
+ */
+const struct irq_stats *irqstat_get(enum irqstat_kind kind, int id)
+{
+    if (id < 0 || id >= Q.tables[kind].size)
+        return NULL;
+    return Q.tables[kind].stats[id];
+}
+
+/**
+ * Returns the average number of interrupts per second.
+ */
+double irqstat_rate(const struct irq_stats *stats)
+{
+    int64_t span = stats->last_ts - stats->first_ts;
+    if (span <= 0)
+        return stats->hist.count;
+    return stats->hist.count * (double)NS_PER_SEC / span;
+}
+
+size_t irqstat_worst(const struct irq_occurrence **worst)
+{
+    *worst = Q.worst;
+    return Q.n_worst;
+}
+
+void irqstat_free()
+{
+    for (int k = 0; k < 2; ++k) {
+        for (int i = 0; i < Q.tables[k].size; ++i)
+            free(Q.tables[k].stats[i]);
+        free(Q.tables[k].stats);
+    }
+
+    memset(&Q, 0, sizeof(Q));
+}
@@ -0,0 +1,93 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef _GNU_SOURCE
+/** Use GNU C Library. */
+#define _GNU_SOURCE
+#endif // _GNU_SOURCE
+
+#include <stdint.h>
+
+#include "analysis.h"
+
+/**
+ * Returns the bucket of a value: values below 2^LHIST_SUB_BITS
+ * have their own bucket, the others are grouped by power of two
+ * and split in 2^LHIST_SUB_BITS linear sub-buckets.
+ */
+static unsigned bucket_of(uint64_t val)
+{
+    if (val < (1 << LHIST_SUB_BITS))
+        return val;
+
+    unsigned msb = 63 - __builtin_clzll(val),
+             shift = msb - LHIST_SUB_BITS,
+             bucket = ((shift + 1) << LHIST_SUB_BITS) |
+                        ((val >> shift) & ((1 << LHIST_SUB_BITS) - 1));
+
+    return (bucket < LHIST_BUCKETS) ? bucket : LHIST_BUCKETS - 1;
+}
+
+/**
+ * Returns the lowest value falling in a bucket.
+ */
+static uint64_t bucket_low(unsigned bucket)
+{
+    if (bucket < (1 << LHIST_SUB_BITS))
+        return bucket;
+
+    unsigned shift = (bucket >> LHIST_SUB_BITS) - 1;
+    uint64_t sub = bucket & ((1 << LHIST_SUB_BITS) - 1);
+    return ((1ULL << LHIST_SUB_BITS) | sub) << shift;
+}
+
+void lhist_add(struct lhist *h, uint64_t val)
+{
+    h->counts[bucket_of(val)]++;
+    h->count++;
+    h->sum += val;
+    if (val > h->max)
+        h->max = val;
+}
+
+/**
+ * Returns (an approximation of) the "p"-th percentile (0 < p <= 100).
+ */
+uint64_t lhist_percentile(const struct lhist *h, double p)
+{
+    if (!h->count)
+        return 0;
+
+    uint64_t rank = (uint64_t)(h->count * p / 100.0),
+             seen = 0;
+    if (rank >= h->count)
+        return h->max;
+
+    for (unsigned b = 0; b < LHIST_BUCKETS; ++b) {
+        seen += h->counts[b];
+        if (seen > rank) {
+            uint64_t low = bucket_low(b);
+            return (low < h->max) ? low : h->max;
+        }
+    }
+
+    return h->max;
+}
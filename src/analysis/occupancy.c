@@ -0,0 +1,200 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef _GNU_SOURCE
+/** Use GNU C Library. */
+#define _GNU_SOURCE
+#endif // _GNU_SOURCE
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Xen Project
+#include <trace.h>
+
+#include "analysis.h"
+
+#define INTERVALS_INIT_SIZE 256
+
+// Run intervals of a single pCPU
+struct cpu_intervals {
+    struct run_interval *data;
+    size_t size,
+           capacity;
+    // Domain/vCPU currently running
+    // (-1 if unknown) and since when.
+    int curr_task;
+    int64_t curr_start,
+            last_ts;
+};
+
+static struct {
+    struct cpu_intervals *cpus;
+    int n_cpus;
+} O;
+
+static int push_interval(struct cpu_intervals *c, int64_t end)
+{
+    if (c->size == c->capacity) {
+        size_t new_cap = c->capacity ? c->capacity * 2 : INTERVALS_INIT_SIZE;
+        struct run_interval *tmp = realloc(c->data, new_cap * sizeof(*tmp));
+        if (!tmp)
+            return -ENOMEM;
+        c->data = tmp;
+        c->capacity = new_cap;
+    }
+
+    c->data[c->size++] = (struct run_interval) {
+        .start = c->curr_start,
+        .end = end,
+        .task_id = c->curr_task
+    };
+    return 0;
+}
+
+/**
+ * Closes the interval currently open on a pCPU (if any)
+ * and opens a new one for "task_id", starting at "ts".
+ */
+static void switch_task(struct cpu_intervals *c, int task_id, int64_t ts)
+{
+    if (c->curr_task == task_id)
+        return;
+
+    // Idle (0) and unknown (-1) are not drawn
+    if (c->curr_task > 0 && ts > c->curr_start)
+        push_interval(c, ts);
+
+    c->curr_task = task_id;
+    c->curr_start = ts;
+}
+
+static int grow_cpus(int n_cpus)
+{
+    struct cpu_intervals *tmp = realloc(O.cpus, n_cpus * sizeof(*tmp));
+    if (!tmp)
+        return -ENOMEM;
+
+    memset(tmp + O.n_cpus, 0, (n_cpus - O.n_cpus) * sizeof(*tmp));
+    for (int i = O.n_cpus; i < n_cpus; ++i)
+        tmp[i].curr_task = -1;
+
+    O.cpus = tmp;
+    O.n_cpus = n_cpus;
+    return 0;
+}
+
+int occupancy_init(int n_cpus)
+{
+    occupancy_free();
+    return grow_cpus(n_cpus > 0 ? n_cpus : 1);
+}
+
+/**
+ * Follows the context switches of each pCPU.
+ * "__enter_scheduler" carries both the previous and the next
+ * domain/vCPU, "switch_infprev" closes the running interval
+ * and "switch_infnext" opens a new one.
+ */
+void occupancy_feed(const xt_event *event, int64_t ts)
+{
+    int cpu = event->cpu;
+    if (cpu >= O.n_cpus && grow_cpus(cpu + 1))
+        return;
+
+    struct cpu_intervals *c = &O.cpus[cpu];
+    const uint32_t *extra = (event->rec).extra;
+    xt_domain dom = { .u32 = 0 };
+    c->last_ts = ts;
+
+    switch ((event->rec).id) {
+        case TRC_SCHED_SWITCH:
+            dom.id = extra[2];
+            dom.vcpu = extra[3];
+            switch_task(c, get_task_id(dom), ts);
+            break;
+        case TRC_SCHED_SWITCH_INFPREV:
+            dom.id = extra[0];
+            dom.vcpu = extra[1];
+            if (c->curr_task == get_task_id(dom))
+                switch_task(c, -1, ts);
+            break;
+        case TRC_SCHED_SWITCH_INFNEXT:
+            dom.id = extra[0];
+            dom.vcpu = extra[1];
+            switch_task(c, get_task_id(dom), ts);
+            break;
+    }
+}
+
+/**
+ * Closes the intervals still open at the end of the trace.
+ */
+void occupancy_finish()
+{
+    for (int i = 0; i < O.n_cpus; ++i)
+        switch_task(&O.cpus[i], -1, O.cpus[i].last_ts);
+}
+
+/**
+ * Returns the number of run intervals of a pCPU, sorted by time.
+ */
+ssize_t occupancy_get(int cpu, const struct run_interval **intervals)
+{
+    if (cpu < 0 || cpu >= O.n_cpus)
+        return 0;
+
+    *intervals = O.cpus[cpu].data;
+    return O.cpus[cpu].size;
+}
+
+/**
+ * Returns the index of the first run interval of a pCPU
+ * that ends after "ts" (binary search).
+ */
+ssize_t occupancy_find(int cpu, int64_t ts)
+{
+    const struct run_interval *data = NULL;
+    ssize_t l = 0,
+            h = occupancy_get(cpu, &data);
+
+    while (l < h) {
+        ssize_t m = l + (h - l) / 2;
+        if (data[m].end <= ts)
+            l = m + 1;
+        else
+            h = m;
+    }
+
+    return l;
+}
+
+void occupancy_free()
+{
+    for (int i = 0; i < O.n_cpus; ++i)
+        free(O.cpus[i].data);
+
+    free(O.cpus);
+    O.cpus = NULL;
+    O.n_cpus = 0;
+}
@@ -0,0 +1,358 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef _GNU_SOURCE
+/** Use GNU C Library. */
+#define _GNU_SOURCE
+#endif // _GNU_SOURCE
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Xen Project
+#include <trace.h>
+
+#include "analysis.h"
+
+#define INTERVALS_INIT_SIZE 256
+
+// Intervals of a track in a single state, with the
+// prefix sums of their durations (prefix[k] is the
+// time spent in the state by the first k intervals).
+struct state_index {
+    uint32_t state;
+    size_t *idx;
+    int64_t *prefix;
+    size_t size,
+           capacity;
+};
+
+// State timeline of a pCPU
+struct power_track {
+    struct state_interval *data;
+    size_t size,
+           capacity;
+    struct state_index *states;
+    int n_states;
+    // Current state and since when
+    bool open;
+    uint32_t curr_state;
+    int64_t curr_start;
+};
+
+struct cpu_power {
+    struct power_track tracks[POWER_N_KINDS];
+    bool seen;
+    int64_t first_ts,
+            last_ts;
+};
+
+static struct {
+    struct cpu_power *cpus;
+    int n_cpus;
+} P;
+
+static int grow_cpus(int n_cpus)
+{
+    struct cpu_power *tmp = realloc(P.cpus, n_cpus * sizeof(*tmp));
+    if (!tmp)
+        return -ENOMEM;
+
+    memset(tmp + P.n_cpus, 0, (n_cpus - P.n_cpus) * sizeof(*tmp));
+    P.cpus = tmp;
+    P.n_cpus = n_cpus;
+    return 0;
+}
+
+static int push_interval(struct power_track *t, int64_t end)
+{
+    if (t->size == t->capacity) {
+        size_t new_cap = t->capacity ? t->capacity * 2 : INTERVALS_INIT_SIZE;
+        struct state_interval *tmp = realloc(t->data, new_cap * sizeof(*tmp));
+        if (!tmp)
+            return -ENOMEM;
+        t->data = tmp;
+        t->capacity = new_cap;
+    }
+
+    t->data[t->size++] = (struct state_interval) {
+        .start = t->curr_start,
+        .end = end,
+        .state = t->curr_state
+    };
+    return 0;
+}
+
+/**
+ * Moves a track from "prev" to "next" at "ts". The first change
+ * of a track also tells its state since the first record of the pCPU.
+ */
+static void change_state(struct cpu_power *c, enum power_kind kind,
+                            uint32_t prev, uint32_t next, int64_t ts)
+{
+    struct power_track *t = &c->tracks[kind];
+    if (!t->open) {
+        t->open = true;
+        t->curr_state = prev;
+        t->curr_start = c->first_ts;
+    }
+
+    if (t->curr_state == next)
+        return;
+
+    if (ts > t->curr_start)
+        push_interval(t, ts);
+
+    t->curr_state = next;
+    t->curr_start = ts;
+}
+
+int power_init(int n_cpus)
+{
+    power_free();
+    return grow_cpus(n_cpus > 0 ? n_cpus : 1);
+}
+
+/**
+ * Follows the C-state ("cpu_idle_entry", "cpu_idle_exit")
+ * and the frequency ("cpu_freq_change") of each pCPU.
+ */
+void power_feed(const xt_event *event, int64_t ts)
+{
+    int cpu = event->cpu;
+    if (cpu >= P.n_cpus && grow_cpus(cpu + 1))
+        return;
+
+    struct cpu_power *c = &P.cpus[cpu];
+    const uint32_t *extra = (event->rec).extra;
+    if (!c->seen) {
+        c->seen = true;
+        c->first_ts = ts;
+    }
+    c->last_ts = ts;
+
+    switch ((event->rec).id) {
+        case TRC_PM_FREQ_CHANGE:
+            // old MHz, new MHz
+            change_state(c, POWER_FREQ, extra[0], extra[1], ts);
+            break;
+        case TRC_PM_IDLE_ENTRY:
+            // C0 -> Cx
+            change_state(c, POWER_CSTATE, 0, extra[0], ts);
+            break;
+        case TRC_PM_IDLE_EXIT:
+            // Cx -> C0, Cx is the state of the last "cpu_idle_entry" (the
+            // record carries the type of the C-state, not its index). Before
+            // the first entry the state is unknown and the time is left out.
+            if (!c->tracks[POWER_CSTATE].open) {
+                c->tracks[POWER_CSTATE] = (struct power_track) {
+                    .open = true,
+                    .curr_state = 0,
+                    .curr_start = ts
+                };
+                break;
+            }
+            change_state(c, POWER_CSTATE, 0, 0, ts);
+            break;
+    }
+}
+
+static struct state_index *get_state_index(struct power_track *t, uint32_t state)
+{
+    for (int i = 0; i < t->n_states; ++i)
+        if (t->states[i].state == state)
+            return &t->states[i];
+
+    struct state_index *tmp = realloc(t->states, (t->n_states + 1) * sizeof(*tmp));
+    if (!tmp)
+        return NULL;
+
+    t->states = tmp;
+    tmp = &t->states[t->n_states++];
+    memset(tmp, 0, sizeof(*tmp));
+    tmp->state = state;
+    return tmp;
+}
+
+static int index_append(struct state_index *si, size_t i, int64_t duration)
+{
+    if (si->size + 1 >= si->capacity) {
+        size_t new_cap = si->capacity ? si->capacity * 2 : INTERVALS_INIT_SIZE;
+        size_t *idx = realloc(si->idx, new_cap * sizeof(*idx));
+        if (!idx)
+            return -ENOMEM;
+        si->idx = idx;
+
+        int64_t *prefix = realloc(si->prefix, (new_cap + 1) * sizeof(*prefix));
+        if (!prefix)
+            return -ENOMEM;
+        si->prefix = prefix;
+        si->capacity = new_cap;
+    }
+
+    if (!si->size)
+        si->prefix[0] = 0;
+    si->idx[si->size] = i;
+    si->prefix[si->size + 1] = si->prefix[si->size] + duration;
+    si->size++;
+    return 0;
+}
+
+/**
+ * Closes the intervals still open at the end of the trace
+ * and builds the per-state prefix sums.
+ */
+void power_finish()
+{
+    for (int i = 0; i < P.n_cpus; ++i) {
+        struct cpu_power *c = &P.cpus[i];
+        for (int k = 0; k < POWER_N_KINDS; ++k) {
+            struct power_track *t = &c->tracks[k];
+            if (t->open && c->last_ts > t->curr_start)
+                push_interval(t, c->last_ts);
+            t->open = false;
+
+            for (size_t j = 0; j < t->size; ++j) {
+                struct state_index *si = get_state_index(t, t->data[j].state);
+                if (si)
+                    index_append(si, j, t->data[j].end - t->data[j].start);
+            }
+        }
+    }
+}
+
+static struct power_track *get_track(int cpu, enum power_kind kind)
+{
+    if (cpu < 0 || cpu >= P.n_cpus)
+        return NULL;
+    return &P.cpus[cpu].tracks[kind];
+}
+
+/**
+ * Returns the number of state intervals of a pCPU, sorted by time.
+ */
+ssize_t power_get(int cpu, enum power_kind kind, const struct state_interval **intervals)
+{
+    struct power_track *t = get_track(cpu, kind);
+    if (!t)
+        return 0;
+
+    *intervals = t->data;
+    return t->size;
+}
+
+/**
+ * Copies (up to "max") the states seen on a pCPU,
+ * returning how many they are.
+ */
+int power_states(int cpu, enum power_kind kind, uint32_t *states, int max)
+{
+    struct power_track *t = get_track(cpu, kind);
+    if (!t)
+        return 0;
+
+    for (int i = 0; i < t->n_states && i < max; ++i)
+        states[i] = t->states[i].state;
+    return t->n_states;
+}
+
+/**
+ * Returns the time spent in a state before "ts": the prefix sum
+ * of the intervals starting before it, minus the part of the last
+ * one that lies after "ts".
+ */
+static int64_t time_before(const struct power_track *t,
+                            const struct state_index *si, int64_t ts)
+{
+    size_t l = 0,
+           h = si->size;
+
+    while (l < h) {
+        size_t m = l + (h - l) / 2;
+        if (t->data[si->idx[m]].start < ts)
+            l = m + 1;
+        else
+            h = m;
+    }
+
+    if (!l)
+        return 0;
+
+    int64_t sum = si->prefix[l],
+            end = t->data[si->idx[l - 1]].end;
+    return (end > ts) ? sum - (end - ts) : sum;
+}
+
+/**
+ * Returns the time (ns) a pCPU spent in a state in [from, to].
+ */
+int64_t power_residency(int cpu, enum power_kind kind, uint32_t state,
+                            int64_t from, int64_t to)
+{
+    const struct power_track *t = get_track(cpu, kind);
+    if (!t || to <= from)
+        return 0;
+
+    for (int i = 0; i < t->n_states; ++i)
+        if (t->states[i].state == state)
+            return time_before(t, &t->states[i], to) -
+                        time_before(t, &t->states[i], from);
+
+    return 0;
+}
+
+/**
+ * Returns the time span of the records of a pCPU.
+ */
+bool power_span(int cpu, int64_t *from, int64_t *to)
+{
+    if (cpu < 0 || cpu >= P.n_cpus || !P.cpus[cpu].seen)
+        return false;
+
+    *from = P.cpus[cpu].first_ts;
+    *to = P.cpus[cpu].last_ts;
+    return true;
+}
+
+int power_cpus_count()
+{
+    return P.n_cpus;
+}
+
+void power_free()
+{
+    for (int i = 0; i < P.n_cpus; ++i)
+        for (int k = 0; k < POWER_N_KINDS; ++k) {
+            struct power_track *t = &P.cpus[i].tracks[k];
+            for (int s = 0; s < t->n_states; ++s) {
+                free(t->states[s].idx);
+                free(t->states[s].prefix);
+            }
+            free(t->states);
+            free(t->data);
+        }
+
+    free(P.cpus);
+    P.cpus = NULL;
+    P.n_cpus = 0;
+}
@@ -0,0 +1,343 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef _GNU_SOURCE
+/** Use GNU C Library. */
+#define _GNU_SOURCE
+#endif // _GNU_SOURCE
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Xen Project
+#include <trace.h>
+
+// Events formatting
+#include "events/events.h"
+#include "analysis.h"
+
+#define STATS_INIT_SIZE 64
+#define BUCKETS_INIT_SIZE 64
+#define NS_PER_SEC 1000000000LL
+
+// Hypercall names, by number (Xen public/xen.h)
+static const char *hypercall_names[] = {
+    "set_trap_table", "mmu_update", "set_gdt", "stack_switch",
+    "set_callbacks", "fpu_taskswitch", "sched_op_compat", "platform_op",
+    "set_debugreg", "get_debugreg", "update_descriptor", NULL,
+    "memory_op", "multicall", "update_va_mapping", "set_timer_op",
+    "event_channel_op_compat", "xen_version", "console_io", "physdev_op_compat",
+    "grant_table_op", "vm_assist", "update_va_mapping_otherdomain", "iret",
+    "vcpu_op", "set_segment_base", "mmuext_op", "xsm_op",
+    "nmi_op", "sched_op", "callback_op", "xenoprof_op",
+    "event_channel_op", "physdev_op", "hvm_op", "sysctl",
+    "domctl", "kexec_op", "tmem_op", "argo_op",
+    "xenpmu_op", "dm_op", "hypfs_op"
+};
+
+#define N_HYPERCALL_NAMES (sizeof(hypercall_names) / sizeof(*hypercall_names))
+
+static struct {
+    struct pv_stats *stats;
+    size_t size,
+           capacity;
+    // Open-addressing index of "stats" (by key), -1 if empty
+    ssize_t *index;
+    size_t index_size;
+    bool started;
+    int64_t base_ts;
+} V;
+
+static uint64_t make_key(uint16_t dom, enum pv_kind kind, uint32_t number)
+{
+    return ((uint64_t)dom << 40) | ((uint64_t)kind << 32) | number;
+}
+
+static size_t hash_key(uint64_t key)
+{
+    return (key * 0x9e3779b97f4a7c15ULL) >> 20;
+}
+
+static int grow_index()
+{
+    size_t size = V.index_size ? V.index_size * 2 : 2 * STATS_INIT_SIZE;
+    ssize_t *index = malloc(size * sizeof(*index));
+    if (!index)
+        return -ENOMEM;
+
+    memset(index, 0xff, size * sizeof(*index));
+    for (size_t i = 0; i < V.size; ++i) {
+        const struct pv_stats *s = &V.stats[i];
+        size_t slot = hash_key(make_key(s->dom, s->kind, s->number)) & (size - 1);
+        while (index[slot] >= 0)
+            slot = (slot + 1) & (size - 1);
+        index[slot] = i;
+    }
+
+    free(V.index);
+    V.index = index;
+    V.index_size = size;
+    return 0;
+}
+
+static struct pv_stats *get_stats(uint16_t dom, enum pv_kind kind, uint32_t number)
+{
+    if (2 * (V.size + 1) > V.index_size && grow_index())
+        return NULL;
+
+    uint64_t key = make_key(dom, kind, number);
+    size_t mask = V.index_size - 1,
+           slot = hash_key(key) & mask;
+
+    for (; V.index[slot] >= 0; slot = (slot + 1) & mask) {
+        struct pv_stats *s = &V.stats[V.index[slot]];
+        if (make_key(s->dom, s->kind, s->number) == key)
+            return s;
+    }
+
+    if (V.size == V.capacity) {
+        size_t new_cap = V.capacity ? V.capacity * 2 : STATS_INIT_SIZE;
+        struct pv_stats *tmp = realloc(V.stats, new_cap * sizeof(*tmp));
+        if (!tmp)
+            return NULL;
+        V.stats = tmp;
+        V.capacity = new_cap;
+    }
+
+    struct pv_stats *s = &V.stats[V.size];
+    memset(s, 0, sizeof(*s));
+    s->dom = dom;
+    s->kind = kind;
+    s->number = number;
+
+    V.index[slot] = V.size++;
+    return s;
+}
+
+/**
+ * Counts an occurrence in its time bucket. The buckets hold the
+ * running total, so that a window is a difference of two of them.
+ */
+static void add_occurrence(struct pv_stats *s, int64_t ts)
+{
+    if (s->count) {
+        int64_t delta = ts - s->last_ts;
+        lhist_add(&s->inter_arrival, (delta > 0) ? delta : 0);
+    } else {
+        s->first_ts = ts;
+    }
+    s->last_ts = ts;
+    s->count++;
+
+    uint32_t bucket = (ts > V.base_ts) ? (ts - V.base_ts) / PVPROF_BUCKET_NS : 0;
+    if (s->n_buckets && s->buckets[s->n_buckets - 1].index >= bucket) {
+        s->buckets[s->n_buckets - 1].cum++;
+        return;
+    }
+
+    if (s->n_buckets == s->buckets_cap) {
+        size_t new_cap = s->buckets_cap ? s->buckets_cap * 2 : BUCKETS_INIT_SIZE;
+        struct pv_bucket *tmp = realloc(s->buckets, new_cap * sizeof(*tmp));
+        if (!tmp)
+            return;
+        s->buckets = tmp;
+        s->buckets_cap = new_cap;
+    }
+
+    s->buckets[s->n_buckets++] = (struct pv_bucket) {
+        .index = bucket,
+        .cum = s->count
+    };
+}
+
+void pvprof_init()
+{
+    pvprof_free();
+}
+
+/**
+ * Accounts a PV record: hypercalls and subcalls by number,
+ * traps by vector, the other entries by event.
+ */
+void pvprof_feed(const xt_event *event, int64_t ts)
+{
+    const uint32_t *extra = (event->rec).extra;
+    uint32_t sub = (event->rec).id & 0x00000fff;
+    enum pv_kind kind = PV_OTHER;
+    uint32_t number = sub & 0xff;
+
+    switch ((event->rec).id) {
+        case TRC_PV_HYPERCALL:
+            kind = PV_HYPERCALL;
+            number = extra[1];
+            break;
+        case TRC_PV_HYPERCALL | TRC_64_FLAG:
+            kind = PV_HYPERCALL;
+            number = extra[2];
+            break;
+        case TRC_PV_HYPERCALL_V2:
+            // Argument bits (A0-A5) and op
+            kind = PV_HYPERCALL;
+            number = extra[0] & ~TRC_PV_HYPERCALL_V2_ARG_MASK;
+            break;
+        case TRC_PV_HYPERCALL_SUBCALL:
+            kind = PV_SUBCALL;
+            number = extra[0] & ~TRC_PV_HYPERCALL_V2_ARG_MASK;
+            break;
+        case TRC_PV_TRAP:
+            // trapnr:15, use_error_code:1, error_code:16
+            kind = PV_TRAP;
+            number = extra[1] & 0x7fff;
+            break;
+        case TRC_PV_TRAP | TRC_64_FLAG:
+            kind = PV_TRAP;
+            number = extra[2] & 0x7fff;
+            break;
+    }
+
+    if (!V.started) {
+        V.started = true;
+        V.base_ts = ts;
+    }
+
+    struct pv_stats *s = get_stats((event->dom).id, kind, number);
+    if (s)
+        add_occurrence(s, ts);
+}
+
+/**
+ * Returns the statistics of every domain/kind/number seen.
+ */
+size_t pvprof_stats(const struct pv_stats **stats)
+{
+    *stats = V.stats;
+    return V.size;
+}
+
+/**
+ * Returns the occurrences before "ts" (bucket granularity).
+ */
+static uint64_t count_before(const struct pv_stats *s, int64_t ts)
+{
+    if (ts <= V.base_ts)
+        return 0;
+
+    uint64_t bucket = (ts - V.base_ts) / PVPROF_BUCKET_NS;
+    size_t l = 0,
+           h = s->n_buckets;
+
+    while (l < h) {
+        size_t m = l + (h - l) / 2;
+        if (s->buckets[m].index < bucket)
+            l = m + 1;
+        else
+            h = m;
+    }
+
+    return l ? s->buckets[l - 1].cum : 0;
+}
+
+/**
+ * Returns the occurrences in [from, to), rounded to the buckets.
+ */
+uint64_t pvprof_count(const struct pv_stats *s, int64_t from, int64_t to)
+{
+    return (to > from) ? count_before(s, to) - count_before(s, from) : 0;
+}
+
+/**
+ * Returns the highest number of occurrences per second,
+ * measured over the buckets.
+ */
+double pvprof_peak_rate(const struct pv_stats *s)
+{
+    uint64_t peak = 0;
+    for (size_t i = 0; i < s->n_buckets; ++i) {
+        uint64_t n = s->buckets[i].cum - (i ? s->buckets[i - 1].cum : 0);
+        peak = (n > peak) ? n : peak;
+    }
+
+    return peak * (double)NS_PER_SEC / PVPROF_BUCKET_NS;
+}
+
+static int cmp_top(const void *a, const void *b)
+{
+    const struct pv_top *ta = a,
+                        *tb = b;
+    return (ta->count < tb->count) - (ta->count > tb->count);
+}
+
+/**
+ * Fills "top" with (up to) the "n" most frequent
+ * domain/kind/number in [from, to).
+ */
+size_t pvprof_top(int64_t from, int64_t to, struct pv_top *top, size_t n)
+{
+    struct pv_top *all = malloc(V.size * sizeof(*all));
+    if (!all)
+        return 0;
+
+    size_t n_all = 0;
+    for (size_t i = 0; i < V.size; ++i) {
+        uint64_t count = pvprof_count(&V.stats[i], from, to);
+        if (count)
+            all[n_all++] = (struct pv_top) { .stats = &V.stats[i], .count = count };
+    }
+
+    qsort(all, n_all, sizeof(*all), cmp_top);
+    n = (n < n_all) ? n : n_all;
+    memcpy(top, all, n * sizeof(*top));
+    free(all);
+    return n;
+}
+
+/**
+ * Writes the name of a domain/kind/number ("hypercall memory_op").
+ */
+int pvprof_name(const struct pv_stats *s, char *result_str)
+{
+    switch (s->kind) {
+        case PV_HYPERCALL:
+        case PV_SUBCALL: {
+            const char *kind = (s->kind == PV_HYPERCALL) ? "hypercall" : "subcall";
+            if (s->number < N_HYPERCALL_NAMES && hypercall_names[s->number])
+                return EVNAME(result_str, "%s %s", kind, hypercall_names[s->number]);
+            return EVNAME(result_str, "%s %u", kind, s->number);
+        }
+        case PV_TRAP:
+            return EVNAME(result_str, "trap %u", s->number);
+        default:
+            return get_pvcls_evname(TRC_PV_ENTRY + s->number, result_str);
+    }
+}
+
+void pvprof_free()
+{
+    for (size_t i = 0; i < V.size; ++i)
+        free(V.stats[i].buckets);
+
+    free(V.stats);
+    free(V.index);
+    memset(&V, 0, sizeof(V));
+}
@@ -0,0 +1,384 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef _GNU_SOURCE
+/** Use GNU C Library. */
+#define _GNU_SOURCE
+#endif // _GNU_SOURCE
+
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "analysis.h"
+
+#define SERIES_INIT_SIZE 1024
+#define SERIES_SET_INIT_SIZE 64
+
+static int points_append(struct series_points *p, int64_t ts, double val)
+{
+    if (p->size == p->capacity) {
+        size_t new_cap = p->capacity ? p->capacity * 2 : SERIES_INIT_SIZE;
+        double *new_val = realloc(p->val, new_cap * sizeof(*new_val));
+        if (!new_val)
+            return -ENOMEM;
+        p->val = new_val;
+
+        p->capacity = new_cap;
+    }
+
+    if (tscol_append(&p->ts, ts))
+        return -ENOMEM;
+    p->val[p->size] = val;
+    p->size++;
+    return 0;
+}
+
+static void points_free(struct series_points *p)
+{
+    tscol_free(&p->ts);
+    free(p->val);
+    memset(p, 0, sizeof(*p));
+}
+
+/**
+ * Largest-Triangle-Three-Buckets downsampling of "n_in" points
+ * ("ts" decoded from the column) into (at most) "n_out" points.
+ * The first and the last point are always kept.
+ */
+static size_t lttb(const int64_t *ts, const double *val, size_t n_in,
+                    size_t n_out, int64_t *out_ts, double *out_val)
+{
+    if (n_out >= n_in || n_out < 3) {
+        n_out = (n_out < n_in) ? n_out : n_in;
+        for (size_t i = 0; i < n_out; ++i) {
+            size_t src = i * n_in / n_out;
+            out_ts[i] = ts[src];
+            out_val[i] = val[src];
+        }
+        return n_out;
+    }
+
+    double bucket = (double)(n_in - 2) / (n_out - 2);
+    size_t a = 0,
+           n = 0;
+
+    out_ts[n] = ts[a];
+    out_val[n++] = val[a];
+
+    for (size_t i = 0; i < n_out - 2; ++i) {
+        // Average of the next bucket
+        size_t avg_start = 1 + (size_t)((i + 1) * bucket),
+               avg_end = 1 + (size_t)((i + 2) * bucket);
+        if (avg_end > n_in)
+            avg_end = n_in;
+
+        double avg_ts = 0,
+               avg_val = 0;
+        for (size_t j = avg_start; j < avg_end; ++j) {
+            avg_ts += ts[j];
+            avg_val += val[j];
+        }
+        if (avg_end > avg_start) {
+            avg_ts /= avg_end - avg_start;
+            avg_val /= avg_end - avg_start;
+        }
+
+        // Point of the current bucket forming
+        // the largest triangle with "a" and the average
+        size_t b_start = 1 + (size_t)(i * bucket),
+               b_end = 1 + (size_t)((i + 1) * bucket),
+               best = b_start;
+        double best_area = -1;
+
+        for (size_t j = b_start; j < b_end; ++j) {
+            double area = fabs((ts[a] - avg_ts) * (val[j] - val[a]) -
+                                (ts[a] - (double)ts[j]) * (avg_val - val[a]));
+            if (area > best_area) {
+                best_area = area;
+                best = j;
+            }
+        }
+
+        out_ts[n] = ts[best];
+        out_val[n++] = val[best];
+        a = best;
+    }
+
+    out_ts[n] = ts[n_in - 1];
+    out_val[n++] = val[n_in - 1];
+    return n;
+}
+
+int series_append(struct time_series *s, int64_t ts, double val)
+{
+    return points_append(&s->levels[0], ts, val);
+}
+
+static void cache_free(struct series_cache *c)
+{
+    if (!c)
+        return;
+    free(c->out_ts);
+    free(c->out_val);
+    free(c->ts);
+    free(c);
+}
+
+/**
+ * Builds the coarser levels of a series, each one being the LTTB
+ * downsampling of the previous one by SERIES_LEVEL_FACTOR.
+ */
+void series_build_levels(struct time_series *s)
+{
+    cache_free(s->cache);
+    s->cache = calloc(1, sizeof(*s->cache));
+
+    for (int l = 1; l < SERIES_MAX_LEVELS; ++l) {
+        struct series_points *prev = &s->levels[l - 1],
+                             *curr = &s->levels[l];
+        points_free(curr);
+
+        size_t n_out = prev->size / SERIES_LEVEL_FACTOR;
+        if (n_out < SERIES_MIN_POINTS)
+            break;
+
+        // Scratch buffers: timestamps of "prev" and of the new level
+        int64_t *prev_ts = malloc(prev->size * sizeof(*prev_ts)),
+                *out_ts = malloc(n_out * sizeof(*out_ts));
+        curr->val = malloc(n_out * sizeof(*curr->val));
+        if (!prev_ts || !out_ts || !curr->val) {
+            free(prev_ts);
+            free(out_ts);
+            points_free(curr);
+            break;
+        }
+
+        tscol_decode(&prev->ts, 0, prev->size, prev_ts);
+        curr->size = curr->capacity = lttb(prev_ts, prev->val, prev->size, n_out,
+                                            out_ts, curr->val);
+
+        int ret = 0;
+        for (size_t p = 0; p < curr->size && !ret; ++p)
+            ret = tscol_append(&curr->ts, out_ts[p]);
+        free(prev_ts);
+        free(out_ts);
+        if (ret) {
+            points_free(curr);
+            break;
+        }
+    }
+}
+
+// Makes room for "n" decoded timestamps in the scratch buffer of the cache
+static int64_t *cache_ts(struct series_cache *c, size_t n)
+{
+    if (n > c->ts_cap) {
+        int64_t *tmp = realloc(c->ts, n * sizeof(*tmp));
+        if (!tmp)
+            return NULL;
+        c->ts = tmp;
+        c->ts_cap = n;
+    }
+    return c->ts;
+}
+
+// Keeps the decimation of the window [from, to] in the cache
+static void cache_store(struct series_cache *c, int64_t from, int64_t to, size_t n_out,
+                        const int64_t *out_ts, const double *out_val, size_t n)
+{
+    c->valid = false;
+    if (n) {
+        int64_t *tmp_ts = realloc(c->out_ts, n * sizeof(*tmp_ts));
+        if (!tmp_ts)
+            return;
+        c->out_ts = tmp_ts;
+
+        double *tmp_val = realloc(c->out_val, n * sizeof(*tmp_val));
+        if (!tmp_val)
+            return;
+        c->out_val = tmp_val;
+
+        memcpy(c->out_ts, out_ts, n * sizeof(*out_ts));
+        memcpy(c->out_val, out_val, n * sizeof(*out_val));
+    }
+
+    c->from = from;
+    c->to = to;
+    c->n_out = n_out;
+    c->n = n;
+    c->valid = true;
+}
+
+/**
+ * Decimates the points of a series in the time window [from, to] into
+ * (at most) "n_out" points, starting from the coarsest level that
+ * still has at least "n_out" points in the window.
+ * Returns the number of points written in "out_ts" and "out_val".
+ * The result is kept until the window or "n_out" change, as the
+ * graphs are drawn again and again on the same window.
+ */
+size_t series_decimate(const struct time_series *s, int64_t from, int64_t to,
+                        size_t n_out, int64_t *out_ts, double *out_val)
+{
+    struct series_cache *c = s->cache;
+    if (c && c->valid && c->from == from && c->to == to && c->n_out == n_out) {
+        memcpy(out_ts, c->out_ts, c->n * sizeof(*out_ts));
+        memcpy(out_val, c->out_val, c->n * sizeof(*out_val));
+        return c->n;
+    }
+
+    const struct series_points *p = &s->levels[0];
+    size_t first = 0,
+           last = 0;
+
+    for (int l = SERIES_MAX_LEVELS - 1; l >= 0; --l) {
+        const struct series_points *lp = &s->levels[l];
+        if (!lp->size)
+            continue;
+
+        first = tscol_find(&lp->ts, from);
+        last = tscol_find(&lp->ts, to + 1);
+        // Keep a point on both sides of the window
+        if (first > 0)
+            first--;
+        if (last < lp->size)
+            last++;
+
+        p = lp;
+        if (last - first >= n_out)
+            break;
+    }
+
+    size_t n = 0;
+    if (last > first) {
+        // The timestamps of the window are decoded once
+        int64_t *ts = c ? cache_ts(c, last - first) : malloc((last - first) * sizeof(*ts));
+        if (!ts)
+            return 0;
+
+        tscol_decode(&p->ts, first, last - first, ts);
+        n = lttb(ts, p->val + first, last - first, n_out, out_ts, out_val);
+        if (!c)
+            free(ts);
+    }
+
+    if (c)
+        cache_store(c, from, to, n_out, out_ts, out_val, n);
+    return n;
+}
+
+void series_free(struct time_series *s)
+{
+    for (int l = 0; l < SERIES_MAX_LEVELS; ++l)
+        points_free(&s->levels[l]);
+    cache_free(s->cache);
+    s->cache = NULL;
+}
+
+static uint32_t hash_key(uint32_t key)
+{
+    key ^= key >> 16;
+    key *= 0x45d9f3b;
+    key ^= key >> 16;
+    return key;
+}
+
+static int set_grow(struct series_set *set)
+{
+    size_t new_cap = set->capacity ? set->capacity * 2 : SERIES_SET_INIT_SIZE;
+    struct series_slot *slots = calloc(new_cap, sizeof(*slots));
+    if (!slots)
+        return -ENOMEM;
+
+    for (size_t i = 0; i < set->capacity; ++i) {
+        if (!set->slots[i].used)
+            continue;
+
+        size_t j = hash_key(set->slots[i].key) & (new_cap - 1);
+        while (slots[j].used)
+            j = (j + 1) & (new_cap - 1);
+        slots[j] = set->slots[i];
+    }
+
+    free(set->slots);
+    set->slots = slots;
+    set->capacity = new_cap;
+    return 0;
+}
+
+/**
+ * Returns the series of "key", creating it if needed.
+ */
+struct time_series *series_set_get(struct series_set *set, uint32_t key)
+{
+    if ((set->size + 1) * 2 > set->capacity && set_grow(set))
+        return NULL;
+
+    size_t i = hash_key(key) & (set->capacity - 1);
+    while (set->slots[i].used) {
+        if (set->slots[i].key == key)
+            return &set->slots[i].series;
+        i = (i + 1) & (set->capacity - 1);
+    }
+
+    set->slots[i].used = 1;
+    set->slots[i].key = key;
+    set->size++;
+    return &set->slots[i].series;
+}
+
+/**
+ * Returns the series of "key" (NULL if it does not exist).
+ */
+const struct time_series *series_set_find(const struct series_set *set, uint32_t key)
+{
+    if (!set->capacity)
+        return NULL;
+
+    size_t i = hash_key(key) & (set->capacity - 1);
+    while (set->slots[i].used) {
+        if (set->slots[i].key == key)
+            return &set->slots[i].series;
+        i = (i + 1) & (set->capacity - 1);
+    }
+
+    return NULL;
+}
+
+void series_set_build_levels(struct series_set *set)
+{
+    for (size_t i = 0; i < set->capacity; ++i)
+        if (set->slots[i].used)
+            series_build_levels(&set->slots[i].series);
+}
+
+void series_set_free(struct series_set *set)
+{
+    for (size_t i = 0; i < set->capacity; ++i)
+        if (set->slots[i].used)
+            series_free(&set->slots[i].series);
+
+    free(set->slots);
+    memset(set, 0, sizeof(*set));
+}
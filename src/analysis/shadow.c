@@ -0,0 +1,213 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef _GNU_SOURCE
+/** Use GNU C Library. */
+#define _GNU_SOURCE
+#endif // _GNU_SOURCE
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Xen Project
+#include <trace.h>
+
+// Events formatting
+#include "events/events.h"
+#include "analysis.h"
+
+static struct {
+    struct shadow_dom **doms;
+    int n_doms;
+    // Last domain looked up
+    struct shadow_dom *last;
+} S;
+
+static struct shadow_dom *get_dom(uint16_t dom)
+{
+    if (S.last && S.last->dom == dom)
+        return S.last;
+
+    for (int i = 0; i < S.n_doms; ++i)
+        if (S.doms[i]->dom == dom)
+            return S.last = S.doms[i];
+
+    struct shadow_dom **tmp = realloc(S.doms, (S.n_doms + 1) * sizeof(*tmp));
+    if (!tmp)
+        return NULL;
+    S.doms = tmp;
+
+    struct shadow_dom *d = malloc(sizeof(*d));
+    if (!d)
+        return NULL;
+
+    d->dom = dom;
+    for (int t = 0; t < SHADOW_TYPES; ++t)
+        for (int k = 0; k < SHADOW_N_KEYS; ++k)
+            topk_init(&d->topk[t][k]);
+
+    S.doms[S.n_doms++] = d;
+    return S.last = d;
+}
+
+static void add_key(struct shadow_dom *d, int type, enum shadow_key kind,
+                        uint64_t key, int64_t ts, struct kshark_entry *entry)
+{
+    topk_add(&d->topk[type][kind], key, ts, entry);
+    topk_add(&d->topk[SHADOW_ALL_TYPES][kind], key, ts, entry);
+}
+
+void shadow_init()
+{
+    shadow_free();
+}
+
+/**
+ * Counts the guest virtual address and the gfn
+ * of a shadow paging record (see "shdwcls.c").
+ */
+void shadow_feed(const xt_event *event, int64_t ts, struct kshark_entry *entry)
+{
+    const uint32_t *extra = (event->rec).extra;
+    uint32_t sub = (event->rec).id & 0x00000fff;
+    int type = sub & 0xff;
+    if (type < 1 || type >= SHADOW_TYPES)
+        return;
+
+    struct shadow_dom *d = get_dom((event->dom).id);
+    if (!d)
+        return;
+
+    switch (sub) {
+        case 0x001:
+            add_key(d, type, SHADOW_VA, extra[2], ts, entry);
+            break;
+        case 0x101:
+        case 0x106:
+            add_key(d, type, SHADOW_VA, U64_FROM_WORDS(extra[3], extra[2]), ts, entry);
+            break;
+        case 0x002:
+        case 0x003:
+        case 0x004:
+        case 0x005:
+        case 0x007:
+            add_key(d, type, SHADOW_VA, extra[0], ts, entry);
+            break;
+        case 0x102:
+        case 0x103:
+        case 0x104:
+        case 0x105:
+        case 0x107:
+            add_key(d, type, SHADOW_VA, U64_FROM_WORDS(extra[1], extra[0]), ts, entry);
+            break;
+        case 0x006:
+            add_key(d, type, SHADOW_VA, extra[1], ts, entry);
+            break;
+        case 0x008:
+            add_key(d, type, SHADOW_VA, extra[2], ts, entry);
+            break;
+        case 0x108:
+            add_key(d, type, SHADOW_VA, U64_FROM_WORDS(extra[5], extra[4]), ts, entry);
+            break;
+        case 0x009:
+        case 0x00a:
+        case 0x00b:
+            add_key(d, type, SHADOW_VA, extra[0], ts, entry);
+            add_key(d, type, SHADOW_GFN, extra[1], ts, entry);
+            break;
+        case 0x109:
+        case 0x10a:
+        case 0x10b:
+            add_key(d, type, SHADOW_VA, U64_FROM_WORDS(extra[1], extra[0]), ts, entry);
+            add_key(d, type, SHADOW_GFN, U64_FROM_WORDS(extra[3], extra[2]), ts, entry);
+            break;
+        case 0x00c:
+        case 0x00d:
+        case 0x00e:
+        case 0x00f:
+            add_key(d, type, SHADOW_GFN, extra[0], ts, entry);
+            break;
+        case 0x10c:
+        case 0x10d:
+        case 0x10e:
+        case 0x10f:
+            add_key(d, type, SHADOW_GFN, U64_FROM_WORDS(extra[1], extra[0]), ts, entry);
+            break;
+    }
+}
+
+/**
+ * Writes the name of a shadow event type ("all" for SHADOW_ALL_TYPES).
+ */
+int shadow_type_name(int type, char *result_str)
+{
+    if (type == SHADOW_ALL_TYPES)
+        return EVNAME(result_str, "all");
+    return get_shdwcls_evname(TRC_SHADOW + type, result_str);
+}
+
+/**
+ * Writes the report: the top keys of each domain,
+ * shadow event type and kind of key.
+ */
+void shadow_report(FILE *fp)
+{
+    static const char *key_names[SHADOW_N_KEYS] = { "va", "gfn" };
+    struct topk_counter counters[TOPK_SIZE];
+    char type_name[STR_EVNAME_MAXLEN];
+
+    fprintf(fp, "# XenTrace shadow paging report\n");
+    fprintf(fp, "# dom event key_kind key count max_error first_ns\n");
+    for (int i = 0; i < S.n_doms; ++i)
+        for (int t = 0; t < SHADOW_TYPES; ++t)
+            for (int k = 0; k < SHADOW_N_KEYS; ++k) {
+                size_t n = topk_sorted(&S.doms[i]->topk[t][k], counters);
+                if (n && shadow_type_name(t, type_name) < 1)
+                    continue;
+
+                for (size_t c = 0; c < n; ++c)
+                    fprintf(fp, "%u %s %s 0x%"PRIx64" %"PRIu64" %"PRIu64" %"PRId64"\n",
+                                S.doms[i]->dom, type_name, key_names[k], counters[c].key,
+                                counters[c].count, counters[c].error, counters[c].first_ts);
+            }
+}
+
+/**
+ * Returns the number of domains with shadow paging records.
+ */
+int shadow_doms(const struct shadow_dom *const **doms)
+{
+    *doms = (const struct shadow_dom *const *)S.doms;
+    return S.n_doms;
+}
+
+void shadow_free()
+{
+    for (int i = 0; i < S.n_doms; ++i)
+        free(S.doms[i]);
+
+    free(S.doms);
+    memset(&S, 0, sizeof(S));
+}
@@ -0,0 +1,363 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef _GNU_SOURCE
+/** Use GNU C Library. */
+#define _GNU_SOURCE
+#endif // _GNU_SOURCE
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// KernelShark.v2-Beta
+#include "libkshark.h"
+// Xen Project
+#include <trace.h>
+
+#include "analysis.h"
+
+#define NS_PER_SEC 1000000000LL
+#define SECONDS_INIT_SIZE 64
+#define WINDOWS_INIT_SIZE 16
+#define GAPS_INIT_SIZE 16
+
+// Counters of one second of one pCPU
+struct loss_second {
+    uint64_t lost,
+             records,
+             bytes;
+};
+
+// Time without records of a pCPU
+struct loss_gap {
+    int64_t start,
+            end;
+};
+
+struct cpu_loss {
+    struct loss_second *seconds;
+    size_t n_seconds;
+    struct loss_window *windows;
+    size_t n_windows,
+           windows_cap;
+    struct loss_gap *gaps;
+    size_t n_gaps,
+           gaps_cap;
+    // Time of the last record (if "has_last")
+    int64_t last_ts;
+    bool has_last;
+    uint64_t lost,
+             wraps,
+             records,
+             bytes;
+};
+
+static struct {
+    struct cpu_loss *cpus;
+    int n_cpus;
+    int64_t (*to_ns)(uint64_t);
+    // Time span of the trace
+    int64_t base_ts,
+            last_ts;
+} L;
+
+static int grow_cpus(int n_cpus)
+{
+    struct cpu_loss *tmp = realloc(L.cpus, n_cpus * sizeof(*tmp));
+    if (!tmp)
+        return -ENOMEM;
+
+    memset(tmp + L.n_cpus, 0, (n_cpus - L.n_cpus) * sizeof(*tmp));
+    L.cpus = tmp;
+    L.n_cpus = n_cpus;
+    return 0;
+}
+
+static struct loss_second *get_second(struct cpu_loss *c, int64_t ts)
+{
+    // Out of the trace (e.g. a TSC not yet known)
+    if (ts < L.base_ts || ts > L.last_ts)
+        return NULL;
+
+    size_t sec = (ts - L.base_ts) / NS_PER_SEC;
+    if (sec >= c->n_seconds) {
+        size_t n = c->n_seconds ? c->n_seconds : SECONDS_INIT_SIZE;
+        while (n <= sec)
+            n *= 2;
+
+        struct loss_second *tmp = realloc(c->seconds, n * sizeof(*tmp));
+        if (!tmp)
+            return NULL;
+
+        memset(tmp + c->n_seconds, 0, (n - c->n_seconds) * sizeof(*tmp));
+        c->seconds = tmp;
+        c->n_seconds = n;
+    }
+
+    return &c->seconds[sec];
+}
+
+static void add_window(struct cpu_loss *c, int64_t start, int64_t end, uint32_t lost)
+{
+    if (c->n_windows == c->windows_cap) {
+        size_t n = c->windows_cap ? c->windows_cap * 2 : WINDOWS_INIT_SIZE;
+        struct loss_window *tmp = realloc(c->windows, n * sizeof(*tmp));
+        if (!tmp)
+            return;
+        c->windows = tmp;
+        c->windows_cap = n;
+    }
+
+    if (start < L.base_ts)
+        start = L.base_ts;
+
+    c->windows[c->n_windows++] = (struct loss_window) {
+        .start = (start < end) ? start : end,
+        .end = end,
+        .lost = lost
+    };
+}
+
+static void add_gap(struct cpu_loss *c, int64_t start, int64_t end)
+{
+    if (c->n_gaps == c->gaps_cap) {
+        size_t n = c->gaps_cap ? c->gaps_cap * 2 : GAPS_INIT_SIZE;
+        struct loss_gap *tmp = realloc(c->gaps, n * sizeof(*tmp));
+        if (!tmp)
+            return;
+        c->gaps = tmp;
+        c->gaps_cap = n;
+    }
+
+    c->gaps[c->n_gaps++] = (struct loss_gap) {
+        .start = start,
+        .end = end
+    };
+}
+
+/**
+ * "to_ns" converts the TSCs carried by "lost_records", "base_ts" and
+ * "last_ts" are the times of the first and of the last record of the
+ * trace: the records out of them are not accounted.
+ */
+int tloss_init(int n_cpus, int64_t (*to_ns)(uint64_t), int64_t base_ts, int64_t last_ts)
+{
+    tloss_free();
+    L.to_ns = to_ns;
+    L.base_ts = base_ts;
+    L.last_ts = last_ts;
+    return grow_cpus(n_cpus > 0 ? n_cpus : 1);
+}
+
+/**
+ * Accounts a raw record. "lost_records" opens a lossy window
+ * from the TSC of the first lost record up to the record itself.
+ * More than TLOSS_GAP_NS without records of a pCPU is a gap.
+ */
+void tloss_feed(const struct xtr_record *rec, int64_t ts)
+{
+    if (rec->cpu >= L.n_cpus && grow_cpus(rec->cpu + 1))
+        return;
+
+    struct cpu_loss *c = &L.cpus[rec->cpu];
+    struct loss_second *s = get_second(c, ts);
+    if (!s)
+        return;
+
+    if (c->has_last && ts - c->last_ts > TLOSS_GAP_NS)
+        add_gap(c, c->last_ts, ts);
+    if (!c->has_last || ts > c->last_ts) {
+        c->last_ts = ts;
+        c->has_last = true;
+    }
+
+    c->records++;
+    c->bytes += rec->size;
+    s->records++;
+    s->bytes += rec->size;
+
+    switch (rec->id) {
+        case TRC_LOST_RECORDS: {
+            // lost_records, did:vid, first_tsc (64 bits)
+            uint64_t first_tsc = U64_FROM_WORDS(rec->extra[3], rec->extra[2]);
+            int64_t first_ts = first_tsc ? L.to_ns(first_tsc) : ts;
+            c->lost += rec->extra[0];
+            s->lost += rec->extra[0];
+            add_window(c, first_ts, ts, rec->extra[0]);
+            break;
+        }
+        case TRC_TRACE_WRAP_BUFFER:
+            c->wraps++;
+            break;
+    }
+}
+
+static int cmp_windows(const void *a, const void *b)
+{
+    const struct loss_window *wa = a,
+                             *wb = b;
+    return (wa->start > wb->start) - (wa->start < wb->start);
+}
+
+/**
+ * Sorts the lossy windows of each pCPU by time
+ * and merges the overlapping ones.
+ */
+void tloss_finish()
+{
+    for (int i = 0; i < L.n_cpus; ++i) {
+        struct cpu_loss *c = &L.cpus[i];
+        if (!c->n_windows)
+            continue;
+
+        qsort(c->windows, c->n_windows, sizeof(struct loss_window), cmp_windows);
+
+        size_t n = 0;
+        for (size_t w = 1; w < c->n_windows; ++w) {
+            if (c->windows[w].start <= c->windows[n].end) {
+                if (c->windows[w].end > c->windows[n].end)
+                    c->windows[n].end = c->windows[w].end;
+                c->windows[n].lost += c->windows[w].lost;
+            } else {
+                c->windows[++n] = c->windows[w];
+            }
+        }
+        c->n_windows = n + 1;
+    }
+}
+
+/**
+ * Returns the number of records lost in the whole trace.
+ */
+uint64_t tloss_total_lost()
+{
+    uint64_t lost = 0;
+    for (int i = 0; i < L.n_cpus; ++i)
+        lost += L.cpus[i].lost;
+    return lost;
+}
+
+/**
+ * Writes the report: totals per pCPU, lossy windows
+ * and lost records/bytes per pCPU per second.
+ */
+void tloss_report(FILE *fp)
+{
+    fprintf(fp, "# XenTrace loss report\n");
+    fprintf(fp, "# cpu lost wraps lossy_windows gaps records bytes peak_bytes_per_s\n");
+    for (int i = 0; i < L.n_cpus; ++i) {
+        const struct cpu_loss *c = &L.cpus[i];
+        if (!c->records)
+            continue;
+
+        uint64_t peak = 0;
+        for (size_t s = 0; s < c->n_seconds; ++s)
+            peak = (c->seconds[s].bytes > peak) ? c->seconds[s].bytes : peak;
+
+        fprintf(fp, "%d %"PRIu64" %"PRIu64" %zu %zu %"PRIu64" %"PRIu64" %"PRIu64"\n", i, c->lost,
+                    c->wraps, c->n_windows, c->n_gaps, c->records, c->bytes, peak);
+    }
+
+    fprintf(fp, "# gaps (no records for more than %lld ms): cpu start_ns end_ns\n",
+                TLOSS_GAP_NS / 1000000);
+    for (int i = 0; i < L.n_cpus; ++i)
+        for (size_t g = 0; g < L.cpus[i].n_gaps; ++g)
+            fprintf(fp, "%d %"PRId64" %"PRId64"\n", i, L.cpus[i].gaps[g].start,
+                        L.cpus[i].gaps[g].end);
+
+    fprintf(fp, "# lossy windows: cpu start_ns end_ns lost\n");
+    for (int i = 0; i < L.n_cpus; ++i)
+        for (size_t w = 0; w < L.cpus[i].n_windows; ++w)
+            fprintf(fp, "%d %"PRId64" %"PRId64" %u\n", i, L.cpus[i].windows[w].start,
+                        L.cpus[i].windows[w].end, L.cpus[i].windows[w].lost);
+
+    fprintf(fp, "# per second: cpu second lost records bytes\n");
+    for (int i = 0; i < L.n_cpus; ++i)
+        for (size_t s = 0; s < L.cpus[i].n_seconds; ++s) {
+            const struct loss_second *sec = &L.cpus[i].seconds[s];
+            if (sec->records)
+                fprintf(fp, "%d %zu %"PRIu64" %"PRIu64" %"PRIu64"\n", i, s, sec->lost,
+                            sec->records, sec->bytes);
+        }
+}
+
+/**
+ * Returns the number of gaps of a pCPU.
+ */
+size_t tloss_gaps(int cpu)
+{
+    return (cpu >= 0 && cpu < L.n_cpus) ? L.cpus[cpu].n_gaps : 0;
+}
+
+/**
+ * Returns the number of lossy windows of a pCPU, sorted by time.
+ */
+ssize_t tloss_windows(int cpu, const struct loss_window **windows)
+{
+    if (cpu < 0 || cpu >= L.n_cpus)
+        return 0;
+
+    *windows = L.cpus[cpu].windows;
+    return L.cpus[cpu].n_windows;
+}
+
+/**
+ * Matching condition of the data collection of the lossy windows
+ * of a pCPU ("values[0]").
+ */
+bool tloss_match_lossy(struct kshark_context *kshark_ctx,
+                        struct kshark_entry *entry, int sd, int *values)
+{
+    if (entry->stream_id != sd || entry->cpu != values[0])
+        return false;
+
+    const struct loss_window *windows = NULL;
+    ssize_t l = 0,
+            h = tloss_windows(entry->cpu, &windows);
+
+    // Last window starting before the entry
+    while (l < h) {
+        ssize_t m = l + (h - l) / 2;
+        if (windows[m].start <= entry->ts)
+            l = m + 1;
+        else
+            h = m;
+    }
+
+    return l > 0 && entry->ts <= windows[l - 1].end;
+}
+
+void tloss_free()
+{
+    for (int i = 0; i < L.n_cpus; ++i) {
+        free(L.cpus[i].seconds);
+        free(L.cpus[i].windows);
+        free(L.cpus[i].gaps);
+    }
+
+    free(L.cpus);
+    L.cpus = NULL;
+    L.n_cpus = 0;
+}
@@ -0,0 +1,188 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef _GNU_SOURCE
+/** Use GNU C Library. */
+#define _GNU_SOURCE
+#endif // _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "analysis.h"
+
+#define INDEX_MASK (TOPK_INDEX_SIZE - 1)
+
+/*
+ * Space-saving summary: TOPK_SIZE counters, kept in a min-heap (by
+ * count) and indexed by key with an open-addressing table. A key that
+ * is not tracked replaces the smallest counter, inheriting its count
+ * as overestimation ("error").
+ */
+
+static unsigned hash_key(uint64_t key)
+{
+    return (key * 0x9e3779b97f4a7c15ULL) >> 32 & INDEX_MASK;
+}
+
+static int find_slot(const struct topk *t, uint64_t key)
+{
+    for (unsigned i = hash_key(key); ; i = (i + 1) & INDEX_MASK) {
+        int c = t->index[i];
+        if (c < 0 || t->counters[c].key == key)
+            return i;
+    }
+}
+
+/**
+ * Removes a key from the index, shifting back the
+ * entries of its probe sequence (no tombstones).
+ */
+static void index_remove(struct topk *t, uint64_t key)
+{
+    unsigned i = find_slot(t, key),
+             j = i;
+    if (t->index[i] < 0)
+        return;
+
+    t->index[i] = -1;
+    for (;;) {
+        j = (j + 1) & INDEX_MASK;
+        if (t->index[j] < 0)
+            return;
+
+        // Home of the entry, moved if not cyclically in (i, j]
+        unsigned k = hash_key(t->counters[t->index[j]].key);
+        bool in_range = (i <= j) ? (i < k && k <= j) : (i < k || k <= j);
+        if (!in_range) {
+            t->index[i] = t->index[j];
+            t->index[j] = -1;
+            i = j;
+        }
+    }
+}
+
+static void heap_swap(struct topk *t, int a, int b)
+{
+    uint8_t tmp = t->heap[a];
+    t->heap[a] = t->heap[b];
+    t->heap[b] = tmp;
+    t->pos[t->heap[a]] = a;
+    t->pos[t->heap[b]] = b;
+}
+
+static uint64_t heap_count(const struct topk *t, int h)
+{
+    return t->counters[t->heap[h]].count;
+}
+
+static void sift_up(struct topk *t, int h)
+{
+    while (h > 0 && heap_count(t, (h - 1) / 2) > heap_count(t, h)) {
+        heap_swap(t, h, (h - 1) / 2);
+        h = (h - 1) / 2;
+    }
+}
+
+static void sift_down(struct topk *t, int h)
+{
+    for (;;) {
+        int min = h,
+            l = 2 * h + 1,
+            r = l + 1;
+        if (l < t->size && heap_count(t, l) < heap_count(t, min))
+            min = l;
+        if (r < t->size && heap_count(t, r) < heap_count(t, min))
+            min = r;
+        if (min == h)
+            return;
+        heap_swap(t, h, min);
+        h = min;
+    }
+}
+
+void topk_init(struct topk *t)
+{
+    memset(t, 0, sizeof(*t));
+    memset(t->index, 0xff, sizeof(t->index));
+}
+
+/**
+ * Counts an occurrence of "key".
+ */
+void topk_add(struct topk *t, uint64_t key, int64_t ts, struct kshark_entry *entry)
+{
+    int slot = find_slot(t, key),
+        c = t->index[slot];
+
+    if (c >= 0) {
+        t->counters[c].count++;
+        sift_down(t, t->pos[c]);
+        return;
+    }
+
+    uint64_t error = 0;
+    if (t->size < TOPK_SIZE) {
+        c = t->size;
+        t->heap[c] = c;
+        t->pos[c] = c;
+        t->size++;
+    } else {
+        // Replace the smallest counter
+        c = t->heap[0];
+        error = t->counters[c].count;
+        index_remove(t, t->counters[c].key);
+        slot = find_slot(t, key);
+    }
+
+    t->index[slot] = c;
+    t->counters[c] = (struct topk_counter) {
+        .key = key,
+        .count = error + 1,
+        .error = error,
+        .first_ts = ts,
+        .first_entry = entry
+    };
+
+    if (error)
+        sift_down(t, t->pos[c]);
+    else
+        sift_up(t, t->pos[c]);
+}
+
+static int cmp_counters(const void *a, const void *b)
+{
+    const struct topk_counter *ca = a,
+                              *cb = b;
+    return (ca->count < cb->count) - (ca->count > cb->count);
+}
+
+/**
+ * Copies the counters to "out" (TOPK_SIZE elements),
+ * sorted by decreasing count. Returns how many they are.
+ */
+size_t topk_sorted(const struct topk *t, struct topk_counter *out)
+{
+    memcpy(out, t->counters, t->size * sizeof(*out));
+    qsort(out, t->size, sizeof(*out), cmp_counters);
+    return t->size;
+}
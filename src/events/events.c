@@ -0,0 +1,101 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef _GNU_SOURCE
+/** Use GNU C Library. */
+#define _GNU_SOURCE
+#endif // _GNU_SOURCE
+
+#include <stdio.h>
+
+#include "events.h"
+
+//
+// EVENT NAME
+//
+
+int get_evname(const uint32_t event_id, char *result_str)
+{
+    switch (GET_EVENT_CLS(event_id)) {
+        // General trace
+        case GET_EVENT_CLS(TRC_GEN):
+            return get_basecls_evname(event_id, result_str);
+        // Xen Scheduler trace
+        case GET_EVENT_CLS(TRC_SCHED):
+            return get_schedcls_evname(event_id, result_str);
+        // Xen DOM0 operation trace
+        case GET_EVENT_CLS(TRC_DOM0OP):
+            return get_dom0cls_evname(event_id, result_str);
+        // Xen HVM trace
+        case GET_EVENT_CLS(TRC_HVM):
+            return get_hvmcls_evname(event_id, result_str);
+        // Xen memory trace
+        case GET_EVENT_CLS(TRC_MEM):
+            return get_memcls_evname(event_id, result_str);
+        // Xen PV traces
+        case GET_EVENT_CLS(TRC_PV):
+            return get_pvcls_evname(event_id, result_str);
+        // Xen shadow tracing
+        case GET_EVENT_CLS(TRC_SHADOW):
+            return get_shdwcls_evname(event_id, result_str);
+        // Xen hardware-related traces
+        case GET_EVENT_CLS(TRC_HW):
+            return get_hwcls_evname(event_id, result_str);
+        default:
+            return 0;
+    }
+}
+
+//
+// EVENT INFO
+//
+
+int get_evinfo(const uint32_t event_id, const uint32_t *event_extra, char *result_str)
+{
+    switch (GET_EVENT_CLS(event_id)) {
+        // General trace
+        case GET_EVENT_CLS(TRC_GEN):
+            return get_basecls_evinfo(event_id, event_extra, result_str);
+        // Xen Scheduler trace
+        case GET_EVENT_CLS(TRC_SCHED):
+            return get_schedcls_evinfo(event_id, event_extra, result_str);
+        // Xen DOM0 operation trace
+        case GET_EVENT_CLS(TRC_DOM0OP):
+            return get_dom0cls_evinfo(event_id, event_extra, result_str);
+        // Xen HVM trace
+        case GET_EVENT_CLS(TRC_HVM):
+            return get_hvmcls_evinfo(event_id, event_extra, result_str);
+        // Xen memory trace
+        case GET_EVENT_CLS(TRC_MEM):
+            return get_memcls_evinfo(event_id, event_extra, result_str);
+        // Xen PV traces
+        case GET_EVENT_CLS(TRC_PV):
+            return get_pvcls_evinfo(event_id, event_extra, result_str);
+        // Xen shadow tracing
+        case GET_EVENT_CLS(TRC_SHADOW):
+            return get_shdwcls_evinfo(event_id, event_extra, result_str);
+        // Xen hardware-related traces
+        case GET_EVENT_CLS(TRC_HW):
+            return get_hwcls_evinfo(event_id, event_extra, result_str);
+        default:
+            return 0;
+    }
+}
@@ -41,6 +41,10 @@
 #define EVINFO(_str, _format, ...) snprintf(_str, STR_EVINFO_MAXLEN, \
                                                 _format, ##__VA_ARGS__)
 
+// Dispatch by event class | events.c
+int get_evname(const uint32_t, char*);
+int get_evinfo(const uint32_t, const uint32_t*, char*);
+
 // General trace | basecls.c
 int get_basecls_evname(const uint32_t, char*);
 int get_basecls_evinfo(const uint32_t, const uint32_t*, char*);
@@ -0,0 +1,248 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef _GNU_SOURCE
+/** Use GNU C Library. */
+#define _GNU_SOURCE
+#endif // _GNU_SOURCE
+
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "export.h"
+
+/*
+ * Writes the records as one little-endian binary file per column,
+ * plus a "manifest.json" describing them (dtype and shape, numpy
+ * notation), so that they can be memory-mapped as they are.
+ *
+ * The rows are split in blocks; worker threads take the next block,
+ * fill the column buffers of that block and write them at their
+ * offset in each file. Nothing is held beyond one block per thread.
+ */
+
+#define BLOCK_ROWS 65536
+#define MAX_THREADS 8
+#define PATH_MAXLEN 4096
+
+enum column {
+    COL_TS,
+    COL_CPU,
+    COL_DOM,
+    COL_VCPU,
+    COL_EVENT,
+    COL_EXTRA,
+    N_COLUMNS
+};
+
+static const struct {
+    const char *name,
+               *dtype;
+    // Bytes per row
+    size_t width;
+} columns[N_COLUMNS] = {
+    [COL_TS] = { "ts_ns", "<i8", sizeof(int64_t) },
+    [COL_CPU] = { "cpu", "<u2", sizeof(uint16_t) },
+    [COL_DOM] = { "dom", "<u2", sizeof(uint16_t) },
+    [COL_VCPU] = { "vcpu", "<u2", sizeof(uint16_t) },
+    [COL_EVENT] = { "event_id", "<u4", sizeof(uint32_t) },
+    [COL_EXTRA] = { "extra", "<u4", COLEXPORT_EXTRA_WORDS * sizeof(uint32_t) }
+};
+
+struct export_job {
+    int fds[N_COLUMNS];
+    size_t n_rows;
+    uint32_t next_block;
+    const xt_event *(*get_event)(size_t pos, xt_event *buf);
+    int64_t (*tsc_to_ns)(uint64_t);
+    // First error (negative errno)
+    int error;
+};
+
+static int write_all(int fd, const void *buf, size_t size, off_t offset)
+{
+    while (size) {
+        ssize_t n = pwrite(fd, buf, size, offset);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -errno;
+        }
+        buf = (const uint8_t *)buf + n;
+        size -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+static void fill_block(struct export_job *job, size_t start, uint32_t n, void **bufs)
+{
+    int64_t *ts = bufs[COL_TS];
+    uint16_t *cpu = bufs[COL_CPU],
+             *dom = bufs[COL_DOM],
+             *vcpu = bufs[COL_VCPU];
+    uint32_t *id = bufs[COL_EVENT],
+             *extra = bufs[COL_EXTRA];
+
+    for (uint32_t i = 0; i < n; ++i) {
+        xt_event buf;
+        const xt_event *event = job->get_event(start + i, &buf);
+        uint32_t *row_extra = extra + i * COLEXPORT_EXTRA_WORDS;
+        if (!event) {
+            ts[i] = cpu[i] = dom[i] = vcpu[i] = id[i] = 0;
+            memset(row_extra, 0, columns[COL_EXTRA].width);
+            continue;
+        }
+
+        ts[i] = htole64(job->tsc_to_ns((event->rec).tsc));
+        cpu[i] = htole16(event->cpu);
+        dom[i] = htole16((event->dom).id);
+        vcpu[i] = htole16((event->dom).vcpu);
+        id[i] = htole32((event->rec).id);
+        for (int w = 0; w < 7; ++w)
+            row_extra[w] = htole32((event->rec).extra[w]);
+        row_extra[7] = 0;
+    }
+}
+
+static void *export_worker(void *data)
+{
+    struct export_job *job = data;
+    void *bufs[N_COLUMNS] = { 0 };
+    int ret = 0;
+
+    for (int c = 0; c < N_COLUMNS; ++c)
+        if (!(bufs[c] = malloc(BLOCK_ROWS * columns[c].width))) {
+            ret = -ENOMEM;
+            goto out;
+        }
+
+    for (;;) {
+        uint64_t start = (uint64_t)__atomic_fetch_add(&job->next_block, 1, __ATOMIC_RELAXED) * BLOCK_ROWS;
+        if (start >= job->n_rows || __atomic_load_n(&job->error, __ATOMIC_RELAXED))
+            break;
+
+        uint32_t n = (job->n_rows - start > BLOCK_ROWS) ? BLOCK_ROWS : job->n_rows - start;
+        fill_block(job, start, n, bufs);
+
+        for (int c = 0; c < N_COLUMNS && !ret; ++c)
+            ret = write_all(job->fds[c], bufs[c], n * columns[c].width, start * columns[c].width);
+        if (ret)
+            break;
+    }
+
+out:
+    if (ret)
+        __atomic_compare_exchange_n(&job->error, &(int){ 0 }, ret, false,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    for (int c = 0; c < N_COLUMNS; ++c)
+        free(bufs[c]);
+    return NULL;
+}
+
+static int write_manifest(const char *dir, size_t n_rows, uint64_t cpu_hz)
+{
+    char path[PATH_MAXLEN];
+    snprintf(path, sizeof(path), "%s/manifest.json", dir);
+    FILE *fp = fopen(path, "w");
+    if (!fp)
+        return -errno;
+
+    fprintf(fp, "{\n  \"format\": \"xentrace-columns\",\n  \"version\": 1,\n");
+    fprintf(fp, "  \"rows\": %zu,\n  \"cpu_hz\": %"PRIu64",\n  \"columns\": [\n", n_rows, cpu_hz);
+    for (int c = 0; c < N_COLUMNS; ++c) {
+        fprintf(fp, "    { \"name\": \"%s\", \"file\": \"%s.bin\", \"dtype\": \"%s\", ",
+                    columns[c].name, columns[c].name, columns[c].dtype);
+        if (c == COL_EXTRA)
+            fprintf(fp, "\"shape\": [%zu, %d] }", n_rows, COLEXPORT_EXTRA_WORDS);
+        else
+            fprintf(fp, "\"shape\": [%zu] }", n_rows);
+        fprintf(fp, (c < N_COLUMNS - 1) ? ",\n" : "\n");
+    }
+    fprintf(fp, "  ]\n}\n");
+
+    return fclose(fp) ? -errno : 0;
+}
+
+/**
+ * Exports "n_rows" records (by position) to the directory "dir",
+ * which is created if missing. Returns 0 or a negative errno.
+ */
+int colexport_write(const char *dir, size_t n_rows, uint64_t cpu_hz,
+                        const xt_event *(*get_event)(size_t pos, xt_event *buf),
+                        int64_t (*tsc_to_ns)(uint64_t))
+{
+    if (mkdir(dir, 0755) && errno != EEXIST)
+        return -errno;
+
+    struct export_job job = {
+        .n_rows = n_rows,
+        .get_event = get_event,
+        .tsc_to_ns = tsc_to_ns
+    };
+
+    int c, ret = 0;
+    for (c = 0; c < N_COLUMNS; ++c) {
+        char path[PATH_MAXLEN];
+        snprintf(path, sizeof(path), "%s/%s.bin", dir, columns[c].name);
+        job.fds[c] = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (job.fds[c] < 0 || ftruncate(job.fds[c], (off_t)n_rows * columns[c].width)) {
+            ret = -errno;
+            if (job.fds[c] >= 0)
+                close(job.fds[c]);
+            goto close_fds;
+        }
+    }
+
+    long n_threads = sysconf(_SC_NPROCESSORS_ONLN),
+         n_blocks = (n_rows + BLOCK_ROWS - 1) / BLOCK_ROWS;
+    n_threads = (n_threads < 1) ? 1 : (n_threads > MAX_THREADS) ? MAX_THREADS : n_threads;
+    n_threads = (n_threads > n_blocks) ? n_blocks : n_threads;
+
+    pthread_t threads[MAX_THREADS];
+    int started = 0;
+    for (; started < n_threads; ++started)
+        if (pthread_create(&threads[started], NULL, export_worker, &job))
+            break;
+    // Without threads, the work is done here
+    if (!started)
+        export_worker(&job);
+    for (int t = 0; t < started; ++t)
+        pthread_join(threads[t], NULL);
+
+    ret = job.error;
+
+close_fds:
+    while (c-- > 0)
+        if (close(job.fds[c]) && !ret)
+            ret = -errno;
+
+    return ret ? ret : write_manifest(dir, n_rows, cpu_hz);
+}
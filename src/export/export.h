@@ -0,0 +1,49 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef __KSXT_EXPORT
+#define __KSXT_EXPORT
+
+#include <stdint.h>
+
+// XenTrace-Parser
+#include "xentrace-event.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// Columnar export | colexport.c
+//
+
+// Extra words per row of the "extra" matrix (7 + padding)
+#define COLEXPORT_EXTRA_WORDS 8
+
+int colexport_write(const char *dir, size_t n_rows, uint64_t cpu_hz,
+                        const xt_event *(*get_event)(size_t pos, xt_event *buf),
+                        int64_t (*tsc_to_ns)(uint64_t));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,81 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+// Qt
+#include <QInputDialog>
+#include <QMessageBox>
+
+#include "gui.hpp"
+#include "index/index.h"
+
+#define ERR_MAXLEN 128
+
+/**
+ * Applies the event, task and CPU filters of the XenTrace stream
+ * with the bitmap indexes, then redraws the graphs.
+ */
+void apply_bitmap_filters(KsMainWindow *ks)
+{
+    kshark_context *kshark_ctx = nullptr;
+    if (!kshark_instance(&kshark_ctx))
+        return;
+
+    if (xti_apply_filters(kshark_ctx) < 0)
+        return;
+
+    KsGLWidget *gl = ks->graphPtr()->glPtr();
+    gl->model()->update();
+    gl->update();
+}
+
+/**
+ * Asks for a field filter expression, e.g.
+ * "event == VMEXIT && exitcode == 0x1e && dom == 3", and applies it
+ * along with the other filters. An empty expression removes it.
+ */
+void show_field_filter_dialog(KsMainWindow *ks)
+{
+    static QString last;
+    bool ok = false;
+    QString text = QInputDialog::getText(ks, "XenTrace field filter",
+                                            "Show the records matching:",
+                                            QLineEdit::Normal, last, &ok);
+    if (!ok)
+        return;
+
+    xtf_expr *expr = nullptr;
+    if (!text.trimmed().isEmpty()) {
+        char err[ERR_MAXLEN];
+        expr = xtf_compile(text.toUtf8().constData(), err, sizeof(err));
+        if (!expr) {
+            QMessageBox::warning(ks, "XenTrace field filter", err);
+            return;
+        }
+    }
+
+    last = text;
+    ssize_t ret = xti_set_field_filter(expr);
+    xtf_free(expr);
+    if (ret < 0)
+        return;
+
+    apply_bitmap_filters(ks);
+}
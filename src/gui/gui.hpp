@@ -0,0 +1,63 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef __KSXT_GUI
+#define __KSXT_GUI
+
+// Qt
+#include <QDialog>
+#include <QStringList>
+#include <QTabWidget>
+#include <QTableWidget>
+#include <QVariant>
+
+// KernelShark.v2-Beta
+#include "KsMainWindow.hpp"
+
+/**
+ * Dialog of read-only, sortable tables. Each row can be linked to a
+ * KernelShark entry: double-clicking it moves the marker A there.
+ */
+class XtTableDialog : public QDialog {
+public:
+    XtTableDialog(KsMainWindow *ks, const QString &title);
+
+    QTableWidget *addTable(const QString &name, const QStringList &headers);
+    void addRow(QTableWidget *table, const QVariantList &cells,
+                    const kshark_entry *entry = nullptr);
+
+private:
+    KsMainWindow *_ks;
+    QTabWidget *_tabs;
+};
+
+// Menu actions
+void show_irqstat_dialog(KsMainWindow *ks);
+void show_power_dialog(KsMainWindow *ks);
+void show_shadow_dialog(KsMainWindow *ks);
+void show_pvprof_dialog(KsMainWindow *ks);
+void apply_bitmap_filters(KsMainWindow *ks);
+void show_field_filter_dialog(KsMainWindow *ks);
+void find_next_event(KsMainWindow *ks);
+void find_prev_event(KsMainWindow *ks);
+void show_load_progress(KsMainWindow *ks);
+
+#endif
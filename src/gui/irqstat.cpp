@@ -0,0 +1,89 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include "gui.hpp"
+#include "analysis/analysis.h"
+
+/**
+ * Cells shared by the IRQ and the pCPU tables.
+ */
+static QVariantList stats_cells(int id, const struct irq_stats *s)
+{
+    const struct lhist *h = &s->hist;
+    return {
+        id,
+        (qulonglong)h->count,
+        irqstat_rate(s),
+        (qulonglong)s->peak_rate,
+        h->count ? (qulonglong)(h->sum / h->count) : 0ULL,
+        (qulonglong)lhist_percentile(h, 50),
+        (qulonglong)lhist_percentile(h, 99),
+        (qulonglong)h->max
+    };
+}
+
+static void fill_stats_table(XtTableDialog *dialog, enum irqstat_kind kind)
+{
+    QStringList headers = {
+        kind == IRQSTAT_IRQ ? "IRQ" : "pCPU",
+        "Count", "Avg rate (/s)", "Peak rate (/s)",
+        "Mean (ns)", "p50 (ns)", "p99 (ns)", "Max (ns)"
+    };
+    if (kind == IRQSTAT_IRQ)
+        headers << "Vector moves" << "Vector assigns";
+
+    QTableWidget *table = dialog->addTable(kind == IRQSTAT_IRQ ? "Per IRQ" : "Per pCPU",
+                                            headers);
+
+    for (int id = 0; id < irqstat_count(kind); ++id) {
+        const struct irq_stats *s = irqstat_get(kind, id);
+        if (!s || !(s->hist.count || s->moves || s->assigns))
+            continue;
+
+        QVariantList cells = stats_cells(id, s);
+        if (kind == IRQSTAT_IRQ)
+            cells << (qulonglong)s->moves << (qulonglong)s->assigns;
+
+        // Linked to the longest handling of the IRQ/pCPU
+        dialog->addRow(table, cells, s->worst.entry);
+    }
+}
+
+/**
+ * Shows the physical IRQ handling statistics of the trace.
+ */
+void show_irqstat_dialog(KsMainWindow *ks)
+{
+    XtTableDialog *dialog = new XtTableDialog(ks, "XenTrace - IRQ handling");
+    fill_stats_table(dialog, IRQSTAT_IRQ);
+    fill_stats_table(dialog, IRQSTAT_CPU);
+
+    QTableWidget *table = dialog->addTable("Worst occurrences",
+                                            {"Duration (ns)", "IRQ", "pCPU", "Time (ns)"});
+
+    const struct irq_occurrence *worst;
+    size_t n_worst = irqstat_worst(&worst);
+    for (size_t i = 0; i < n_worst; ++i)
+        dialog->addRow(table, {(qulonglong)worst[i].duration, worst[i].irq,
+                                worst[i].cpu, (qlonglong)worst[i].ts}, worst[i].entry);
+
+    dialog->show();
+}
@@ -0,0 +1,43 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+// KernelShark.v2-Beta
+#include "libkshark-plugin.h"
+
+#include "gui.hpp"
+
+/**
+ * Loads the menu plugin (tables of the load-time analyses).
+ */
+extern "C" void *KSHARK_MENU_PLUGIN_INITIALIZER(void *gui_ptr)
+{
+    KsMainWindow *ks = static_cast<KsMainWindow *>(gui_ptr);
+    ks->addPluginMenu("Tools/XenTrace IRQ handling", show_irqstat_dialog);
+    ks->addPluginMenu("Tools/XenTrace power residency", show_power_dialog);
+    ks->addPluginMenu("Tools/XenTrace shadow paging", show_shadow_dialog);
+    ks->addPluginMenu("Tools/XenTrace PV profile", show_pvprof_dialog);
+    ks->addPluginMenu("Tools/XenTrace apply filters (bitmaps)", apply_bitmap_filters);
+    ks->addPluginMenu("Tools/XenTrace field filter", show_field_filter_dialog);
+    ks->addPluginMenu("Tools/XenTrace find next event", find_next_event);
+    ks->addPluginMenu("Tools/XenTrace find previous event", find_prev_event);
+    ks->addPluginMenu("Tools/XenTrace loading progress", show_load_progress);
+    return ks;
+}
@@ -0,0 +1,93 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include <algorithm>
+#include <set>
+
+#include "gui.hpp"
+#include "analysis/analysis.h"
+
+#define MAX_STATES 32
+
+/**
+ * Residency of each pCPU in [from, to], clipped to the records of the pCPU.
+ */
+static void fill_residency_table(XtTableDialog *dialog, enum power_kind kind,
+                                    int64_t from, int64_t to)
+{
+    uint32_t states[MAX_STATES];
+    std::set<uint32_t> all_states;
+
+    for (int cpu = 0; cpu < power_cpus_count(); ++cpu) {
+        int n = power_states(cpu, kind, states, MAX_STATES);
+        all_states.insert(states, states + std::min(n, MAX_STATES));
+    }
+
+    if (all_states.empty())
+        return;
+
+    QStringList headers = {"pCPU"};
+    for (uint32_t state : all_states)
+        headers << ((kind == POWER_CSTATE) ? QString("C%1 (%)").arg(state)
+                                            : QString("%1 MHz (%)").arg(state));
+
+    QTableWidget *table = dialog->addTable((kind == POWER_CSTATE) ? "C-states"
+                                                                    : "Frequencies",
+                                            headers);
+
+    for (int cpu = 0; cpu < power_cpus_count(); ++cpu) {
+        int64_t first, last;
+        if (!power_span(cpu, &first, &last))
+            continue;
+
+        first = std::max(first, from);
+        last = std::min(last, to);
+        if (last <= first)
+            continue;
+
+        QVariantList cells = {cpu};
+        for (uint32_t state : all_states)
+            cells << 100.0 * power_residency(cpu, kind, state, first, last) / (last - first);
+
+        dialog->addRow(table, cells);
+    }
+}
+
+/**
+ * Shows the C-state and frequency residency of each pCPU,
+ * over the time range visible in the graphs (the whole trace if none).
+ */
+void show_power_dialog(KsMainWindow *ks)
+{
+    XtTableDialog *dialog = new XtTableDialog(ks, "XenTrace - Power residency");
+
+    int64_t from = INT64_MIN,
+            to = INT64_MAX;
+    const kshark_trace_histo *histo = ks->graphPtr()->glPtr()->model()->histo();
+    if (histo && histo->max > histo->min) {
+        from = histo->min;
+        to = histo->max;
+    }
+
+    fill_residency_table(dialog, POWER_CSTATE, from, to);
+    fill_residency_table(dialog, POWER_FREQ, from, to);
+    dialog->show();
+}
@@ -0,0 +1,67 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+// Qt
+#include <QMessageBox>
+
+#include "gui.hpp"
+#include "store/store.h"
+
+/**
+ * Shows how far the background load of the trace is (see "XEN_PREVIEW").
+ */
+void show_load_progress(KsMainWindow *ks)
+{
+    struct xtbg_progress progress;
+    xtbg_progress(&progress);
+
+    QString text;
+    switch (progress.state) {
+        case XTBG_IDLE:
+            text = QString("The whole trace is loaded (%1 records).").arg(xts_count());
+            break;
+        case XTBG_PARSING:
+            text = QString("Parsing the trace: %1% (%2 s).")
+                        .arg(100.0 * progress.parsed, 0, 'f', 0)
+                        .arg(progress.elapsed_ns / 1e9, 0, 'f', 1);
+            break;
+        case XTBG_PACKING:
+            text = QString("Packing the records: %1% of the trace parsed (%2 s).")
+                        .arg(100.0 * progress.parsed, 0, 'f', 0)
+                        .arg(progress.elapsed_ns / 1e9, 0, 'f', 1);
+            break;
+        case XTBG_READY:
+            text = QString("The whole trace has been loaded (%1 records in %2 s).")
+                        .arg(progress.packed)
+                        .arg(progress.elapsed_ns / 1e9, 0, 'f', 1);
+            break;
+        case XTBG_FAILED:
+            text = "The whole trace cannot be loaded, only its beginning is shown.";
+            break;
+    }
+
+    // Appended at each reload of the stream
+    if (progress.state != XTBG_IDLE && progress.packed > xts_count())
+        text += QString("\n%1 records are shown, %2 more at the next reload of the stream.")
+                    .arg(xts_count()).arg(progress.packed - xts_count());
+
+    QMessageBox::information(ks, "XenTrace loading progress", text);
+}
@@ -0,0 +1,96 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include <vector>
+
+#include "gui.hpp"
+#include "analysis/analysis.h"
+// Events formatting
+#include "events/events.h"
+
+// Rows of the windowed view
+#define TOP_N 50
+
+static const char *kind_names[] = { "hypercall", "subcall", "trap", "other" };
+
+static void fill_summary_table(XtTableDialog *dialog)
+{
+    QTableWidget *table = dialog->addTable("Summary",
+                                            {"Domain", "Kind", "Number", "Name", "Count",
+                                             "Avg rate (/s)", "Peak rate (/s)",
+                                             "Inter-arrival p50 (ns)", "Inter-arrival p99 (ns)"});
+
+    const struct pv_stats *stats;
+    size_t n_stats = pvprof_stats(&stats);
+    char name[STR_EVNAME_MAXLEN];
+
+    for (size_t i = 0; i < n_stats; ++i) {
+        const struct pv_stats *s = &stats[i];
+        int64_t span = s->last_ts - s->first_ts;
+        if (pvprof_name(s, name) < 1)
+            name[0] = '\0';
+
+        dialog->addRow(table, {s->dom, kind_names[s->kind], s->number, name,
+                                (qulonglong)s->count,
+                                (span > 0) ? s->count * 1e9 / span : (double)s->count,
+                                pvprof_peak_rate(s),
+                                (qulonglong)lhist_percentile(&s->inter_arrival, 50),
+                                (qulonglong)lhist_percentile(&s->inter_arrival, 99)});
+    }
+}
+
+/**
+ * Top-N of the time range visible in the graphs.
+ */
+static void fill_window_table(XtTableDialog *dialog, int64_t from, int64_t to)
+{
+    QTableWidget *table = dialog->addTable("Top in visible range",
+                                            {"Rank", "Domain", "Name", "Count", "Rate (/s)"});
+
+    std::vector<struct pv_top> top(TOP_N);
+    size_t n_top = pvprof_top(from, to, top.data(), TOP_N);
+    char name[STR_EVNAME_MAXLEN];
+
+    for (size_t i = 0; i < n_top; ++i) {
+        if (pvprof_name(top[i].stats, name) < 1)
+            name[0] = '\0';
+
+        dialog->addRow(table, {(int)i + 1, top[i].stats->dom, name,
+                                (qulonglong)top[i].count,
+                                top[i].count * 1e9 / (to - from)});
+    }
+}
+
+/**
+ * Shows the PV hypercall/trap profile of the trace
+ * and the top-N of the visible time range.
+ */
+void show_pvprof_dialog(KsMainWindow *ks)
+{
+    XtTableDialog *dialog = new XtTableDialog(ks, "XenTrace - PV profile");
+    fill_summary_table(dialog);
+
+    const kshark_trace_histo *histo = ks->graphPtr()->glPtr()->model()->histo();
+    if (histo && histo->max > histo->min)
+        fill_window_table(dialog, histo->min, histo->max);
+
+    dialog->show();
+}
@@ -0,0 +1,107 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include <climits>
+
+// Qt
+#include <QInputDialog>
+#include <QMessageBox>
+
+// KernelShark.v2-Beta
+#include "KsDualMarker.hpp"
+
+#include "gui.hpp"
+#include "index/index.h"
+
+/**
+ * Moves the marker A to the next (or previous) entry of an event,
+ * starting from the active marker, else from the border of the
+ * visible range.
+ */
+static void find_event(KsMainWindow *ks, bool forward)
+{
+    static QString last_name;
+    static ssize_t last_pos = -1;
+
+    bool ok = false;
+    QString name = QInputDialog::getText(ks, "XenTrace find event",
+                                            "Event name (a trailing '*' matches a prefix):",
+                                            QLineEdit::Normal, last_name, &ok);
+    if (!ok || name.trimmed().isEmpty())
+        return;
+
+    struct xzm_query query = {};
+    query.dom = -1;
+    QByteArray pattern = name.trimmed().toUtf8();
+    for (int i = 0; i < evids_count(); ++i) {
+        if (!evids_match_name(i, pattern.constData()))
+            continue;
+        if (query.n_events == XZM_MAX_EVENTS) {
+            QMessageBox::warning(ks, "XenTrace find event", "Too many matching events.");
+            return;
+        }
+        query.events[query.n_events++] = i;
+    }
+
+    if (!query.n_events) {
+        QMessageBox::warning(ks, "XenTrace find event", "Unknown event.");
+        return;
+    }
+
+    // Entries after (or before) the marker, which may be on the last
+    // entry found (among others at the same time)
+    KsDualMarkerSM *markers = ks->findChild<KsDualMarkerSM *>();
+    KsGraphMark *marker = markers ? &markers->activeMarker() : nullptr;
+    const kshark_trace_histo *histo = ks->graphPtr()->glPtr()->model()->histo();
+    const kshark_entry *last = (last_pos >= 0) ? xti_entry(last_pos) : nullptr;
+    ssize_t from;
+    if (marker && marker->isSet() && last && last->ts == marker->_ts) {
+        from = last_pos;
+    } else {
+        int64_t ts = (marker && marker->isSet()) ? marker->_ts + forward :
+                        (forward ? histo->min : histo->max + 1);
+        from = xzm_find_ts(ts);
+        if (from < 0 && !forward)
+            from = SSIZE_MAX;
+        else if (forward)
+            from--;
+    }
+
+    last_name = name;
+    ssize_t found = xzm_find(&query, from, forward);
+    if (found < 0) {
+        QMessageBox::information(ks, "XenTrace find event", "No more entries.");
+        return;
+    }
+
+    last_pos = found;
+    ks->markEntry(xti_entry(found), DualMarkerState::A);
+}
+
+void find_next_event(KsMainWindow *ks)
+{
+    find_event(ks, true);
+}
+
+void find_prev_event(KsMainWindow *ks)
+{
+    find_event(ks, false);
+}
@@ -0,0 +1,64 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include "gui.hpp"
+#include "analysis/analysis.h"
+// Events formatting
+#include "events/events.h"
+
+static void fill_topk_table(XtTableDialog *dialog, enum shadow_key kind)
+{
+    QTableWidget *table = dialog->addTable((kind == SHADOW_VA) ? "Guest VAs" : "GFNs",
+                                            {"Domain", "Event", (kind == SHADOW_VA) ? "VA" : "GFN",
+                                             "Count", "Max error", "First seen (ns)"});
+
+    const struct shadow_dom *const *doms;
+    int n_doms = shadow_doms(&doms);
+    struct topk_counter counters[TOPK_SIZE];
+    char type_name[STR_EVNAME_MAXLEN];
+
+    for (int i = 0; i < n_doms; ++i)
+        for (int t = 0; t < SHADOW_TYPES; ++t) {
+            size_t n = topk_sorted(&doms[i]->topk[t][kind], counters);
+            if (!n || shadow_type_name(t, type_name) < 1)
+                continue;
+
+            for (size_t c = 0; c < n; ++c)
+                dialog->addRow(table, {doms[i]->dom, type_name,
+                                        QString("0x%1").arg((qulonglong)counters[c].key, 0, 16),
+                                        (qulonglong)counters[c].count,
+                                        (qulonglong)counters[c].error,
+                                        (qlonglong)counters[c].first_ts},
+                                counters[c].first_entry);
+        }
+}
+
+/**
+ * Shows the hottest guest virtual addresses and gfns
+ * of the shadow paging records, per domain and event.
+ */
+void show_shadow_dialog(KsMainWindow *ks)
+{
+    XtTableDialog *dialog = new XtTableDialog(ks, "XenTrace - Shadow paging");
+    fill_topk_table(dialog, SHADOW_VA);
+    fill_topk_table(dialog, SHADOW_GFN);
+    dialog->show();
+}
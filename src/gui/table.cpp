@@ -0,0 +1,84 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+// Qt
+#include <QHeaderView>
+#include <QVBoxLayout>
+
+#include "gui.hpp"
+
+XtTableDialog::XtTableDialog(KsMainWindow *ks, const QString &title)
+: QDialog(ks),
+  _ks(ks),
+  _tabs(new QTabWidget(this))
+{
+    setAttribute(Qt::WA_DeleteOnClose);
+    setWindowTitle(title);
+    resize(800, 500);
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->addWidget(_tabs);
+}
+
+/**
+ * Adds a (tabbed) table to the dialog.
+ */
+QTableWidget *XtTableDialog::addTable(const QString &name, const QStringList &headers)
+{
+    QTableWidget *table = new QTableWidget(0, headers.size(), _tabs);
+    table->setHorizontalHeaderLabels(headers);
+    table->setEditTriggers(QTableWidget::NoEditTriggers);
+    table->setSelectionBehavior(QTableWidget::SelectRows);
+    table->horizontalHeader()->setStretchLastSection(true);
+
+    connect(table, &QTableWidget::cellDoubleClicked, this, [this, table](int row, int) {
+        const kshark_entry *entry = static_cast<const kshark_entry *>(
+                        table->item(row, 0)->data(Qt::UserRole).value<void *>());
+        if (entry)
+            _ks->markEntry(entry, DualMarkerState::A);
+    });
+
+    _tabs->addTab(table, name);
+    return table;
+}
+
+/**
+ * Appends a row. Numeric cells are kept as numbers, so that
+ * the columns sort by value.
+ */
+void XtTableDialog::addRow(QTableWidget *table, const QVariantList &cells,
+                            const kshark_entry *entry)
+{
+    // Rows are appended unsorted, then sorted again
+    table->setSortingEnabled(false);
+
+    int row = table->rowCount();
+    table->setRowCount(row + 1);
+    for (int col = 0; col < cells.size(); ++col) {
+        QTableWidgetItem *item = new QTableWidgetItem;
+        item->setData(Qt::DisplayRole, cells.at(col));
+        if (!col)
+            item->setData(Qt::UserRole, QVariant::fromValue((void *)entry));
+        table->setItem(row, col, item);
+    }
+
+    table->setSortingEnabled(true);
+}
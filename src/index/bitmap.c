@@ -0,0 +1,342 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef _GNU_SOURCE
+/** Use GNU C Library. */
+#define _GNU_SOURCE
+#endif // _GNU_SOURCE
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "index.h"
+
+#define CONTAINERS_INIT_SIZE 4
+#define ARRAY_INIT_SIZE 4
+
+/*
+ * Each container holds the values sharing the high 16 bits, either
+ * as a sorted array of the low 16 bits (up to XBM_ARRAY_MAX values)
+ * or as a 65536-bit bitmap. Binary operations work container by
+ * container, on the bitmap form, and store back the smaller form.
+ */
+
+typedef uint64_t (*word_op)(uint64_t, uint64_t);
+
+static uint64_t op_or(uint64_t a, uint64_t b) { return a | b; }
+static uint64_t op_and(uint64_t a, uint64_t b) { return a & b; }
+static uint64_t op_andnot(uint64_t a, uint64_t b) { return a & ~b; }
+static uint64_t op_xor(uint64_t a, uint64_t b) { return a ^ b; }
+
+static void container_free(struct xbm_container *c)
+{
+    if (c->is_bitmap)
+        free(c->words);
+    else
+        free(c->array);
+}
+
+static struct xbm_container *push_container(struct xbm *bm, uint16_t key)
+{
+    if (bm->size == bm->capacity) {
+        size_t new_cap = bm->capacity ? bm->capacity * 2 : CONTAINERS_INIT_SIZE;
+        struct xbm_container *tmp = realloc(bm->containers, new_cap * sizeof(*tmp));
+        if (!tmp)
+            return NULL;
+        bm->containers = tmp;
+        bm->capacity = new_cap;
+    }
+
+    struct xbm_container *c = &bm->containers[bm->size++];
+    memset(c, 0, sizeof(*c));
+    c->key = key;
+    return c;
+}
+
+static int to_bitmap(struct xbm_container *c)
+{
+    uint64_t *words = calloc(XBM_WORDS, sizeof(*words));
+    if (!words)
+        return -ENOMEM;
+
+    for (uint32_t i = 0; i < c->card; ++i)
+        words[c->array[i] >> 6] |= 1ULL << (c->array[i] & 63);
+
+    free(c->array);
+    c->words = words;
+    c->is_bitmap = true;
+    return 0;
+}
+
+/**
+ * Adds a value greater than all the ones already in the bitmap.
+ */
+int xbm_append(struct xbm *bm, uint32_t val)
+{
+    uint16_t key = val >> 16,
+             low = val & 0xffff;
+
+    struct xbm_container *c = bm->size ? &bm->containers[bm->size - 1] : NULL;
+    if (!c || c->key != key)
+        if (!(c = push_container(bm, key)))
+            return -ENOMEM;
+
+    if (c->is_bitmap) {
+        c->words[low >> 6] |= 1ULL << (low & 63);
+        c->card++;
+        return 0;
+    }
+
+    if (c->card == XBM_ARRAY_MAX) {
+        if (to_bitmap(c))
+            return -ENOMEM;
+        return xbm_append(bm, val);
+    }
+
+    if (c->card == c->capacity) {
+        uint32_t new_cap = c->capacity ? c->capacity * 2 : ARRAY_INIT_SIZE;
+        uint16_t *tmp = realloc(c->array, new_cap * sizeof(*tmp));
+        if (!tmp)
+            return -ENOMEM;
+        c->array = tmp;
+        c->capacity = new_cap;
+    }
+
+    c->array[c->card++] = low;
+    return 0;
+}
+
+/**
+ * Sets the bitmap to [from, to).
+ */
+int xbm_fill(struct xbm *bm, uint32_t from, uint64_t to)
+{
+    xbm_free(bm);
+    for (uint64_t key = from >> 16; key << 16 < to; ++key) {
+        struct xbm_container *c = push_container(bm, key);
+        if (!c || !(c->words = malloc(XBM_WORDS * sizeof(uint64_t))))
+            goto fail;
+
+        // Bits [lo, hi) of the container
+        uint64_t base = key << 16;
+        uint32_t lo = (from > base) ? from - base : 0,
+                 hi = (to - base < 65536) ? to - base : 65536;
+        memset(c->words, 0, XBM_WORDS * sizeof(uint64_t));
+        for (uint32_t v = lo; v < hi; ) {
+            if (!(v % 64) && hi - v >= 64) {
+                c->words[v / 64] = UINT64_MAX;
+                v += 64;
+            } else {
+                c->words[v / 64] |= 1ULL << (v % 64);
+                ++v;
+            }
+        }
+
+        c->is_bitmap = true;
+        c->card = hi - lo;
+    }
+    return 0;
+
+fail:
+    xbm_free(bm);
+    return -ENOMEM;
+}
+
+uint64_t xbm_cardinality(const struct xbm *bm)
+{
+    uint64_t card = 0;
+    for (size_t i = 0; i < bm->size; ++i)
+        card += bm->containers[i].card;
+    return card;
+}
+
+static void load_words(const struct xbm_container *c, uint64_t *words)
+{
+    if (!c) {
+        memset(words, 0, XBM_WORDS * sizeof(*words));
+    } else if (c->is_bitmap) {
+        memcpy(words, c->words, XBM_WORDS * sizeof(*words));
+    } else {
+        memset(words, 0, XBM_WORDS * sizeof(*words));
+        for (uint32_t i = 0; i < c->card; ++i)
+            words[c->array[i] >> 6] |= 1ULL << (c->array[i] & 63);
+    }
+}
+
+/**
+ * Appends the result of an operation between two containers
+ * (either may be missing), in the smaller of the two forms.
+ */
+static int combine(struct xbm *out, uint16_t key, const struct xbm_container *a,
+                    const struct xbm_container *b, word_op op, uint64_t *words)
+{
+    uint64_t tmp[XBM_WORDS];
+    load_words(a, words);
+    load_words(b, tmp);
+
+    uint32_t card = 0;
+    for (int i = 0; i < XBM_WORDS; ++i) {
+        words[i] = op(words[i], tmp[i]);
+        card += __builtin_popcountll(words[i]);
+    }
+
+    if (!card)
+        return 0;
+
+    struct xbm_container *c = push_container(out, key);
+    if (!c)
+        return -ENOMEM;
+    c->card = card;
+
+    if (card > XBM_ARRAY_MAX) {
+        if (!(c->words = malloc(XBM_WORDS * sizeof(uint64_t))))
+            return -ENOMEM;
+        memcpy(c->words, words, XBM_WORDS * sizeof(uint64_t));
+        c->is_bitmap = true;
+        return 0;
+    }
+
+    if (!(c->array = malloc(card * sizeof(uint16_t))))
+        return -ENOMEM;
+    c->capacity = card;
+
+    uint32_t n = 0;
+    for (int i = 0; i < XBM_WORDS; ++i)
+        for (uint64_t w = words[i]; w; w &= w - 1)
+            c->array[n++] = (i << 6) | __builtin_ctzll(w);
+    return 0;
+}
+
+/**
+ * Merges the containers of two bitmaps. "keep_a" and "keep_b" tell
+ * whether a container present in one bitmap only may produce values.
+ */
+static int binary_op(const struct xbm *a, const struct xbm *b, struct xbm *out,
+                        word_op op, bool keep_a, bool keep_b)
+{
+    uint64_t *words = malloc(XBM_WORDS * sizeof(*words));
+    if (!words)
+        return -ENOMEM;
+
+    struct xbm res = { 0 };
+    size_t i = 0,
+           j = 0;
+    int ret = 0;
+
+    while (!ret && (i < a->size || j < b->size)) {
+        const struct xbm_container *ca = (i < a->size) ? &a->containers[i] : NULL,
+                                   *cb = (j < b->size) ? &b->containers[j] : NULL;
+
+        if (ca && (!cb || ca->key < cb->key)) {
+            if (keep_a)
+                ret = combine(&res, ca->key, ca, NULL, op, words);
+            ++i;
+        } else if (cb && (!ca || cb->key < ca->key)) {
+            if (keep_b)
+                ret = combine(&res, cb->key, NULL, cb, op, words);
+            ++j;
+        } else {
+            ret = combine(&res, ca->key, ca, cb, op, words);
+            ++i;
+            ++j;
+        }
+    }
+
+    free(words);
+    if (ret) {
+        xbm_free(&res);
+        return ret;
+    }
+
+    xbm_move(out, &res);
+    return 0;
+}
+
+int xbm_or(const struct xbm *a, const struct xbm *b, struct xbm *out)
+{
+    return binary_op(a, b, out, op_or, true, true);
+}
+
+int xbm_and(const struct xbm *a, const struct xbm *b, struct xbm *out)
+{
+    return binary_op(a, b, out, op_and, false, false);
+}
+
+int xbm_andnot(const struct xbm *a, const struct xbm *b, struct xbm *out)
+{
+    return binary_op(a, b, out, op_andnot, true, false);
+}
+
+int xbm_xor(const struct xbm *a, const struct xbm *b, struct xbm *out)
+{
+    return binary_op(a, b, out, op_xor, true, true);
+}
+
+int xbm_copy(struct xbm *dst, const struct xbm *src)
+{
+    const struct xbm empty = { 0 };
+    return binary_op(src, &empty, dst, op_or, true, false);
+}
+
+/**
+ * Calls "func" on every value, in increasing order.
+ */
+void xbm_foreach(const struct xbm *bm, void (*func)(uint32_t, void *), void *data)
+{
+    for (size_t i = 0; i < bm->size; ++i) {
+        const struct xbm_container *c = &bm->containers[i];
+        uint32_t high = (uint32_t)c->key << 16;
+
+        if (!c->is_bitmap) {
+            for (uint32_t v = 0; v < c->card; ++v)
+                func(high | c->array[v], data);
+            continue;
+        }
+
+        for (int w = 0; w < XBM_WORDS; ++w)
+            for (uint64_t word = c->words[w]; word; word &= word - 1)
+                func(high | (w << 6) | __builtin_ctzll(word), data);
+    }
+}
+
+/**
+ * Replaces "dst" with "src" (left empty).
+ */
+void xbm_move(struct xbm *dst, struct xbm *src)
+{
+    if (dst == src)
+        return;
+
+    xbm_free(dst);
+    *dst = *src;
+    memset(src, 0, sizeof(*src));
+}
+
+void xbm_free(struct xbm *bm)
+{
+    for (size_t i = 0; i < bm->size; ++i)
+        container_free(&bm->containers[i]);
+
+    free(bm->containers);
+    memset(bm, 0, sizeof(*bm));
+}
@@ -0,0 +1,188 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef _GNU_SOURCE
+/** Use GNU C Library. */
+#define _GNU_SOURCE
+#endif // _GNU_SOURCE
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Events formatting
+#include "events/events.h"
+
+#include "index.h"
+// USDT probes
+#include "stats/probes.h"
+
+#define IDS_INIT_SIZE 64
+// Dense ids must fit "kshark_entry.event_id"
+#define DENSE_ID_MAX INT16_MAX
+
+/*
+ * XenTrace event ids are 28 bits wide, while KernelShark keeps a
+ * 16-bit "event_id" per entry. Every distinct id is given a dense
+ * id, in order of first appearance.
+ */
+static struct {
+    // Full id of each dense id
+    uint32_t *full;
+    int size,
+        capacity;
+    // Open-addressing table: full id -> dense id + 1 (0 if empty)
+    uint32_t *keys;
+    int16_t *values;
+    int table_size;
+    // Last lookup
+    uint32_t last_id;
+    int last_dense;
+} E = { .last_dense = -1 };
+
+static unsigned hash_id(uint32_t id, int table_size)
+{
+    return (id * 0x9e3779b1u) >> 7 & (table_size - 1);
+}
+
+static int find_slot(uint32_t id)
+{
+    unsigned slot = hash_id(id, E.table_size);
+    while (E.values[slot] && E.keys[slot] != id)
+        slot = (slot + 1) & (E.table_size - 1);
+    return slot;
+}
+
+static int grow_table()
+{
+    int size = E.table_size ? E.table_size * 2 : 2 * IDS_INIT_SIZE;
+    uint32_t *keys = calloc(size, sizeof(*keys));
+    int16_t *values = calloc(size, sizeof(*values));
+    if (!keys || !values) {
+        free(keys);
+        free(values);
+        return -ENOMEM;
+    }
+
+    free(E.keys);
+    free(E.values);
+    E.keys = keys;
+    E.values = values;
+    E.table_size = size;
+
+    for (int i = 0; i < E.size; ++i) {
+        int slot = find_slot(E.full[i]);
+        E.keys[slot] = E.full[i];
+        E.values[slot] = i + 1;
+    }
+    return 0;
+}
+
+/**
+ * Returns the dense id of an event id (adding it if new),
+ * or a negative error code.
+ */
+int evids_get(uint32_t event_id)
+{
+    if (E.last_dense >= 0 && E.last_id == event_id) {
+        XT_PROBE2(evids__hit, event_id, E.last_dense);
+        return E.last_dense;
+    }
+
+    if (2 * (E.size + 1) > E.table_size && grow_table())
+        return -ENOMEM;
+
+    int slot = find_slot(event_id);
+    if (!E.values[slot]) {
+        if (E.size == DENSE_ID_MAX)
+            return -ERANGE;
+
+        if (E.size == E.capacity) {
+            int new_cap = E.capacity ? E.capacity * 2 : IDS_INIT_SIZE;
+            uint32_t *tmp = realloc(E.full, new_cap * sizeof(*tmp));
+            if (!tmp)
+                return -ENOMEM;
+            E.full = tmp;
+            E.capacity = new_cap;
+        }
+
+        E.full[E.size] = event_id;
+        E.keys[slot] = event_id;
+        E.values[slot] = ++E.size;
+        XT_PROBE2(evids__new, event_id, E.size - 1);
+    }
+
+    E.last_id = event_id;
+    E.last_dense = E.values[slot] - 1;
+    XT_PROBE2(evids__miss, event_id, E.last_dense);
+    return E.last_dense;
+}
+
+/**
+ * Returns the dense id of an event id, -1 if not seen.
+ */
+int evids_find(uint32_t event_id)
+{
+    if (!E.table_size)
+        return -1;
+
+    int slot = find_slot(event_id);
+    return E.values[slot] - 1;
+}
+
+/**
+ * Returns the event id of a dense id (0 if unknown).
+ */
+uint32_t evids_full(int dense_id)
+{
+    return (dense_id >= 0 && dense_id < E.size) ? E.full[dense_id] : 0;
+}
+
+/**
+ * Checks if the name of the event of a dense id is "pattern"
+ * (or starts with it, if "pattern" ends with '*').
+ */
+bool evids_match_name(int dense_id, const char *pattern)
+{
+    char name[STR_EVNAME_MAXLEN];
+    if (get_evname(evids_full(dense_id), name) < 1)
+        return false;
+
+    size_t len = strlen(pattern);
+    if (len && pattern[len - 1] == '*')
+        return !strncmp(name, pattern, len - 1);
+    return !strcmp(name, pattern);
+}
+
+int evids_count()
+{
+    return E.size;
+}
+
+void evids_free()
+{
+    free(E.full);
+    free(E.keys);
+    free(E.values);
+    memset(&E, 0, sizeof(E));
+    E.last_dense = -1;
+}
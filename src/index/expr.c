@@ -0,0 +1,719 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef _GNU_SOURCE
+/** Use GNU C Library. */
+#define _GNU_SOURCE
+#endif // _GNU_SOURCE
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Xen Project
+#include <trace.h>
+// Events formatting
+#include "events/events.h"
+
+#include "index.h"
+
+/*
+ * Filter expressions, e.g.
+ *   event == VMEXIT && exitcode == 0x1e && dom == 3
+ *   event == "csched2:credit_burn" and delta > 500000
+ *
+ * A predicate compares a field with a constant (==, !=, <, <=, >, >=,
+ * "&" tests for common bits); predicates are combined with &&/and,
+ * ||/or, !/not and parentheses. The "event" field is compared with an
+ * event name (a trailing '*' matches a prefix).
+ *
+ * The expression is compiled to a postfix program, bound to the dense
+ * event ids of the loaded trace. It is evaluated over batches of
+ * records stored by columns: each predicate produces a mask of the
+ * whole batch, then the masks are combined. Records of events not
+ * defining a field never match a predicate on it.
+ */
+
+#define NO_WORD 0xff
+#define MAX_PREDS 64
+#define MAX_DEPTH 16
+#define TOKEN_MAXLEN 64
+
+// Field decoded from the extra words of an event
+struct field_def {
+    uint32_t event_id;
+    const char *name;
+    // Low and high (NO_WORD if 32-bit) word
+    uint8_t lo,
+            hi,
+            shift,
+            bits;
+    bool is_signed;
+};
+
+#define FIELD(_ev, _name, _w) { _ev, _name, _w, NO_WORD, 0, 32, false }
+#define FIELD_S(_ev, _name, _w) { _ev, _name, _w, NO_WORD, 0, 32, true }
+#define FIELD_BITS(_ev, _name, _w, _sh, _b) { _ev, _name, _w, NO_WORD, _sh, _b, false }
+#define FIELD64(_ev, _name, _lo, _hi) { _ev, _name, _lo, _hi, 0, 64, false }
+
+#define CSCHED2_EVT(_e) TRC_SCHED_CLASS_EVT(CSCHED2, _e)
+
+// Layouts as printed by the "get_*_evinfo" functions
+static const struct field_def fields[] = {
+    // HVM
+    FIELD(TRC_HVM_VMEXIT, "exitcode", 0),
+    FIELD(TRC_HVM_VMEXIT, "rip", 1),
+    FIELD(TRC_HVM_VMEXIT | TRC_HVM_NESTEDFLAG, "exitcode", 0),
+    FIELD(TRC_HVM_VMEXIT | TRC_HVM_NESTEDFLAG, "rip", 1),
+    FIELD(TRC_HVM_VMEXIT64, "exitcode", 0),
+    FIELD64(TRC_HVM_VMEXIT64, "rip", 1, 2),
+    FIELD(TRC_HVM_VMEXIT64 | TRC_HVM_NESTEDFLAG, "exitcode", 0),
+    FIELD64(TRC_HVM_VMEXIT64 | TRC_HVM_NESTEDFLAG, "rip", 1, 2),
+    FIELD(TRC_HVM_PF_XEN, "virt", 0),
+    FIELD(TRC_HVM_PF_XEN, "errorcode", 1),
+    FIELD64(TRC_HVM_PF_XEN64, "virt", 0, 1),
+    FIELD(TRC_HVM_PF_XEN64, "errorcode", 2),
+    FIELD(TRC_HVM_PF_INJECT, "errorcode", 0),
+    FIELD(TRC_HVM_PF_INJECT, "virt", 1),
+    FIELD(TRC_HVM_PF_INJECT64, "errorcode", 0),
+    FIELD64(TRC_HVM_PF_INJECT64, "virt", 1, 2),
+    FIELD(TRC_HVM_INJ_EXC, "vector", 0),
+    FIELD(TRC_HVM_INJ_EXC, "errorcode", 1),
+    FIELD(TRC_HVM_INJ_VIRQ, "vector", 0),
+    FIELD(TRC_HVM_REINJ_VIRQ, "vector", 0),
+    FIELD(TRC_HVM_INTR, "vector", 0),
+    FIELD(TRC_HVM_TRAP, "vector", 0),
+    FIELD(TRC_HVM_IO_READ, "port", 0),
+    FIELD(TRC_HVM_IO_READ, "size", 1),
+    FIELD(TRC_HVM_IO_WRITE, "port", 0),
+    FIELD(TRC_HVM_IO_WRITE, "size", 1),
+    FIELD(TRC_HVM_CR_READ, "cr", 0),
+    FIELD(TRC_HVM_CR_READ, "value", 1),
+    FIELD(TRC_HVM_CR_WRITE, "cr", 0),
+    FIELD(TRC_HVM_CR_WRITE, "value", 1),
+    FIELD(TRC_HVM_CR_READ64, "cr", 0),
+    FIELD64(TRC_HVM_CR_READ64, "value", 1, 2),
+    FIELD(TRC_HVM_CR_WRITE64, "cr", 0),
+    FIELD64(TRC_HVM_CR_WRITE64, "value", 1, 2),
+    FIELD(TRC_HVM_MSR_READ, "msr", 0),
+    FIELD64(TRC_HVM_MSR_READ, "value", 1, 2),
+    FIELD(TRC_HVM_MSR_WRITE, "msr", 0),
+    FIELD64(TRC_HVM_MSR_WRITE, "value", 1, 2),
+    FIELD(TRC_HVM_CPUID, "func", 0),
+    FIELD(TRC_HVM_VMMCALL, "func", 0),
+    FIELD(TRC_HVM_IOPORT_READ, "port", 0),
+    FIELD(TRC_HVM_IOPORT_READ, "data", 1),
+    FIELD(TRC_HVM_IOPORT_WRITE, "port", 0),
+    FIELD(TRC_HVM_IOPORT_WRITE, "data", 1),
+    FIELD(TRC_HVM_IOMEM_READ, "port", 0),
+    FIELD(TRC_HVM_IOMEM_READ, "data", 1),
+    FIELD(TRC_HVM_IOMEM_WRITE, "port", 0),
+    FIELD(TRC_HVM_IOMEM_WRITE, "data", 1),
+    FIELD64(TRC_HVM_NPF, "gpa", 0, 1),
+    FIELD64(TRC_HVM_NPF, "mfn", 2, 3),
+    FIELD(TRC_HVM_NPF, "qual", 4),
+    FIELD(TRC_HVM_NPF, "p2mt", 5),
+    // Scheduler
+    FIELD_S(TRC_SCHED_SWITCH_INFPREV, "runtime", 2),
+    FIELD_S(TRC_SCHED_SWITCH_INFNEXT, "time", 2),
+    FIELD_S(TRC_SCHED_SWITCH_INFNEXT, "r_time", 3),
+    FIELD(TRC_SCHED_SHUTDOWN, "reason", 2),
+    FIELD(TRC_SCHED_SHUTDOWN_CODE, "reason", 2),
+    FIELD_S(CSCHED2_EVT(3), "credit", 1),
+    FIELD_S(CSCHED2_EVT(3), "budget", 2),
+    FIELD_S(CSCHED2_EVT(3), "delta", 3),
+    FIELD_S(CSCHED2_EVT(5), "credit", 1),
+    FIELD_S(CSCHED2_EVT(5), "score", 2),
+    FIELD_S(CSCHED2_EVT(7), "cr_start", 1),
+    FIELD_S(CSCHED2_EVT(7), "cr_end", 2),
+    FIELD(CSCHED2_EVT(10), "rq_id", 1),
+    FIELD_S(CSCHED2_EVT(19), "credit", 2),
+    FIELD(CSCHED2_EVT(19), "tickled_cpu", 1),
+    FIELD_S(CSCHED2_EVT(21), "runtime", 1),
+    // Hardware
+    FIELD(TRC_PM_FREQ_CHANGE, "old", 0),
+    FIELD(TRC_PM_FREQ_CHANGE, "new", 1),
+    FIELD(TRC_PM_IDLE_ENTRY, "cx", 0),
+    FIELD(TRC_PM_IDLE_EXIT, "cx", 0),
+    FIELD(TRC_HW_IRQ_HANDLED, "irq", 0),
+    FIELD(TRC_HW_IRQ_MOVE_FINISH, "irq", 0),
+    FIELD(TRC_HW_IRQ_MOVE_FINISH, "vector", 1),
+    FIELD(TRC_HW_IRQ_ASSIGN_VECTOR, "irq", 0),
+    FIELD(TRC_HW_IRQ_ASSIGN_VECTOR, "vector", 1),
+    // PV
+    FIELD(TRC_PV_HYPERCALL, "op", 1),
+    FIELD(TRC_PV_HYPERCALL, "eip", 0),
+    FIELD(TRC_PV_HYPERCALL | TRC_64_FLAG, "op", 2),
+    FIELD64(TRC_PV_HYPERCALL | TRC_64_FLAG, "rip", 0, 1),
+    FIELD_BITS(TRC_PV_HYPERCALL_V2, "op", 0, 0, 20),
+    FIELD_BITS(TRC_PV_HYPERCALL_SUBCALL, "op", 0, 0, 20),
+    FIELD_BITS(TRC_PV_TRAP, "trapnr", 1, 0, 15),
+    FIELD_BITS(TRC_PV_TRAP | TRC_64_FLAG, "trapnr", 2, 0, 15),
+};
+
+#define N_FIELDS (sizeof(fields) / sizeof(*fields))
+
+// Fields of every record
+enum column {
+    COL_EVENT,
+    COL_ID,
+    COL_DOM,
+    COL_VCPU,
+    COL_CPU,
+    COL_TS,
+    // w0..w6 (raw extra words)
+    COL_WORD,
+    // Field of "fields"
+    COL_FIELD = COL_WORD + XTF_WORDS
+};
+
+static const char *const column_names[] = {
+    [COL_EVENT] = "event",
+    [COL_ID] = "id",
+    [COL_DOM] = "dom",
+    [COL_VCPU] = "vcpu",
+    [COL_CPU] = "cpu",
+    [COL_TS] = "ts"
+};
+
+enum op {
+    OP_EQ,
+    OP_NE,
+    OP_LT,
+    OP_LE,
+    OP_GT,
+    OP_GE,
+    OP_BITS
+};
+
+// Decoding of a field for a dense event id
+struct access {
+    bool defined,
+         is_signed;
+    uint8_t lo,
+            hi,
+            shift,
+            bits;
+};
+
+struct pred {
+    int column;
+    enum op op;
+    bool is_signed;
+    uint64_t value;
+    // COL_EVENT: matching dense ids, COL_FIELD: decoding by dense id
+    uint8_t *events;
+    struct access *access;
+};
+
+// Program items: predicate index, or one of these
+enum {
+    INS_AND = -1,
+    INS_OR = -2,
+    INS_NOT = -3
+};
+
+struct xtf_expr {
+    struct pred preds[MAX_PREDS];
+    int n_preds;
+    int16_t prog[2 * MAX_PREDS];
+    int prog_len;
+    // Dense ids the expression is bound to
+    int n_events;
+    uint8_t words_used;
+};
+
+//
+// Compiler
+//
+
+struct parser {
+    const char *text,
+               *pos;
+    struct xtf_expr *expr;
+    int depth,
+        max_depth;
+    char *err;
+    size_t err_len;
+    bool failed;
+};
+
+static void error(struct parser *p, const char *format, ...)
+{
+    if (p->failed)
+        return;
+
+    p->failed = true;
+    int len = snprintf(p->err, p->err_len, "at %ld: ", (long)(p->pos - p->text));
+    if (len < 0 || (size_t)len >= p->err_len)
+        return;
+
+    va_list args;
+    va_start(args, format);
+    vsnprintf(p->err + len, p->err_len - len, format, args);
+    va_end(args);
+}
+
+static void skip_spaces(struct parser *p)
+{
+    while (isspace((unsigned char)*p->pos))
+        p->pos++;
+}
+
+/**
+ * Consumes "tok" if it is the next token. Keywords must
+ * not be followed by an identifier character.
+ */
+static bool accept(struct parser *p, const char *tok)
+{
+    skip_spaces(p);
+    size_t len = strlen(tok);
+    if (strncmp(p->pos, tok, len))
+        return false;
+    if (isalpha((unsigned char)*tok) &&
+            (isalnum((unsigned char)p->pos[len]) || p->pos[len] == '_'))
+        return false;
+
+    p->pos += len;
+    return true;
+}
+
+/**
+ * Reads an identifier or a quoted string.
+ */
+static bool read_word(struct parser *p, char *word)
+{
+    skip_spaces(p);
+    size_t len = 0;
+
+    if (*p->pos == '"') {
+        const char *end = strchr(p->pos + 1, '"');
+        if (!end || end - p->pos - 1 >= TOKEN_MAXLEN) {
+            error(p, "bad string");
+            return false;
+        }
+        len = end - p->pos - 1;
+        memcpy(word, p->pos + 1, len);
+        p->pos = end + 1;
+    } else {
+        while ((isalnum((unsigned char)p->pos[len]) || strchr("_:*", p->pos[len])) &&
+                    p->pos[len] && len < TOKEN_MAXLEN - 1)
+            len++;
+        if (!len) {
+            error(p, "expected a name");
+            return false;
+        }
+        memcpy(word, p->pos, len);
+        p->pos += len;
+    }
+
+    word[len] = '\0';
+    return true;
+}
+
+static bool read_number(struct parser *p, uint64_t *value, bool *negative)
+{
+    skip_spaces(p);
+    *negative = (*p->pos == '-');
+
+    char *end;
+    errno = 0;
+    *value = *negative ? (uint64_t)strtoll(p->pos, &end, 0) : strtoull(p->pos, &end, 0);
+    if (end == p->pos || errno) {
+        error(p, "expected a number");
+        return false;
+    }
+
+    p->pos = end;
+    return true;
+}
+
+static bool read_op(struct parser *p, enum op *op)
+{
+    static const struct {
+        const char *tok;
+        enum op op;
+    } ops[] = {
+        { "==", OP_EQ }, { "!=", OP_NE }, { "<=", OP_LE }, { ">=", OP_GE },
+        { "<", OP_LT }, { ">", OP_GT }, { "&", OP_BITS }
+    };
+
+    skip_spaces(p);
+    if (!strncmp(p->pos, "&&", 2))
+        goto fail;
+
+    for (size_t i = 0; i < sizeof(ops) / sizeof(*ops); ++i)
+        if (accept(p, ops[i].tok)) {
+            *op = ops[i].op;
+            return true;
+        }
+
+fail:
+    error(p, "expected a comparison");
+    return false;
+}
+
+static void emit(struct parser *p, int16_t ins)
+{
+    struct xtf_expr *e = p->expr;
+    if (e->prog_len == sizeof(e->prog) / sizeof(*e->prog)) {
+        error(p, "expression too long");
+        return;
+    }
+
+    e->prog[e->prog_len++] = ins;
+    // Predicates push a mask, AND/OR pop one
+    if (ins >= 0 && ++p->depth > p->max_depth)
+        p->max_depth = p->depth;
+    else if (ins == INS_AND || ins == INS_OR)
+        p->depth--;
+}
+
+/**
+ * Binds a field name to the dense event ids defining it.
+ */
+static int bind_field(struct parser *p, struct pred *pred, const char *name)
+{
+    pred->access = calloc(p->expr->n_events ? p->expr->n_events : 1, sizeof(*pred->access));
+    if (!pred->access)
+        return -ENOMEM;
+
+    bool known = false;
+    for (size_t f = 0; f < N_FIELDS; ++f) {
+        if (strcmp(fields[f].name, name))
+            continue;
+
+        known = true;
+        int dense_id = evids_find(fields[f].event_id);
+        if (dense_id < 0 || dense_id >= p->expr->n_events)
+            continue;
+
+        pred->access[dense_id] = (struct access) {
+            .defined = true,
+            .is_signed = fields[f].is_signed,
+            .lo = fields[f].lo,
+            .hi = fields[f].hi,
+            .shift = fields[f].shift,
+            .bits = fields[f].bits
+        };
+        p->expr->words_used |= 1 << fields[f].lo;
+        if (fields[f].hi != NO_WORD)
+            p->expr->words_used |= 1 << fields[f].hi;
+        if (fields[f].is_signed)
+            pred->is_signed = true;
+    }
+
+    if (!known)
+        error(p, "unknown field \"%s\"", name);
+    return 0;
+}
+
+static void parse_or(struct parser *p);
+
+static void parse_predicate(struct parser *p)
+{
+    struct xtf_expr *e = p->expr;
+    if (e->n_preds == MAX_PREDS) {
+        error(p, "too many predicates");
+        return;
+    }
+
+    char name[TOKEN_MAXLEN];
+    int index = e->n_preds++;
+    struct pred *pred = &e->preds[index];
+    if (!read_word(p, name) || !read_op(p, &pred->op))
+        return;
+
+    for (int c = 0; c < COL_WORD; ++c)
+        if (!strcmp(name, column_names[c]))
+            pred->column = c;
+    if (name[0] == 'w' && name[1] >= '0' && name[1] < '0' + XTF_WORDS && !name[2]) {
+        pred->column = COL_WORD + name[1] - '0';
+        e->words_used |= 1 << (name[1] - '0');
+    } else if (pred->column == COL_EVENT && strcmp(name, "event")) {
+        pred->column = COL_FIELD;
+    }
+
+    if (pred->column == COL_EVENT) {
+        char pattern[TOKEN_MAXLEN];
+        if (pred->op != OP_EQ && pred->op != OP_NE) {
+            error(p, "events can only be compared with == or !=");
+            return;
+        }
+        if (!read_word(p, pattern))
+            return;
+
+        if (!(pred->events = calloc(e->n_events ? e->n_events : 1, 1))) {
+            error(p, "out of memory");
+            return;
+        }
+        for (int i = 0; i < e->n_events; ++i)
+            pred->events[i] = evids_match_name(i, pattern);
+    } else {
+        bool negative;
+        if (!read_number(p, &pred->value, &negative))
+            return;
+
+        pred->is_signed = negative || pred->column == COL_TS;
+        if (pred->column == COL_FIELD && bind_field(p, pred, name))
+            error(p, "out of memory");
+    }
+
+    emit(p, index);
+}
+
+static void parse_unary(struct parser *p)
+{
+    if (accept(p, "!") || accept(p, "not")) {
+        parse_unary(p);
+        emit(p, INS_NOT);
+    } else if (accept(p, "(")) {
+        parse_or(p);
+        if (!accept(p, ")"))
+            error(p, "expected ')'");
+    } else {
+        parse_predicate(p);
+    }
+}
+
+static void parse_and(struct parser *p)
+{
+    parse_unary(p);
+    while (!p->failed && (accept(p, "&&") || accept(p, "and"))) {
+        parse_unary(p);
+        emit(p, INS_AND);
+    }
+}
+
+static void parse_or(struct parser *p)
+{
+    parse_and(p);
+    while (!p->failed && (accept(p, "||") || accept(p, "or"))) {
+        parse_and(p);
+        emit(p, INS_OR);
+    }
+}
+
+/**
+ * Compiles a filter expression against the events loaded so far.
+ * Returns NULL on error, with a message in "err".
+ */
+struct xtf_expr *xtf_compile(const char *text, char *err, size_t err_len)
+{
+    struct xtf_expr *e = calloc(1, sizeof(*e));
+    if (!e) {
+        snprintf(err, err_len, "out of memory");
+        return NULL;
+    }
+
+    e->n_events = evids_count();
+    struct parser p = {
+        .text = text,
+        .pos = text,
+        .expr = e,
+        .err = err,
+        .err_len = err_len
+    };
+
+    parse_or(&p);
+    skip_spaces(&p);
+    if (*p.pos)
+        error(&p, "unexpected \"%s\"", p.pos);
+    if (p.max_depth > MAX_DEPTH)
+        error(&p, "expression too deep");
+
+    if (p.failed) {
+        xtf_free(e);
+        return NULL;
+    }
+
+    return e;
+}
+
+/**
+ * Returns the mask of the extra words read by the expression.
+ */
+uint8_t xtf_words_used(const struct xtf_expr *e)
+{
+    return e->words_used;
+}
+
+//
+// Evaluator
+//
+
+#define COMPARE(_v, _c, _op) \
+    ((_op) == OP_EQ ? (_v) == (_c) : \
+     (_op) == OP_NE ? (_v) != (_c) : \
+     (_op) == OP_LT ? (_v) < (_c) : \
+     (_op) == OP_LE ? (_v) <= (_c) : \
+     (_op) == OP_GT ? (_v) > (_c) : \
+     (_op) == OP_GE ? (_v) >= (_c) : \
+                      ((_v) & (_c)) != 0)
+
+// One loop per operator, so that each one is vectorised
+#define COMPARE_COLUMN(_out, _col, _n, _type, _c, _op) \
+    do { \
+        const _type _cv = (_type)(_c); \
+        switch (_op) { \
+            case OP_EQ: for (uint32_t _i = 0; _i < (_n); ++_i) (_out)[_i] = (_type)(_col)[_i] == _cv; break; \
+            case OP_NE: for (uint32_t _i = 0; _i < (_n); ++_i) (_out)[_i] = (_type)(_col)[_i] != _cv; break; \
+            case OP_LT: for (uint32_t _i = 0; _i < (_n); ++_i) (_out)[_i] = (_type)(_col)[_i] < _cv; break; \
+            case OP_LE: for (uint32_t _i = 0; _i < (_n); ++_i) (_out)[_i] = (_type)(_col)[_i] <= _cv; break; \
+            case OP_GT: for (uint32_t _i = 0; _i < (_n); ++_i) (_out)[_i] = (_type)(_col)[_i] > _cv; break; \
+            case OP_GE: for (uint32_t _i = 0; _i < (_n); ++_i) (_out)[_i] = (_type)(_col)[_i] >= _cv; break; \
+            case OP_BITS: for (uint32_t _i = 0; _i < (_n); ++_i) (_out)[_i] = ((_type)(_col)[_i] & _cv) != 0; break; \
+        } \
+    } while (0)
+
+static void eval_column(const struct pred *pred, const void *col, int width,
+                            uint32_t n, uint8_t *out)
+{
+    switch (width) {
+        case 16:
+            if (pred->is_signed)
+                COMPARE_COLUMN(out, (const uint16_t *)col, n, int64_t, pred->value, pred->op);
+            else
+                COMPARE_COLUMN(out, (const uint16_t *)col, n, uint64_t, pred->value, pred->op);
+            break;
+        case 32:
+            if (pred->is_signed)
+                COMPARE_COLUMN(out, (const int32_t *)col, n, int64_t, pred->value, pred->op);
+            else
+                COMPARE_COLUMN(out, (const uint32_t *)col, n, uint64_t, pred->value, pred->op);
+            break;
+        default:
+            COMPARE_COLUMN(out, (const int64_t *)col, n, int64_t, pred->value, pred->op);
+            break;
+    }
+}
+
+static void eval_field(const struct xtf_expr *e, const struct pred *pred,
+                        const struct xtf_batch *b, uint8_t *out)
+{
+    for (uint32_t i = 0; i < b->size; ++i) {
+        const struct access *a = (b->event[i] < e->n_events) ?
+                                    &pred->access[b->event[i]] : NULL;
+        if (!a || !a->defined) {
+            out[i] = 0;
+            continue;
+        }
+
+        uint64_t v = b->words[a->lo][i];
+        if (a->hi != NO_WORD)
+            v |= (uint64_t)b->words[a->hi][i] << 32;
+        v >>= a->shift;
+        if (a->bits < 64)
+            v &= (1ULL << a->bits) - 1;
+
+        if (a->is_signed) {
+            int64_t sv = (a->bits == 32) ? (int32_t)v : (int64_t)v;
+            out[i] = COMPARE(sv, (int64_t)pred->value, pred->op);
+        } else {
+            out[i] = COMPARE(v, pred->value, pred->op);
+        }
+    }
+}
+
+static void eval_pred(const struct xtf_expr *e, const struct pred *pred,
+                        const struct xtf_batch *b, uint8_t *out)
+{
+    switch (pred->column) {
+        case COL_EVENT:
+            for (uint32_t i = 0; i < b->size; ++i) {
+                uint8_t m = (b->event[i] < e->n_events) && pred->events[b->event[i]];
+                out[i] = (pred->op == OP_EQ) ? m : !m;
+            }
+            break;
+        case COL_ID:
+            eval_column(pred, b->id, 32, b->size, out);
+            break;
+        case COL_DOM:
+            eval_column(pred, b->dom, 16, b->size, out);
+            break;
+        case COL_VCPU:
+            eval_column(pred, b->vcpu, 16, b->size, out);
+            break;
+        case COL_CPU:
+            eval_column(pred, b->cpu, 16, b->size, out);
+            break;
+        case COL_TS:
+            eval_column(pred, b->ts, 64, b->size, out);
+            break;
+        case COL_FIELD:
+            eval_field(e, pred, b, out);
+            break;
+        default:
+            eval_column(pred, b->words[pred->column - COL_WORD], 32, b->size, out);
+            break;
+    }
+}
+
+/**
+ * Evaluates the expression over a batch: "match[i]" is set to 1
+ * if the i-th record matches, to 0 otherwise.
+ */
+void xtf_eval(const struct xtf_expr *e, const struct xtf_batch *b, uint8_t *match)
+{
+    uint8_t stack[MAX_DEPTH][XTF_BATCH];
+    int top = -1;
+
+    for (int k = 0; k < e->prog_len; ++k) {
+        int16_t ins = e->prog[k];
+        if (ins >= 0) {
+            eval_pred(e, &e->preds[ins], b, stack[++top]);
+            continue;
+        }
+
+        uint8_t *x = stack[top];
+        if (ins == INS_NOT) {
+            for (uint32_t i = 0; i < b->size; ++i)
+                x[i] = !x[i];
+            continue;
+        }
+
+        uint8_t *y = stack[--top];
+        if (ins == INS_AND)
+            for (uint32_t i = 0; i < b->size; ++i)
+                y[i] &= x[i];
+        else
+            for (uint32_t i = 0; i < b->size; ++i)
+                y[i] |= x[i];
+    }
+
+    memcpy(match, stack[0], b->size);
+}
+
+void xtf_free(struct xtf_expr *e)
+{
+    if (!e)
+        return;
+
+    for (int i = 0; i < e->n_preds; ++i) {
+        free(e->preds[i].events);
+        free(e->preds[i].access);
+    }
+    free(e);
+}
@@ -0,0 +1,485 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef _GNU_SOURCE
+/** Use GNU C Library. */
+#define _GNU_SOURCE
+#endif // _GNU_SOURCE
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// KernelShark.v2-Beta
+#include "libkshark.h"
+
+#include "index.h"
+
+#define SLOTS_INIT_SIZE 64
+#define ENTRIES_INIT_SIZE 4096
+
+// Bitmap of the entries with a given id
+struct id_bitmap {
+    int id;
+    bool used;
+    struct xbm bm;
+};
+
+// Open-addressing table of bitmaps, by id
+struct id_bitmaps {
+    struct id_bitmap *slots;
+    size_t size,
+           capacity;
+    // Last lookup
+    struct id_bitmap *last;
+};
+
+static struct {
+    int stream_id;
+    // Record of the entry at a position
+    const xt_event *(*get_event)(size_t pos, xt_event *buf);
+    struct id_bitmaps kinds[XTI_N_KINDS];
+    // Entry at each position, from "first" (0 but for
+    // "xti_init_at") to "n_entries"
+    struct kshark_entry **entries;
+    uint32_t first,
+             n_entries;
+    size_t capacity;
+    // Entries currently hidden by the fast path, with the masks
+    // it cleared (valid while "applied" is set)
+    struct xbm hidden_events,
+               hidden_others;
+    uint8_t event_mask,
+            filter_mask;
+    bool applied;
+    // Entries not matching the field filter
+    struct xbm field_hidden;
+} X;
+
+static size_t slot_of(const struct id_bitmaps *t, int id)
+{
+    size_t mask = t->capacity - 1,
+           slot = ((uint32_t)id * 0x9e3779b1u) >> 5 & mask;
+    while (t->slots[slot].used && t->slots[slot].id != id)
+        slot = (slot + 1) & mask;
+    return slot;
+}
+
+static int grow_slots(struct id_bitmaps *t)
+{
+    struct id_bitmaps tmp = {
+        .capacity = t->capacity ? t->capacity * 2 : SLOTS_INIT_SIZE
+    };
+    if (!(tmp.slots = calloc(tmp.capacity, sizeof(*tmp.slots))))
+        return -ENOMEM;
+
+    for (size_t i = 0; i < t->capacity; ++i)
+        if (t->slots[i].used)
+            tmp.slots[slot_of(&tmp, t->slots[i].id)] = t->slots[i];
+
+    tmp.size = t->size;
+    free(t->slots);
+    *t = tmp;
+    return 0;
+}
+
+static struct xbm *get_bitmap(struct id_bitmaps *t, int id)
+{
+    if (t->last && t->last->id == id)
+        return &t->last->bm;
+
+    if (2 * (t->size + 1) > t->capacity && grow_slots(t))
+        return NULL;
+
+    struct id_bitmap *s = &t->slots[slot_of(t, id)];
+    if (!s->used) {
+        s->used = true;
+        s->id = id;
+        t->size++;
+    }
+
+    t->last = s;
+    return &s->bm;
+}
+
+// Marks the entries as left by the last application
+static void set_applied(uint8_t event_mask, uint8_t filter_mask)
+{
+    X.event_mask = event_mask;
+    X.filter_mask = filter_mask;
+    X.applied = true;
+    if (X.n_entries > X.first && X.entries[0])
+        X.entries[0]->visible &= ~XTI_APPLIED_MASK;
+}
+
+/**
+ * "get_event" returns the record of the entry at a position,
+ * it is used by the field filters.
+ */
+int xti_init(int stream_id, const xt_event *(*get_event)(size_t pos, xt_event *buf))
+{
+    return xti_init_at(stream_id, get_event, 0);
+}
+
+/**
+ * Same as "xti_init", with the entries starting at position "first"
+ * (there are none before). Lets the checks index a few entries at the
+ * end of the positions.
+ */
+int xti_init_at(int stream_id, const xt_event *(*get_event)(size_t pos, xt_event *buf),
+                    uint32_t first)
+{
+    xti_free();
+    X.stream_id = stream_id;
+    X.get_event = get_event;
+    X.first = X.n_entries = first;
+    return 0;
+}
+
+/**
+ * Indexes the entry at "pos" (positions must be increasing)
+ * by event, task, domain and pCPU.
+ */
+int xti_feed(uint32_t pos, struct kshark_entry *entry, uint16_t dom)
+{
+    size_t i = pos - X.first;
+    if (i >= X.capacity) {
+        size_t new_cap = X.capacity ? X.capacity * 2 : ENTRIES_INIT_SIZE;
+        while (new_cap <= i)
+            new_cap *= 2;
+
+        struct kshark_entry **tmp = realloc(X.entries, new_cap * sizeof(*tmp));
+        if (!tmp)
+            return -ENOMEM;
+
+        memset(tmp + X.capacity, 0, (new_cap - X.capacity) * sizeof(*tmp));
+        X.entries = tmp;
+        X.capacity = new_cap;
+    }
+
+    X.entries[i] = entry;
+    if (!entry)
+        return 0;
+
+    const int ids[XTI_N_KINDS] = {
+        [XTI_EVENT] = entry->event_id,
+        [XTI_TASK] = entry->pid,
+        [XTI_DOM] = dom,
+        [XTI_CPU] = entry->cpu
+    };
+
+    for (int k = 0; k < XTI_N_KINDS; ++k) {
+        struct xbm *bm = get_bitmap(&X.kinds[k], ids[k]);
+        if (!bm || xbm_append(bm, pos))
+            return -ENOMEM;
+    }
+
+    return 0;
+}
+
+void xti_finish(uint32_t n_entries)
+{
+    X.n_entries = n_entries;
+    for (int k = 0; k < XTI_N_KINDS; ++k)
+        X.kinds[k].last = NULL;
+
+    // All visible
+    set_applied(0, 0);
+}
+
+/**
+ * Returns the bitmap of the entries with a given event (dense id),
+ * task, domain or pCPU, NULL if there are none.
+ */
+const struct xbm *xti_bitmap(enum xti_kind kind, int id)
+{
+    const struct id_bitmaps *t = &X.kinds[kind];
+    if (!t->capacity)
+        return NULL;
+
+    const struct id_bitmap *s = &t->slots[slot_of(t, id)];
+    return s->used ? &s->bm : NULL;
+}
+
+/**
+ * Returns the entry at a position (NULL if missing).
+ */
+struct kshark_entry *xti_entry(uint32_t pos)
+{
+    return (pos >= X.first && pos < X.n_entries) ? X.entries[pos - X.first] : NULL;
+}
+
+/**
+ * Stores in "out" the union of the bitmaps of a list of ids.
+ */
+static int union_of(enum xti_kind kind, const int *ids, int n_ids, struct xbm *out)
+{
+    xbm_free(out);
+    for (int i = 0; i < n_ids; ++i) {
+        const struct xbm *bm = xti_bitmap(kind, ids[i]);
+        if (bm && xbm_or(out, bm, out))
+            return -ENOMEM;
+    }
+    return 0;
+}
+
+/**
+ * Adds to "hidden" the entries hidden by a show/hide filter pair.
+ */
+static int add_hidden(enum xti_kind kind, struct kshark_hash_id *show,
+                        struct kshark_hash_id *hide, const struct xbm *all,
+                        struct xbm *hidden)
+{
+    struct xbm ids_bm = { 0 };
+    int ret = 0;
+
+    if (kshark_this_filter_is_set(show)) {
+        int *ids = kshark_hash_ids(show);
+        ret = !ids || union_of(kind, ids, show->count, &ids_bm) ||
+                xbm_andnot(all, &ids_bm, &ids_bm) ||
+                xbm_or(hidden, &ids_bm, hidden);
+        free(ids);
+    }
+
+    if (!ret && kshark_this_filter_is_set(hide)) {
+        int *ids = kshark_hash_ids(hide);
+        ret = !ids || union_of(kind, ids, hide->count, &ids_bm) ||
+                xbm_or(hidden, &ids_bm, hidden);
+        free(ids);
+    }
+
+    xbm_free(&ids_bm);
+    return ret ? -ENOMEM : 0;
+}
+
+struct visibility_update {
+    uint8_t clear;
+    uint16_t set_visible;
+};
+
+static void update_visible(uint32_t pos, void *data)
+{
+    const struct visibility_update *u = data;
+    struct kshark_entry *entry = X.entries[pos - X.first];
+    if (!entry)
+        return;
+
+    entry->visible |= u->set_visible;
+    entry->visible &= ~u->clear;
+}
+
+/**
+ * Tells if the entries may not be as the last application left them:
+ * KernelShark sets all the bits of "visible" when it clears or applies
+ * the filters itself, while the fast path leaves XTI_APPLIED_MASK
+ * cleared on the first entry.
+ */
+static bool is_stale()
+{
+    return !X.applied ||
+            (X.n_entries > X.first && X.entries[0] &&
+                (X.entries[0]->visible & XTI_APPLIED_MASK));
+}
+
+/**
+ * Hides the entries in "hidden_events" (clearing "event_mask")
+ * and in "hidden_others" (clearing "filter_mask"), visiting only
+ * the entries whose visibility differs from the last application
+ * (all of them if the masks differ or the entries may have been
+ * changed by KernelShark since then).
+ * Returns the number of entries visited.
+ */
+ssize_t xti_apply_visibility(const struct xbm *hidden_events,
+                                const struct xbm *hidden_others,
+                                uint8_t event_mask, uint8_t filter_mask)
+{
+    struct xbm changed = { 0 },
+               tmp = { 0 };
+    ssize_t ret = -ENOMEM;
+
+    if (is_stale()) {
+        if (xbm_fill(&changed, X.first, X.n_entries))
+            goto out;
+    } else if (X.event_mask != event_mask || X.filter_mask != filter_mask) {
+        // All the entries hidden before or now
+        if (xbm_or(&X.hidden_events, hidden_events, &changed) ||
+                xbm_or(&X.hidden_others, hidden_others, &tmp) ||
+                xbm_or(&changed, &tmp, &changed))
+            goto out;
+    } else if (xbm_xor(&X.hidden_events, hidden_events, &changed) ||
+                xbm_xor(&X.hidden_others, hidden_others, &tmp) ||
+                xbm_or(&changed, &tmp, &changed)) {
+        goto out;
+    }
+
+    // Reset the changed entries, then hide them again
+    struct visibility_update u = { .set_visible = 0xff };
+    xbm_foreach(&changed, update_visible, &u);
+
+    u = (struct visibility_update) { .clear = event_mask };
+    if (xbm_and(&changed, hidden_events, &tmp))
+        goto out;
+    xbm_foreach(&tmp, update_visible, &u);
+
+    u = (struct visibility_update) { .clear = filter_mask };
+    if (xbm_and(&changed, hidden_others, &tmp))
+        goto out;
+    xbm_foreach(&tmp, update_visible, &u);
+
+    // Remember the applied state
+    X.applied = false;
+    if (xbm_copy(&X.hidden_events, hidden_events) ||
+            xbm_copy(&X.hidden_others, hidden_others))
+        goto out;
+
+    set_applied(event_mask, filter_mask);
+    ret = xbm_cardinality(&changed);
+
+out:
+    xbm_free(&changed);
+    xbm_free(&tmp);
+    return ret;
+}
+
+/**
+ * Evaluates a field filter over all the entries (NULL removes it).
+ * The entries not matching are hidden by the next "xti_apply_filters".
+ * Returns the number of matching entries.
+ */
+ssize_t xti_set_field_filter(const struct xtf_expr *expr)
+{
+    xbm_free(&X.field_hidden);
+    if (!expr)
+        return 0;
+    if (!X.get_event)
+        return -EFAULT;
+
+    struct xtf_batch *b = malloc(sizeof(*b));
+    if (!b)
+        return -ENOMEM;
+
+    uint32_t positions[XTF_BATCH];
+    uint8_t match[XTF_BATCH],
+            words = xtf_words_used(expr);
+    ssize_t matching = 0;
+
+    // Positions in 64 bits, a batch can end at 2^32
+    for (uint64_t start = X.first; start < X.n_entries; start += XTF_BATCH) {
+        uint64_t end = (X.n_entries - start > XTF_BATCH) ? start + XTF_BATCH : X.n_entries;
+
+        // Gather the columns of the batch
+        b->size = 0;
+        for (uint64_t pos = start; pos < end; ++pos) {
+            const struct kshark_entry *entry = X.entries[pos - X.first];
+            xt_event buf;
+            const xt_event *event = entry ? X.get_event(pos, &buf) : NULL;
+            if (!event)
+                continue;
+
+            uint32_t i = b->size++;
+            positions[i] = pos;
+            b->event[i] = entry->event_id;
+            b->id[i] = (event->rec).id;
+            b->dom[i] = (event->dom).id;
+            b->vcpu[i] = (event->dom).vcpu;
+            b->cpu[i] = entry->cpu;
+            b->ts[i] = entry->ts;
+            for (int w = 0; w < XTF_WORDS; ++w)
+                if (words & (1 << w))
+                    b->words[w][i] = (event->rec).extra[w];
+        }
+
+        xtf_eval(expr, b, match);
+        for (uint32_t i = 0; i < b->size; ++i) {
+            if (match[i])
+                matching++;
+            else if (xbm_append(&X.field_hidden, positions[i]))
+                matching = -ENOMEM;
+        }
+
+        if (matching < 0)
+            break;
+    }
+
+    free(b);
+    return matching;
+}
+
+/**
+ * Applies the event, task and CPU filters of the stream (and the
+ * field filter, if set) with bitmap operations instead of a matching
+ * function per entry.
+ * Returns the number of entries whose visibility was updated.
+ */
+ssize_t xti_apply_filters(struct kshark_context *kshark_ctx)
+{
+    struct kshark_data_stream *stream = kshark_get_data_stream(kshark_ctx, X.stream_id);
+    if (!stream)
+        return -EFAULT;
+
+    struct xbm all = { 0 },
+               hidden_events = { 0 },
+               hidden_others = { 0 };
+    ssize_t ret = -ENOMEM;
+
+    if (xbm_fill(&all, X.first, X.n_entries) ||
+            add_hidden(XTI_EVENT, stream->show_event_filter,
+                        stream->hide_event_filter, &all, &hidden_events) ||
+            add_hidden(XTI_TASK, stream->show_task_filter,
+                        stream->hide_task_filter, &all, &hidden_others) ||
+            add_hidden(XTI_CPU, stream->show_cpu_filter,
+                        stream->hide_cpu_filter, &all, &hidden_others) ||
+            xbm_or(&hidden_others, &X.field_hidden, &hidden_others))
+        goto out;
+
+    // As KernelShark: the entries hidden by the event filters keep their
+    // graph flag and always lose the event one
+    uint8_t event_mask = (kshark_ctx->filter_mask & ~KS_GRAPH_VIEW_FILTER_MASK) |
+                            KS_EVENT_VIEW_FILTER_MASK;
+    ret = xti_apply_visibility(&hidden_events, &hidden_others,
+                                event_mask, kshark_ctx->filter_mask);
+    if (ret >= 0)
+        stream->filter_is_applied = xbm_cardinality(&hidden_events) ||
+                                        xbm_cardinality(&hidden_others);
+
+out:
+    xbm_free(&all);
+    xbm_free(&hidden_events);
+    xbm_free(&hidden_others);
+    return ret;
+}
+
+void xti_free()
+{
+    for (int k = 0; k < XTI_N_KINDS; ++k) {
+        struct id_bitmaps *t = &X.kinds[k];
+        for (size_t i = 0; i < t->capacity; ++i)
+            xbm_free(&t->slots[i].bm);
+        free(t->slots);
+    }
+
+    free(X.entries);
+    xbm_free(&X.hidden_events);
+    xbm_free(&X.hidden_others);
+    xbm_free(&X.field_hidden);
+    memset(&X, 0, sizeof(X));
+}
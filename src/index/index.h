@@ -0,0 +1,203 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef __KSXT_INDEX
+#define __KSXT_INDEX
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// XenTrace-Parser
+#include "xentrace-event.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct kshark_context;
+struct kshark_data_stream;
+struct kshark_entry;
+
+//
+// Compressed bitmaps | bitmap.c
+//
+
+// Containers holding more values are stored as bitmaps
+#define XBM_ARRAY_MAX 4096
+#define XBM_WORDS (65536 / 64)
+
+// Values sharing the high 16 bits ("key")
+struct xbm_container {
+    uint16_t key;
+    bool is_bitmap;
+    uint32_t card;
+    union {
+        uint16_t *array;
+        uint64_t *words;
+    };
+    uint32_t capacity;
+};
+
+// Roaring-style bitmap of 32-bit values (entry positions)
+struct xbm {
+    struct xbm_container *containers;
+    size_t size,
+           capacity;
+};
+
+int xbm_append(struct xbm *bm, uint32_t val);
+int xbm_fill(struct xbm *bm, uint32_t from, uint64_t to);
+uint64_t xbm_cardinality(const struct xbm *bm);
+int xbm_or(const struct xbm *a, const struct xbm *b, struct xbm *out);
+int xbm_and(const struct xbm *a, const struct xbm *b, struct xbm *out);
+int xbm_andnot(const struct xbm *a, const struct xbm *b, struct xbm *out);
+int xbm_xor(const struct xbm *a, const struct xbm *b, struct xbm *out);
+int xbm_copy(struct xbm *dst, const struct xbm *src);
+void xbm_foreach(const struct xbm *bm, void (*func)(uint32_t, void *), void *data);
+void xbm_move(struct xbm *dst, struct xbm *src);
+void xbm_free(struct xbm *bm);
+
+//
+// Dense event ids | evids.c
+//
+
+int evids_get(uint32_t event_id);
+int evids_find(uint32_t event_id);
+uint32_t evids_full(int dense_id);
+bool evids_match_name(int dense_id, const char *pattern);
+int evids_count();
+void evids_free();
+
+//
+// Task names | tasks.c
+//
+
+int tasks_init(const char *domain_names);
+int tasks_add(xt_domain dom);
+const char *tasks_name(xt_domain dom);
+size_t tasks_count();
+void tasks_free();
+
+//
+// Entry indexes and filter fast path | filter.c
+//
+
+// Positions are 32 bits wide (as the bitmap values)
+#define XTI_MAX_ENTRIES UINT32_MAX
+// Bit of "visible" (reserved by KernelShark, unused) cleared on the
+// first entry by the filter fast path, set again by KernelShark
+#define XTI_APPLIED_MASK (1 << 6)
+
+enum xti_kind {
+    XTI_EVENT,
+    XTI_TASK,
+    XTI_DOM,
+    XTI_CPU,
+    XTI_N_KINDS
+};
+
+int xti_init(int stream_id, const xt_event *(*get_event)(size_t pos, xt_event *buf));
+int xti_init_at(int stream_id, const xt_event *(*get_event)(size_t pos, xt_event *buf),
+                    uint32_t first);
+int xti_feed(uint32_t pos, struct kshark_entry *entry, uint16_t dom);
+void xti_finish(uint32_t n_entries);
+const struct xbm *xti_bitmap(enum xti_kind kind, int id);
+ssize_t xti_apply_visibility(const struct xbm *hidden_events,
+                                const struct xbm *hidden_others,
+                                uint8_t event_mask, uint8_t filter_mask);
+ssize_t xti_apply_filters(struct kshark_context *kshark_ctx);
+struct kshark_entry *xti_entry(uint32_t pos);
+
+struct xtf_expr;
+ssize_t xti_set_field_filter(const struct xtf_expr *expr);
+void xti_free();
+
+//
+// Chunk zone maps | zonemap.c
+//
+
+// Entries per chunk
+#define XZM_CHUNK 4096
+#define XZM_BLOOM_BITS 256
+#define XZM_DOM_BITS 128
+#define XZM_MAX_EVENTS 8
+
+// Summary of the entries of a chunk
+struct xzm_zone {
+    int64_t min_ts,
+            max_ts;
+    // Event classes present (one bit each)
+    uint16_t classes;
+    // Bloom filter of the dense event ids
+    uint64_t events[XZM_BLOOM_BITS / 64];
+    // Domains present (modulo XZM_DOM_BITS)
+    uint64_t doms[XZM_DOM_BITS / 64];
+};
+
+// Entries of any of "events" (if any), of "classes"
+// (if not 0) and of domain "dom" (if not negative)
+struct xzm_query {
+    uint16_t events[XZM_MAX_EVENTS];
+    int n_events;
+    uint16_t classes;
+    int dom;
+};
+
+int xzm_init();
+int xzm_init_at(uint32_t first);
+int xzm_feed(uint32_t pos, const struct kshark_entry *entry, uint32_t event_id, uint16_t dom);
+int xzm_finish();
+ssize_t xzm_find(const struct xzm_query *q, ssize_t from, bool forward);
+ssize_t xzm_find_ts(int64_t ts);
+void xzm_free();
+
+//
+// Field-predicate filters | expr.c
+//
+
+#define XTF_BATCH 256
+#define XTF_WORDS 7
+
+// Columns of a batch of records
+struct xtf_batch {
+    uint32_t size;
+    // Dense and full event ids
+    uint16_t event[XTF_BATCH];
+    uint32_t id[XTF_BATCH];
+    uint16_t dom[XTF_BATCH],
+             vcpu[XTF_BATCH],
+             cpu[XTF_BATCH];
+    int64_t ts[XTF_BATCH];
+    // Only the words read by the expression are filled
+    uint32_t words[XTF_WORDS][XTF_BATCH];
+};
+
+struct xtf_expr *xtf_compile(const char *text, char *err, size_t err_len);
+uint8_t xtf_words_used(const struct xtf_expr *e);
+void xtf_eval(const struct xtf_expr *e, const struct xtf_batch *b, uint8_t *match);
+void xtf_free(struct xtf_expr *e);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,279 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef _GNU_SOURCE
+/** Use GNU C Library. */
+#define _GNU_SOURCE
+#endif // _GNU_SOURCE
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "index.h"
+
+#define TASKS_INIT_SIZE 64
+#define DOMAINS_INIT_SIZE 16
+
+// Name of a domain, from the sidecar file
+struct domain_name {
+    uint16_t id;
+    char *name;
+};
+
+/*
+ * Names of the tasks (domain/vCPU pairs), rendered once when a pair
+ * first shows up while loading, so that "get_task" only copies them.
+ */
+static struct {
+    // Open-addressing table: domain/vCPU -> name (NULL if empty)
+    uint32_t *keys;
+    char **names;
+    size_t size,
+           table_size;
+    struct domain_name *domains;
+    size_t n_domains,
+           domains_cap;
+    // Last pair added
+    uint32_t last_dom;
+    bool has_last;
+} T;
+
+/**
+ * Returns the key of a domain/vCPU pair (the vCPU
+ * of the default domain is not known).
+ */
+static uint32_t key_of(xt_domain dom)
+{
+    if (dom.id == XEN_DOM_DFLT)
+        dom.vcpu = 0;
+    return dom.u32;
+}
+
+static size_t hash_dom(uint32_t dom, size_t table_size)
+{
+    return (dom * 0x9e3779b1u) >> 7 & (table_size - 1);
+}
+
+static size_t find_slot(uint32_t dom)
+{
+    size_t slot = hash_dom(dom, T.table_size);
+    while (T.names[slot] && T.keys[slot] != dom)
+        slot = (slot + 1) & (T.table_size - 1);
+    return slot;
+}
+
+static int grow_table()
+{
+    size_t size = T.table_size ? T.table_size * 2 : TASKS_INIT_SIZE;
+    uint32_t *keys = calloc(size, sizeof(*keys)),
+             *old_keys = T.keys;
+    char **names = calloc(size, sizeof(*names)),
+         **old_names = T.names;
+    if (!keys || !names) {
+        free(keys);
+        free(names);
+        return -ENOMEM;
+    }
+
+    size_t old_size = T.table_size;
+    T.keys = keys;
+    T.names = names;
+    T.table_size = size;
+
+    for (size_t i = 0; i < old_size; ++i) {
+        if (!old_names[i])
+            continue;
+        size_t slot = find_slot(old_keys[i]);
+        T.keys[slot] = old_keys[i];
+        T.names[slot] = old_names[i];
+    }
+
+    free(old_keys);
+    free(old_names);
+    return 0;
+}
+
+static bool is_number(const char *str)
+{
+    if (!*str)
+        return false;
+    for (; *str; ++str)
+        if (!isdigit((unsigned char)*str))
+            return false;
+    return true;
+}
+
+static int add_domain(unsigned long id, const char *name)
+{
+    if (id > UINT16_MAX)
+        return 0;
+
+    if (T.n_domains == T.domains_cap) {
+        size_t cap = T.domains_cap ? T.domains_cap * 2 : DOMAINS_INIT_SIZE;
+        struct domain_name *tmp = realloc(T.domains, cap * sizeof(*tmp));
+        if (!tmp)
+            return -ENOMEM;
+        T.domains = tmp;
+        T.domains_cap = cap;
+    }
+
+    char *copy = strdup(name);
+    if (!copy)
+        return -ENOMEM;
+
+    T.domains[T.n_domains++] = (struct domain_name) {
+        .id = id,
+        .name = copy
+    };
+    return 0;
+}
+
+/**
+ * Reads the names of the domains from the output of "xl list"
+ * ("name id ..." lines, the header is skipped) or from "id name" lines.
+ */
+static int read_domains(const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return -errno;
+
+    char line[512],
+         first[256],
+         second[256];
+    int ret = 0;
+    while (!ret && fgets(line, sizeof(line), fp)) {
+        if (sscanf(line, "%255s %255s", first, second) != 2)
+            continue;
+
+        if (is_number(second))
+            ret = add_domain(strtoul(second, NULL, 10), first);
+        else if (is_number(first))
+            ret = add_domain(strtoul(first, NULL, 10), second);
+    }
+
+    fclose(fp);
+    // Not a list of domains
+    if (!ret && !T.n_domains)
+        return -ENODATA;
+    return ret;
+}
+
+static const char *domain_name(uint16_t id)
+{
+    // Last name read wins
+    for (size_t i = T.n_domains; i > 0; --i)
+        if (T.domains[i - 1].id == id)
+            return T.domains[i - 1].name;
+    return NULL;
+}
+
+/**
+ * Resets the table and reads the names of the domains from the file
+ * "domain_names" (if not NULL), used by the pairs added afterwards.
+ */
+int tasks_init(const char *domain_names)
+{
+    tasks_free();
+    if (!domain_names)
+        return 0;
+
+    int ret = read_domains(domain_names);
+    if (ret)
+        fprintf(stderr, "[XenTrace WARN] Cannot read the domain names from \"%s\" (%s).\n",
+                    domain_names, strerror(-ret));
+    return ret;
+}
+
+/**
+ * Renders the name of a domain/vCPU pair, if new (called for each
+ * record). Returns 1 if added, 0 if already known, or a negative
+ * error code.
+ */
+int tasks_add(xt_domain dom)
+{
+    uint32_t key = key_of(dom);
+    if (T.has_last && T.last_dom == key)
+        return 0;
+
+    if (2 * (T.size + 1) > T.table_size && grow_table())
+        return -ENOMEM;
+
+    size_t slot = find_slot(key);
+    if (T.names[slot]) {
+        T.last_dom = key;
+        T.has_last = true;
+        return 0;
+    }
+
+    const char *name = domain_name(dom.id);
+    int ret;
+    if (dom.id == XEN_DOM_IDLE)
+        ret = asprintf(&T.names[slot], "idle/v%u", dom.vcpu);
+    else if (dom.id == XEN_DOM_DFLT)
+        ret = asprintf(&T.names[slot], "default/v?");
+    else if (name)
+        ret = asprintf(&T.names[slot], "%s/v%u", name, dom.vcpu);
+    else
+        ret = asprintf(&T.names[slot], "d%u/v%u", dom.id, dom.vcpu);
+
+    if (ret < 0) {
+        T.names[slot] = NULL;
+        return -ENOMEM;
+    }
+
+    T.keys[slot] = key;
+    T.size++;
+    T.last_dom = key;
+    T.has_last = true;
+    return 1;
+}
+
+/**
+ * Returns the name of a domain/vCPU pair (NULL if not added).
+ */
+const char *tasks_name(xt_domain dom)
+{
+    return T.table_size ? T.names[find_slot(key_of(dom))] : NULL;
+}
+
+size_t tasks_count()
+{
+    return T.size;
+}
+
+void tasks_free()
+{
+    for (size_t i = 0; i < T.table_size; ++i)
+        free(T.names[i]);
+    for (size_t i = 0; i < T.n_domains; ++i)
+        free(T.domains[i].name);
+
+    free(T.keys);
+    free(T.names);
+    free(T.domains);
+    memset(&T, 0, sizeof(T));
+}
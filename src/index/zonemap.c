@@ -0,0 +1,375 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef _GNU_SOURCE
+/** Use GNU C Library. */
+#define _GNU_SOURCE
+#endif // _GNU_SOURCE
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// KernelShark.v2-Beta
+#include "libkshark.h"
+// Events formatting
+#include "events/events.h"
+
+#include "index.h"
+
+#define COLUMNS_INIT_SIZE 4096
+// Marks a position without entry
+#define NO_EVENT 0xffff
+
+/*
+ * The entries are split in chunks of XZM_CHUNK positions. The zone
+ * map of a chunk tells (without false negatives) whether it may hold
+ * an entry matching a query, so that searches skip whole chunks. The
+ * candidate chunks are scanned on compact columns of dense event ids
+ * and domains, 8 entries at a time with SSE2.
+ */
+static struct {
+    struct xzm_zone *zones;
+    size_t n_zones;
+    // Columns (by position, from "first": 0 but for "xzm_init_at")
+    uint16_t *events,
+             *doms;
+    uint32_t first,
+             size;
+    size_t capacity;
+    // Class bit of each dense id
+    uint16_t *classes;
+    int n_classes;
+} Z;
+
+static unsigned bloom_hash1(uint16_t id)
+{
+    return (id * 0x9e3779b1u) >> 24;
+}
+
+static unsigned bloom_hash2(uint16_t id)
+{
+    return (id * 0x85ebca6bu) >> 24;
+}
+
+static void set_bit(uint64_t *bits, unsigned n)
+{
+    bits[n / 64] |= 1ULL << (n % 64);
+}
+
+static bool test_bit(const uint64_t *bits, unsigned n)
+{
+    return bits[n / 64] & (1ULL << (n % 64));
+}
+
+static int grow_columns(size_t i)
+{
+    size_t new_cap = Z.capacity ? Z.capacity * 2 : COLUMNS_INIT_SIZE;
+    while (new_cap <= i)
+        new_cap *= 2;
+
+    uint16_t *events = realloc(Z.events, new_cap * sizeof(*events));
+    if (!events)
+        return -ENOMEM;
+    Z.events = events;
+
+    uint16_t *doms = realloc(Z.doms, new_cap * sizeof(*doms));
+    if (!doms)
+        return -ENOMEM;
+    Z.doms = doms;
+
+    size_t n_zones = new_cap / XZM_CHUNK + 1;
+    struct xzm_zone *zones = realloc(Z.zones, n_zones * sizeof(*zones));
+    if (!zones)
+        return -ENOMEM;
+    Z.zones = zones;
+
+    Z.capacity = new_cap;
+    return 0;
+}
+
+int xzm_init()
+{
+    return xzm_init_at(0);
+}
+
+/**
+ * Same as "xzm_init", with the entries starting at position "first"
+ * (rounded down to a chunk, there are none before). Lets the checks
+ * map a few entries at the end of the positions.
+ */
+int xzm_init_at(uint32_t first)
+{
+    xzm_free();
+    Z.first = Z.size = first - first % XZM_CHUNK;
+    return 0;
+}
+
+/**
+ * Adds the entry at "pos" (positions must be increasing,
+ * "entry" is NULL if missing) to the columns and to its zone.
+ */
+int xzm_feed(uint32_t pos, const struct kshark_entry *entry, uint32_t event_id, uint16_t dom)
+{
+    size_t i = pos - Z.first;
+    if (i >= Z.capacity && grow_columns(i))
+        return -ENOMEM;
+
+    // Positions skipped so far are empty
+    for (; Z.size <= pos; ++Z.size) {
+        size_t j = Z.size - Z.first;
+        Z.events[j] = NO_EVENT;
+        Z.doms[j] = 0;
+        if (j % XZM_CHUNK == 0) {
+            Z.zones[Z.n_zones++] = (struct xzm_zone) {
+                .min_ts = INT64_MAX,
+                .max_ts = INT64_MIN
+            };
+        }
+    }
+
+    if (!entry)
+        return 0;
+
+    struct xzm_zone *z = &Z.zones[i / XZM_CHUNK];
+    uint16_t id = entry->event_id;
+
+    Z.events[i] = id;
+    Z.doms[i] = dom;
+
+    if (entry->ts < z->min_ts)
+        z->min_ts = entry->ts;
+    if (entry->ts > z->max_ts)
+        z->max_ts = entry->ts;
+    z->classes |= GET_EVENT_CLS(event_id);
+    set_bit(z->events, bloom_hash1(id));
+    set_bit(z->events, bloom_hash2(id));
+    set_bit(z->doms, dom % XZM_DOM_BITS);
+    return 0;
+}
+
+/**
+ * Builds the class of each dense id, for the queries on classes.
+ */
+int xzm_finish()
+{
+    free(Z.classes);
+    Z.n_classes = evids_count();
+    Z.classes = malloc((Z.n_classes ? Z.n_classes : 1) * sizeof(*Z.classes));
+    if (!Z.classes)
+        return -ENOMEM;
+
+    for (int i = 0; i < Z.n_classes; ++i)
+        Z.classes[i] = GET_EVENT_CLS(evids_full(i));
+    return 0;
+}
+
+static bool zone_may_match(const struct xzm_zone *z, const struct xzm_query *q)
+{
+    if (z->min_ts > z->max_ts)
+        return false;
+    if (q->classes && !(z->classes & q->classes))
+        return false;
+    if (q->dom >= 0 && !test_bit(z->doms, q->dom % XZM_DOM_BITS))
+        return false;
+
+    if (!q->n_events)
+        return true;
+    for (int i = 0; i < q->n_events; ++i)
+        if (test_bit(z->events, bloom_hash1(q->events[i])) &&
+                test_bit(z->events, bloom_hash2(q->events[i])))
+            return true;
+    return false;
+}
+
+// Positions of the columns ("i") are relative to the first one
+static bool entry_matches(const struct xzm_query *q, size_t i)
+{
+    uint16_t id = Z.events[i];
+    if (id == NO_EVENT)
+        return false;
+    if (q->dom >= 0 && Z.doms[i] != q->dom)
+        return false;
+    if (q->classes && (id >= Z.n_classes || !(Z.classes[id] & q->classes)))
+        return false;
+
+    if (!q->n_events)
+        return true;
+    for (int i = 0; i < q->n_events; ++i)
+        if (id == q->events[i])
+            return true;
+    return false;
+}
+
+#ifdef __SSE2__
+/**
+ * Returns a mask with two bits set for each of the 8
+ * entries from "i" matching the events and domain.
+ */
+static unsigned match_block(const struct xzm_query *q, size_t i)
+{
+    __m128i ids = _mm_loadu_si128((const __m128i *)(Z.events + i)),
+            m = _mm_set1_epi16(-1);
+
+    if (q->n_events) {
+        m = _mm_setzero_si128();
+        for (int i = 0; i < q->n_events; ++i)
+            m = _mm_or_si128(m, _mm_cmpeq_epi16(ids, _mm_set1_epi16(q->events[i])));
+    }
+
+    if (q->dom >= 0) {
+        __m128i doms = _mm_loadu_si128((const __m128i *)(Z.doms + i));
+        m = _mm_and_si128(m, _mm_cmpeq_epi16(doms, _mm_set1_epi16(q->dom)));
+    }
+
+    // Missing entries never match
+    m = _mm_andnot_si128(_mm_cmpeq_epi16(ids, _mm_set1_epi16((short)NO_EVENT)), m);
+    return _mm_movemask_epi8(m);
+}
+#endif
+
+/**
+ * Scans the positions [from, to) of a chunk, forward or backward.
+ */
+static ssize_t scan_chunk(const struct xzm_query *q, size_t from, size_t to, bool forward)
+{
+#ifdef __SSE2__
+    if (forward) {
+        for (; from < to && from % 8; ++from)
+            if (entry_matches(q, from))
+                return from;
+        for (; from + 8 <= to; from += 8) {
+            unsigned mask = match_block(q, from);
+            while (mask) {
+                size_t pos = from + __builtin_ctz(mask) / 2;
+                if (entry_matches(q, pos))
+                    return pos;
+                mask &= ~(3u << (2 * (pos - from)));
+            }
+        }
+    } else {
+        for (; to > from && to % 8; --to)
+            if (entry_matches(q, to - 1))
+                return to - 1;
+        for (; to >= from + 8; to -= 8) {
+            unsigned mask = match_block(q, to - 8);
+            while (mask) {
+                size_t pos = to - 8 + (31 - __builtin_clz(mask)) / 2;
+                if (entry_matches(q, pos))
+                    return pos;
+                mask &= ~(3u << (2 * (pos - (to - 8))));
+            }
+        }
+    }
+#endif
+
+    if (forward) {
+        for (; from < to; ++from)
+            if (entry_matches(q, from))
+                return from;
+    } else {
+        for (; to > from; --to)
+            if (entry_matches(q, to - 1))
+                return to - 1;
+    }
+
+    return -1;
+}
+
+/**
+ * Returns the position of the first entry matching the query after
+ * (or, if not "forward", before) the position "from", -1 if none.
+ */
+ssize_t xzm_find(const struct xzm_query *q, ssize_t from, bool forward)
+{
+    // Relative to the first position, in 64 bits (a chunk can end at 2^32)
+    int64_t n = (int64_t)Z.size - Z.first,
+            pos = (forward ? from + 1 : from - 1) - (int64_t)Z.first;
+    if (!forward && pos >= n)
+        pos = n - 1;
+    if (pos < 0 || pos >= n)
+        return -1;
+
+    for (int64_t c = pos / XZM_CHUNK; c >= 0 && c < (int64_t)Z.n_zones; c += forward ? 1 : -1) {
+        if (!zone_may_match(&Z.zones[c], q))
+            continue;
+
+        int64_t start = c * XZM_CHUNK,
+                end = (start + XZM_CHUNK < n) ? start + XZM_CHUNK : n;
+        if (c == pos / XZM_CHUNK) {
+            if (forward)
+                start = pos;
+            else
+                end = pos + 1;
+        }
+
+        ssize_t found = scan_chunk(q, start, end, forward);
+        if (found >= 0)
+            return found + Z.first;
+    }
+
+    return -1;
+}
+
+/**
+ * Returns the position of the first entry with a time
+ * not lower than "ts", -1 if none.
+ */
+ssize_t xzm_find_ts(int64_t ts)
+{
+    // First zone ending at or after "ts"
+    size_t l = 0,
+           h = Z.n_zones;
+    while (l < h) {
+        size_t m = l + (h - l) / 2;
+        if (Z.zones[m].max_ts < ts && Z.zones[m].min_ts <= Z.zones[m].max_ts)
+            l = m + 1;
+        else
+            h = m;
+    }
+
+    for (; l < Z.n_zones; ++l) {
+        if (Z.zones[l].max_ts < ts)
+            continue;
+
+        struct kshark_entry *entry;
+        uint64_t end = (uint64_t)Z.first + (l + 1) * XZM_CHUNK;
+        for (uint64_t pos = Z.first + l * XZM_CHUNK; pos < end && pos < Z.size; ++pos)
+            if ((entry = xti_entry(pos)) && entry->ts >= ts)
+                return pos;
+    }
+
+    return -1;
+}
+
+void xzm_free()
+{
+    free(Z.zones);
+    free(Z.events);
+    free(Z.doms);
+    free(Z.classes);
+    memset(&Z, 0, sizeof(Z));
+}
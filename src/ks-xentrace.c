@@ -24,6 +24,7 @@
 #define _GNU_SOURCE
 #endif // _GNU_SOURCE
 
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -39,29 +40,46 @@
 #include "xentrace-parser.h"
 // Events formatting
 #include "events/events.h"
+// Load-time analyses
+#include "analysis/analysis.h"
+// Entry indexes
+#include "index/index.h"
+// Columnar export
+#include "export/export.h"
+// Record store
+#include "store/store.h"
+// Load-phase counters and USDT probes
+#include "stats/stats.h"
+#include "stats/probes.h"
+// Plot plugin
+#include "plot/plot.h"
 
 #ifdef DEBUG
 #define DBG_PRINTF(_format, ...) fprintf(stdout, \
                     "[XenTrace DEBUG] "__func__": "_format, __VA_ARGS__);
 #endif
 
-#define TASK_MAX_LEN 16
-
 #define ENV_XEN_CPUHZ "XEN_CPUHZ"
 #define ENV_XEN_ABSTS "XEN_ABSTS"
+#define ENV_XEN_LOSSRPT "XEN_LOSSRPT"
+#define ENV_XEN_SHDWRPT "XEN_SHDWRPT"
+#define ENV_XEN_COLEXP "XEN_COLEXP"
+#define ENV_XEN_LOADSTAT "XEN_LOADSTAT"
+#define ENV_XEN_PREVIEW "XEN_PREVIEW"
+#define ENV_XEN_DOMNAMES "XEN_DOMNAMES"
 
 #define QHZ_FROM_HZ(_hz) (((_hz) << 10) / 1000000000)
 #define DEFAULT_CPU_HZ 2400000000LL
 #define GHZ 1000000000LL
 #define MHZ 1000000LL
 #define KHZ 1000LL
+#define MIB (1ULL << 20)
+#define GIB (1ULL << 30)
 
 static const char *format_name = "xentrace_binary";
 
 // Plugin instance variables
 static struct {
-    // XenTrace Parser instance.
-    xentrace_parser parser;
     // CPU Hz and Qhz values to use
     // with the currently open trace.
     uint64_t cpu_hz,
@@ -70,6 +88,18 @@ static struct {
     // currently open trace.
     // Used for relative timestamp.
     uint64_t first_tsc;
+    // Path of the loss report
+    // ("-" for stderr, NULL if disabled).
+    char *loss_report;
+    // Path of the shadow paging report
+    // ("-" for stderr, NULL if disabled).
+    char *shadow_report;
+    // Directory of the columnar export
+    // (NULL if disabled).
+    char *column_export;
+    // File of the domain names
+    // (NULL if not set).
+    char *domain_names;
 } I;
 
 /**
@@ -90,30 +120,22 @@ static const int get_pid(struct kshark_data_stream *stream,
 static char *get_task(struct kshark_data_stream *stream,
                         const struct kshark_entry *entry)
 {
-    xt_event *event = xtp_get_event(I.parser, entry->offset);
-    if (!event)
-        return NULL;
-
-    char *result_str = malloc(TASK_MAX_LEN);
-    if (!result_str)
+    XT_PROBE1(get_task__entry, entry->offset);
+    xt_event buf;
+    const xt_event *event = xts_get(entry->offset, &buf);
+    // Rendered while loading
+    const char *name = event ? tasks_name(event->dom) : NULL;
+    // Measured once, for the copy and for the probe
+    size_t result_len = name ? strlen(name) : 0;
+    char *result_str = name ? malloc(result_len + 1) : NULL;
+    if (!result_str) {
+        XT_PROBE2(get_task__return, entry->offset, -1);
         return NULL;
-
-    xt_domain dom = event->dom;
-    int result_len = 0;
-
-    switch (dom.id) {
-        case XEN_DOM_IDLE:
-            result_len = snprintf(result_str, TASK_MAX_LEN, "idle/v%u", dom.vcpu);
-            break;
-        case XEN_DOM_DFLT:
-            result_len = snprintf(result_str, TASK_MAX_LEN, "default/v?");
-            break;
-        default:
-            result_len = snprintf(result_str, TASK_MAX_LEN, "d%u/v%u", dom.id, dom.vcpu);
-            break;
     }
 
-    return (result_len > 0) ? result_str : NULL;
+    memcpy(result_str, name, result_len + 1);
+    XT_PROBE2(get_task__return, entry->offset, result_len);
+    return result_str;
 }
 
 /**
@@ -122,66 +144,30 @@ static char *get_task(struct kshark_data_stream *stream,
 static const int get_event_id(struct kshark_data_stream *stream,
                                 const struct kshark_entry *entry)
 {
-    if (entry->visible & KS_PLUGIN_UNTOUCHED_MASK) {
-        xt_event *event = xtp_get_event(I.parser, entry->offset);
-        return event ? (event->rec).id : -EFAULT;
-    }
+    if (entry->visible & KS_PLUGIN_UNTOUCHED_MASK)
+        return entry->event_id;
 
     return KS_EMPTY_BIN;
 }
 
 /**
- * 
+ * Returns the name of the event of an entry. Only the (dense)
+ * "event_id" of the entry is used, so it works for any entry
+ * built from an id returned by "get_all_event_ids".
  */
 static char *get_event_name(struct kshark_data_stream *stream,
                                 const struct kshark_entry *entry)
 {
-    xt_event *event = xtp_get_event(I.parser, entry->offset);
-    if (!event)
-        return NULL;
-
-    char *result_str = malloc(STR_EVNAME_MAXLEN);
-    if (!result_str)
+    XT_PROBE1(get_event_name__entry, entry->event_id);
+    uint32_t event_id = evids_full(entry->event_id);
+    char *result_str = event_id ? malloc(STR_EVNAME_MAXLEN) : NULL;
+    if (!result_str) {
+        XT_PROBE2(get_event_name__return, entry->event_id, -1);
         return NULL;
-
-    uint32_t event_id = (event->rec).id;
-    int result_len = 0;
-
-    switch (GET_EVENT_CLS(event_id)) {
-        // General trace
-        case GET_EVENT_CLS(TRC_GEN):
-            result_len = get_basecls_evname(event_id, result_str);
-            break;
-        // Xen Scheduler trace
-        case GET_EVENT_CLS(TRC_SCHED):
-            result_len = get_schedcls_evname(event_id, result_str);
-            break;
-        // Xen DOM0 operation trace
-        case GET_EVENT_CLS(TRC_DOM0OP):
-            result_len = get_dom0cls_evname(event_id, result_str);
-            break;
-        // Xen HVM trace
-        case GET_EVENT_CLS(TRC_HVM):
-            result_len = get_hvmcls_evname(event_id, result_str);
-            break;
-        // Xen memory trace
-        case GET_EVENT_CLS(TRC_MEM):
-            result_len = get_memcls_evname(event_id, result_str);
-            break;
-        // Xen PV traces
-        case GET_EVENT_CLS(TRC_PV):
-            result_len = get_pvcls_evname(event_id, result_str);
-            break;
-        // Xen shadow tracing
-        case GET_EVENT_CLS(TRC_SHADOW):
-            result_len = get_shdwcls_evname(event_id, result_str);
-            break;
-        // Xen hardware-related traces
-        case GET_EVENT_CLS(TRC_HW):
-            result_len = get_hwcls_evname(event_id, result_str);
-            break;
     }
 
+    int result_len = get_evname(event_id, result_str);
+
     #ifdef DEBUG
     if (result_len > STR_EVNAME_MAXLEN)
         DBG_PRINTF("result_len(%d) is greater than the maximum length!\n", result_len);
@@ -191,64 +177,63 @@ static char *get_event_name(struct kshark_data_stream *stream,
         result_len = EVNAME(result_str, "unknown (0x%08x)", event_id);
         if (result_len < 1) {
             free(result_str);
-            return NULL;
+            result_str = NULL;
         }
     }
 
+    XT_PROBE2(get_event_name__return, entry->event_id, result_len);
     return result_str;
 }
 
+/**
+ * Returns the (dense) id of the event called "name", -1 if unknown.
+ */
+static int find_event_id(struct kshark_data_stream *stream, const char *name)
+{
+    for (int i = 0; i < evids_count(); ++i) {
+        struct kshark_entry entry = { .event_id = i };
+        char *event_name = get_event_name(stream, &entry);
+        int found = event_name && !strcmp(event_name, name);
+        free(event_name);
+        if (found)
+            return i;
+    }
+
+    return -1;
+}
+
+/**
+ * Returns the (dense) ids of all the events of the trace.
+ */
+static int *get_all_event_ids(struct kshark_data_stream *stream)
+{
+    int n_ids = evids_count(),
+        *ids = malloc(sizeof(int) * (n_ids ? n_ids : 1));
+    if (!ids)
+        return NULL;
+
+    for (int i = 0; i < n_ids; ++i)
+        ids[i] = i;
+    return ids;
+}
+
 /**
  * 
  */
 static char *get_info(struct kshark_data_stream *stream,
                             const struct kshark_entry *entry)
 {
-    xt_event *event = xtp_get_event(I.parser, entry->offset);
-    if (!event)
-        return NULL;
-
-    char *result_str = malloc(STR_EVINFO_MAXLEN);
-    if(!result_str)
+    XT_PROBE1(get_info__entry, entry->offset);
+    xt_event buf;
+    const xt_event *event = xts_get(entry->offset, &buf);
+    char *result_str = event ? malloc(STR_EVINFO_MAXLEN) : NULL;
+    if (!result_str) {
+        XT_PROBE2(get_info__return, entry->offset, -1);
         return NULL;
+    }
 
     xt_record e_record = event->rec;
-    int result_len = 0;
-
-    switch (GET_EVENT_CLS(e_record.id)) {
-        // General trace
-        case GET_EVENT_CLS(TRC_GEN):
-            result_len = get_basecls_evinfo(e_record.id, e_record.extra, result_str);
-            break;
-        // Xen Scheduler trace
-        case GET_EVENT_CLS(TRC_SCHED):
-            result_len = get_schedcls_evinfo(e_record.id, e_record.extra, result_str);
-            break;
-        // Xen DOM0 operation trace
-        case GET_EVENT_CLS(TRC_DOM0OP):
-            result_len = get_dom0cls_evinfo(e_record.id, e_record.extra, result_str);
-            break;
-        // Xen HVM trace
-        case GET_EVENT_CLS(TRC_HVM):
-            result_len = get_hvmcls_evinfo(e_record.id, e_record.extra, result_str);
-            break;
-        // Xen memory trace
-        case GET_EVENT_CLS(TRC_MEM):
-            result_len = get_memcls_evinfo(e_record.id, e_record.extra, result_str);
-            break;
-        // Xen PV traces
-        case GET_EVENT_CLS(TRC_PV):
-            result_len = get_pvcls_evinfo(e_record.id, e_record.extra, result_str);
-            break;
-        // Xen shadow tracing
-        case GET_EVENT_CLS(TRC_SHADOW):
-            result_len = get_shdwcls_evinfo(e_record.id, e_record.extra, result_str);
-            break;
-        // Xen hardware-related traces
-        case GET_EVENT_CLS(TRC_HW):
-            result_len = get_hwcls_evinfo(e_record.id, e_record.extra, result_str);
-            break;
-    }
+    int result_len = get_evinfo(e_record.id, e_record.extra, result_str);
 
     #ifdef DEBUG
     if (result_len > STR_EVINFO_MAXLEN)
@@ -257,9 +242,10 @@ static char *get_info(struct kshark_data_stream *stream,
 
     if (result_len < 1) {
         free(result_str);
-        return NULL;
+        result_str = NULL;
     }
 
+    XT_PROBE3(get_info__return, entry->offset, e_record.id, result_len);
     return result_str;
 }
 
@@ -296,6 +282,110 @@ static int64_t tsc_to_ns(uint64_t tsc)
     return tsc / I.cpu_qhz;
 }
 
+/**
+ * Converts a number of cycles (not a TSC) to ns.
+ */
+static int64_t cycles_to_ns(uint64_t cycles)
+{
+    return (cycles << 10) / I.cpu_qhz;
+}
+
+/**
+ * Writes a report to "path" ("-" for stderr).
+ */
+static void write_report(const char *path, const char *name, void (*report)(FILE *))
+{
+    FILE *fp = strcmp(path, "-") ? fopen(path, "w") : stderr;
+    if (!fp) {
+        fprintf(stderr, "[XenTrace WARN] Cannot write the %s report to \"%s\".\n",
+                    name, path);
+        return;
+    }
+
+    report(fp);
+    if (fp != stderr)
+        fclose(fp);
+}
+
+/**
+ * Writes the loss report to the file set by "XEN_LOSSRPT".
+ */
+static void write_loss_report()
+{
+    uint64_t lost = tloss_total_lost();
+    if (lost && !I.loss_report)
+        fprintf(stderr, "[XenTrace WARN] %"PRIu64" records have been lost. "
+                        "Set \"%s\" for a report.\n", lost, ENV_XEN_LOSSRPT);
+
+    if (I.loss_report)
+        write_report(I.loss_report, "loss", tloss_report);
+}
+
+/**
+ * Writes the records as column files to the directory set by "XEN_COLEXP".
+ */
+static void export_columns(size_t n_rows)
+{
+    int ret = colexport_write(I.column_export, n_rows, I.cpu_hz, xts_get, tsc_to_ns);
+    if (ret)
+        fprintf(stderr, "[XenTrace WARN] Cannot export the columns to \"%s\" (%s).\n",
+                    I.column_export, strerror(-ret));
+}
+
+/**
+ * Walks the raw records of the file, to account the lost
+ * records and the bytes written per pCPU.
+ */
+static void scan_raw_trace(struct kshark_data_stream *stream, int64_t base_ts, int64_t last_ts)
+{
+    struct xtr_file file;
+    if (xtr_open(&file, stream->file))
+        return;
+
+    uint64_t heap = ldstat_heap(),
+             // Bytes of the preview (0 if whole)
+             end = xtbg_preview_end();
+    tloss_init(stream->n_cpus, tsc_to_ns, base_ts, last_ts);
+
+    struct xtr_cursor cur;
+    struct xtr_record rec;
+    xtr_cursor_init(&cur, &file, 0);
+    while (xtr_next(&cur, &rec) > 0 && (!end || rec.offset < end)) {
+        // No TSC yet on the pCPU of the record
+        if (!rec.tsc)
+            continue;
+        tloss_feed(&rec, tsc_to_ns(rec.tsc));
+    }
+
+    xtr_cursor_free(&cur);
+    xtr_close(&file);
+
+    tloss_finish();
+    ldstat_mem_add(LDSTAT_MEM_RAW_SCAN, ldstat_heap() - heap);
+    if (!end)
+        write_loss_report();
+}
+
+/**
+ * Entries are indexed by 32-bit positions: more records cannot be loaded.
+ */
+static bool too_many_records(size_t n_records)
+{
+    if (n_records <= XTI_MAX_ENTRIES)
+        return false;
+
+    fprintf(stderr, "[XenTrace WARN] The trace has %zu records, at most %zu can be loaded.\n",
+                n_records, (size_t)XTI_MAX_ENTRIES);
+    return true;
+}
+
+static void free_rows(struct kshark_entry **rows, size_t n_rows)
+{
+    for (size_t i = 0; i < n_rows; ++i)
+        free(rows[i]);
+    free(rows);
+}
+
 /**
  * Loads the content of the XenTrace binary file.
  */
@@ -303,45 +393,148 @@ static ssize_t load_entries(struct kshark_data_stream *stream,
                                 struct kshark_context *kshark_ctx,
                                 struct kshark_entry ***data_rows)
 {
-    int n_events = xtp_events_count(I.parser),
-        pos = 0;
-    
+    // Records loaded in background so far (see "XEN_PREVIEW")
+    int n_cpus = 0;
+    if (xtbg_commit(&n_cpus) > 0 && n_cpus > stream->n_cpus)
+        stream->n_cpus = n_cpus;
+
+    uint64_t load_begin = ldstat_begin(),
+             heap = ldstat_heap();
+    size_t n_events = xts_count(),
+           pos = 0;
+    XT_PROBE1(load__begin, n_events);
+
+    if (too_many_records(n_events))
+        return -EFBIG;
+
     struct kshark_entry **rows = malloc(sizeof(struct kshark_entry*) * n_events);
     if (!rows)
         return -ENOMEM;
 
-    xt_event *event;
-    while ((event = xtp_next_event(I.parser))) {
+    // Load-time analyses
+    evids_free();
+    tasks_init(I.domain_names);
+    xti_init(stream->stream_id, xts_get);
+    xzm_init();
+    occupancy_init(stream->n_cpus);
+    csched2_init(stream->n_cpus);
+    irqstat_init(cycles_to_ns);
+    power_init(stream->n_cpus);
+    shadow_init();
+    pvprof_init();
+
+    XT_PROBE1(load__phase, "records");
+    while (pos < n_events) {
+        // Each lap closes a phase and begins the next
+        uint64_t lap = ldstat_begin();
+
         // Utility ptrs
-        xt_record *rec = &event->rec;
+        xt_event buf;
+        const xt_event *event = xts_get(pos, &buf);
+        const xt_record *rec = &event->rec;
+        XT_PROBE4(record, pos, rec->id, event->cpu, rec->tsc);
+        int64_t ts = tsc_to_ns(rec->tsc);
+        lap = ldstat_lap(LDSTAT_TSC, lap);
 
         // Initialize KS row
         rows[pos] = calloc(1, sizeof(struct kshark_entry));
+        lap = ldstat_lap(LDSTAT_ROWS_ALLOC, lap);
+
+        occupancy_feed(event, ts);
+        csched2_feed(event, ts);
+        power_feed(event, ts);
+        if (GET_EVENT_CLS(rec->id) == GET_EVENT_CLS(TRC_HW))
+            irqstat_feed(event, ts, rows[pos]);
+        else if (GET_EVENT_CLS(rec->id) == GET_EVENT_CLS(TRC_SHADOW))
+            shadow_feed(event, ts, rows[pos]);
+        else if (GET_EVENT_CLS(rec->id) == GET_EVENT_CLS(TRC_PV))
+            pvprof_feed(event, ts);
+        lap = ldstat_lap(LDSTAT_ANALYSES, lap);
         if (!rows[pos]) { // Jump the entry if calloc fails
             ++pos;
             continue;
         }
 
+        int task_id = get_task_id(event->dom);
+        if (task_id) {
+            kshark_hash_id_add(stream->tasks, task_id);
+            rows[pos]->pid = task_id;
+        } // else 0
+        int ret = tasks_add(event->dom);
+        if (ret < 0) {
+            free_rows(rows, pos + 1);
+            return ret;
+        }
+        lap = ldstat_lap(LDSTAT_TASKS, lap);
+
         // Populate members of the KS row
         rows[pos]->stream_id = stream->stream_id;
         rows[pos]->visible = 0xff;
         rows[pos]->offset = pos;
 
-        rows[pos]->event_id = rec->id % 16; // FIXME  int16_t < uint32_t:28  ¯\_(ツ)_/¯
+        int event_id = evids_get(rec->id);
+        if (event_id < 0) {
+            fprintf(stderr, "[XenTrace WARN] Cannot index the event 0x%08x: %s.\n",
+                        rec->id, strerror(-event_id));
+            free_rows(rows, pos + 1);
+            return event_id;
+        }
+        rows[pos]->event_id = event_id;
         rows[pos]->cpu = event->cpu;
-        rows[pos]->ts  = tsc_to_ns(rec->tsc);
+        rows[pos]->ts  = ts;
 
-        if ((event->dom).id != XEN_DOM_IDLE) {
-            int task_id = ((event->dom).id == XEN_DOM_DFLT) ? 
-                                XEN_DOM_DFLT : (event->dom).u32 + 1;
-            kshark_hash_id_add(stream->tasks, task_id);
-            rows[pos]->pid = task_id;
-        } // else 0
+        xti_feed(pos, rows[pos], (event->dom).id);
+        xzm_feed(pos, rows[pos], rec->id, (event->dom).id);
+        ldstat_end(LDSTAT_INDEXES, lap);
+        XT_PROBE5(entry, pos, rows[pos]->event_id, rows[pos]->cpu,
+                    rows[pos]->pid, rows[pos]->ts);
 
         // Go next
         ++pos;
     }
 
+    XT_PROBE1(load__phase, "finish");
+    uint64_t begin = ldstat_begin();
+    xti_finish(pos);
+    xzm_finish();
+    // Distinct events, not records
+    stream->n_events = evids_count();
+    // Filters set before the (re)load, through the bitmap indexes
+    if (kshark_ctx)
+        xti_apply_filters(kshark_ctx);
+
+    occupancy_finish();
+    csched2_finish();
+    irqstat_finish();
+    power_finish();
+    begin = ldstat_lap(LDSTAT_FINISH, begin);
+
+    // All the rows have the same size
+    int64_t rows_bytes = ldstat_chunk(rows) + (pos ? pos * ldstat_chunk(rows[0]) : 0);
+    ldstat_mem_add(LDSTAT_MEM_ROWS, rows_bytes);
+    ldstat_mem_add(LDSTAT_MEM_ANALYSES, ldstat_heap() - heap - rows_bytes);
+
+    // Reports of the whole trace only
+    XT_PROBE1(load__phase, "reports");
+    if (I.shadow_report && !xtbg_preview_end())
+        write_report(I.shadow_report, "shadow paging", shadow_report);
+
+    if (I.column_export && !xtbg_preview_end())
+        export_columns(pos);
+    begin = ldstat_lap(LDSTAT_REPORTS, begin);
+
+    XT_PROBE1(load__phase, "raw_scan");
+    xt_event first,
+             last;
+    scan_raw_trace(stream, tsc_to_ns((xts_get(0, &first)->rec).tsc),
+                    tsc_to_ns((xts_get(xts_count() - 1, &last)->rec).tsc));
+    ldstat_end(LDSTAT_RAW_SCAN, begin);
+
+    ldstat_end(LDSTAT_LOAD, load_begin);
+    XT_PROBE1(load__end, pos);
+    if (ldstat_enabled())
+        ldstat_json(stderr, "load");
+
     *data_rows = rows;
     return n_events;
 }
@@ -370,6 +563,47 @@ static uint64_t parse_cpu_hz(char *arg) {
     }
 }
 
+/**
+ * Reads the limit of the preview: seconds of trace ("2s")
+ * or MiB / GiB of the file ("64", "64M", "1G").
+ */
+static bool parse_preview(char *arg, uint64_t cpu_hz, struct xtbg_limit *limit)
+{
+    char *next_ptr;
+    double value = strtod(arg, &next_ptr);
+
+    memset(limit, 0, sizeof(*limit));
+    if (next_ptr == arg || value <= 0) {
+        fprintf(stderr, "[XenTrace WARN] Invalid preview \"%s\". The whole trace will be loaded.\n", arg);
+        return false;
+    }
+
+    switch (*next_ptr) {
+        case 's':
+            limit->cycles = value * cpu_hz;
+            return true;
+        case '\0':
+        case 'M':
+            limit->bytes = value * MIB;
+            return true;
+        case 'G':
+            limit->bytes = value * GIB;
+            return true;
+        default:
+            fprintf(stderr, "[XenTrace WARN] Unknown suffix '%c'. The whole trace will be loaded.\n", *next_ptr);
+            return false;
+    }
+}
+
+/**
+ * Returns true if the environment variable "name" is set to 1 / Y / y.
+ */
+static bool env_is_set(const char *name)
+{
+    char *env = secure_getenv(name);
+    return env && ((*env == '1') || (*env == 'y') || (*env == 'Y'));
+}
+
 /**
  *
  */
@@ -382,11 +616,21 @@ static void read_env_vars()
 
     // Save the tsc of the first event to
     // perform the calc of the relative ts.
-    char *env_abs_ts = secure_getenv(ENV_XEN_ABSTS);
-    char abs_ts = env_abs_ts && ((*env_abs_ts == '1') ||
-                                    (*env_abs_ts == 'y') ||
-                                        (*env_abs_ts == 'Y'));
-    I.first_tsc = abs_ts ? 0 : ((xtp_get_event(I.parser, 0))->rec).tsc;
+    xt_event first;
+    I.first_tsc = env_is_set(ENV_XEN_ABSTS) ? 0 :
+                    ((xts_get(0, &first))->rec).tsc;
+
+    // Path of the loss report (optional)
+    I.loss_report = secure_getenv(ENV_XEN_LOSSRPT);
+
+    // Path of the shadow paging report (optional)
+    I.shadow_report = secure_getenv(ENV_XEN_SHDWRPT);
+
+    // Directory of the columnar export (optional)
+    I.column_export = secure_getenv(ENV_XEN_COLEXP);
+
+    // File of the domain names, e.g. "xl list" output (optional)
+    I.domain_names = secure_getenv(ENV_XEN_DOMNAMES);
 
     // TODO Others... ?
 }
@@ -399,6 +643,8 @@ static void init_methods(struct kshark_generic_stream_interface *interface)
     interface->get_pid  = get_pid;
     interface->get_event_id = get_event_id;
     interface->get_event_name = get_event_name;
+    interface->find_event_id = find_event_id;
+    interface->get_all_event_ids = get_all_event_ids;
     interface->get_task = get_task;
     interface->get_info = get_info;
 
@@ -406,21 +652,101 @@ static void init_methods(struct kshark_generic_stream_interface *interface)
     interface->load_entries = load_entries;
 }
 
+/**
+ * Parses the whole trace and packs its records.
+ */
+static int load_store(struct kshark_data_stream *stream)
+{
+    uint64_t heap = ldstat_heap();
+
+    // Initialize XenTrace Parser
+    uint64_t begin = ldstat_begin();
+    xentrace_parser parser = xtp_init(stream->file);
+    begin = ldstat_lap(LDSTAT_XTP_INIT, begin);
+    size_t n_events = parser ? xtp_execute(parser) : 0;
+    begin = ldstat_lap(LDSTAT_XTP_EXECUTE, begin);
+    ldstat_mem_add(LDSTAT_MEM_PARSER, ldstat_heap() - heap);
+    if (!n_events) {
+        if (parser)
+            xtp_free(parser);
+        return -ENOMEM;
+    }
+
+    // Pack the records (read without locks by the callbacks),
+    // the parser is not needed anymore
+    heap = ldstat_heap();
+    int ret = too_many_records(xtp_events_count(parser)) ? -EFBIG : xts_build(parser);
+    ldstat_end(LDSTAT_STORE, begin);
+    ldstat_mem_add(LDSTAT_MEM_STORE, ldstat_heap() - heap);
+
+    stream->n_cpus = xtp_cpus_count(parser);
+    xtp_free(parser);
+    return ret;
+}
+
+/**
+ * Loads the beginning of the trace, up to the limit set by
+ * "XEN_PREVIEW", and starts loading all of it in background.
+ * Returns 1 if no limit is set or it covers the whole trace.
+ */
+static int load_preview(struct kshark_data_stream *stream)
+{
+    char *env_preview = secure_getenv(ENV_XEN_PREVIEW),
+         *env_base_hz = secure_getenv(ENV_XEN_CPUHZ);
+    uint64_t cpu_hz = env_base_hz ? parse_cpu_hz(env_base_hz) : DEFAULT_CPU_HZ;
+    struct xtbg_limit limit;
+    if (!env_preview || !parse_preview(env_preview, cpu_hz, &limit))
+        return 1;
+
+    uint64_t begin = ldstat_begin(),
+             heap = ldstat_heap();
+    int n_cpus = 0,
+        ret = xtbg_preview(stream->file, &limit, &n_cpus);
+    ldstat_end(LDSTAT_PREVIEW, begin);
+    ldstat_mem_add(LDSTAT_MEM_STORE, ldstat_heap() - heap);
+    if (ret < 0)
+        fprintf(stderr, "[XenTrace WARN] Cannot load a preview of the trace (%s). "
+                        "The whole trace will be loaded.\n", strerror(-ret));
+    if (ret)
+        return 1;
+
+    // pCPUs showing up later in the trace
+    struct xtr_probe probe;
+    stream->n_cpus = (!xtr_probe(stream->file, &probe) && probe.n_cpus > n_cpus) ?
+                        probe.n_cpus : n_cpus;
+
+    ret = xtbg_start(stream->file, 0);
+    if (ret)
+        fprintf(stderr, "[XenTrace WARN] Cannot load the whole trace in background (%s), "
+                        "only its beginning is shown.\n", strerror(-ret));
+    else
+        fprintf(stderr, "[XenTrace INFO] Showing the first %zu records, "
+                        "the whole trace is being loaded in background.\n", xts_count());
+    return 0;
+}
+
 /**
  * Checks if the file contains XEN tracing data.
  */
 bool KSHARK_INPUT_CHECK(const char *file, char **format)
 {
-    FILE *fp = fopen(file, "rb");
-    if (!fp)
+    // TRC_TRACE_CPU_CHANGE should be the first record, followed
+    // by well formed records and windows
+    struct xtr_probe probe;
+    int ret = xtr_probe(file, &probe);
+    if (ret == -EBADMSG)
+        fprintf(stderr, "[XenTrace WARN] \"%s\" is corrupted.\n", file);
+    if (ret)
         return false;
 
-    uint32_t event_id;
-    int fread_ok = fread(&event_id, sizeof(event_id), 1, fp) == 1;
-    fclose(fp);
-
-    // TRC_TRACE_CPU_CHANGE should be the first record
-    return fread_ok && ((event_id & 0x0fffffff) == TRC_TRACE_CPU_CHANGE);
+    char *env_base_hz = secure_getenv(ENV_XEN_CPUHZ);
+    uint64_t cpu_hz = env_base_hz ? parse_cpu_hz(env_base_hz) : DEFAULT_CPU_HZ;
+    fprintf(stderr, "[XenTrace INFO] \"%s\": %.1f MiB, ~%"PRIu64" records, "
+                    "%d pCPUs, ~%.3f s%s.\n", file, probe.file_size / 1048576.0,
+                probe.est_records, probe.n_cpus,
+                (double)(probe.last_tsc - probe.first_tsc) / cpu_hz,
+                probe.truncated ? " (truncated)" : "");
+    return true;
 }
 
 /**
@@ -444,21 +770,26 @@ int KSHARK_INPUT_INITIALIZER(struct kshark_data_stream *stream)
     // Set plugin type
     interface->type = KS_GENERIC_DATA_INTERFACE;
 
-    // Initialize XenTrace Parser
-    I.parser = xtp_init(stream->file);
-    unsigned n_events = xtp_execute(I.parser);
-    if (!(I.parser && n_events)) {
+    // Load-phase counters (see "XEN_LOADSTAT")
+    ldstat_init(env_is_set(ENV_XEN_LOADSTAT));
+    // Infos about the trace file ("n_cpus" is set while loading, "n_events"
+    // is the number of distinct events, set by "load_entries")
+    stream->idle_pid = 0;
+
+    // Beginning of the trace now, whole trace in background
+    // (see "XEN_PREVIEW"), or whole trace now
+    int ret = load_preview(stream);
+    if (ret > 0)
+        ret = load_store(stream);
+    if (ret) {
         free(interface);
-        return -ENOMEM;
+        return ret;
     }
 
-    // Load infos about the trace file
-    stream->n_events = n_events;
-    stream->n_cpus   = xtp_cpus_count(I.parser);
-    stream->idle_pid = 0;
-
     // Read environment vars
+    uint64_t begin = ldstat_begin();
     read_env_vars();
+    ldstat_end(LDSTAT_ENV, begin);
 
     // Setup methods references
     init_methods(interface);
@@ -471,5 +802,77 @@ int KSHARK_INPUT_INITIALIZER(struct kshark_data_stream *stream)
  */
 void KSHARK_INPUT_DEINITIALIZER(struct kshark_data_stream *stream)
 {
-    xtp_free(I.parser);
+    occupancy_free();
+    csched2_free();
+    tloss_free();
+    irqstat_free();
+    power_free();
+    shadow_free();
+    pvprof_free();
+    xti_free();
+    xzm_free();
+    evids_free();
+    tasks_free();
+    xtbg_stop();
+    xts_free();
+
+    if (ldstat_enabled())
+        ldstat_json(stderr, "unload");
+}
+
+/**
+ * Checks if the stream has been opened by this plugin.
+ */
+static bool is_xentrace_stream(struct kshark_data_stream *stream)
+{
+    return !strncmp(stream->data_format, format_name, KS_DATA_FORMAT_SIZE - 1);
+}
+
+/**
+ * Defines "timed_<handler>", which accounts
+ * the calls of a draw handler to "_phase".
+ */
+#define TIMED_DRAW_HANDLER(_handler, _phase)                                \
+static void timed_##_handler(struct kshark_cpp_argv *argv_c, int sd,       \
+                                int val, int draw_action)                   \
+{                                                                           \
+    uint64_t begin = ldstat_begin();                                        \
+    _handler(argv_c, sd, val, draw_action);                                 \
+    ldstat_end(_phase, begin);                                              \
+}
+
+TIMED_DRAW_HANDLER(draw_pcpu_occupancy, LDSTAT_DRAW_OCCUPANCY)
+TIMED_DRAW_HANDLER(draw_csched2_series, LDSTAT_DRAW_CSCHED2)
+TIMED_DRAW_HANDLER(draw_lossy_windows, LDSTAT_DRAW_LOSS)
+TIMED_DRAW_HANDLER(draw_power_tracks, LDSTAT_DRAW_POWER)
+
+/**
+ * Loads the plot plugin (pCPU occupancy, Credit2 time series,
+ * lossy windows and power tracks).
+ */
+int KSHARK_PLOT_PLUGIN_INITIALIZER(struct kshark_data_stream *stream)
+{
+    if (!is_xentrace_stream(stream))
+        return 0;
+
+    kshark_register_draw_handler(stream, timed_draw_pcpu_occupancy);
+    kshark_register_draw_handler(stream, timed_draw_csched2_series);
+    kshark_register_draw_handler(stream, timed_draw_lossy_windows);
+    kshark_register_draw_handler(stream, timed_draw_power_tracks);
+    return 1;
+}
+
+/**
+ * Unloads the plot plugin.
+ */
+int KSHARK_PLOT_PLUGIN_DEINITIALIZER(struct kshark_data_stream *stream)
+{
+    if (!is_xentrace_stream(stream))
+        return 0;
+
+    kshark_unregister_draw_handler(stream, timed_draw_pcpu_occupancy);
+    kshark_unregister_draw_handler(stream, timed_draw_csched2_series);
+    kshark_unregister_draw_handler(stream, timed_draw_lossy_windows);
+    kshark_unregister_draw_handler(stream, timed_draw_power_tracks);
+    return 1;
 }
\ No newline at end of file
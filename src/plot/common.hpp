@@ -0,0 +1,60 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef __KSXT_PLOT_COMMON
+#define __KSXT_PLOT_COMMON
+
+// KernelShark.v2-Beta
+#include "libkshark-model.h"
+#include "KsPlotTools.hpp"
+
+/**
+ * Returns the bin of the model containing "ts" (clamped).
+ */
+static inline int ts_to_bin(const kshark_trace_histo *histo, int64_t ts)
+{
+    if (ts <= histo->min)
+        return 0;
+    if (ts >= histo->max)
+        return histo->n_bins - 1;
+    return (ts - histo->min) / histo->bin_size;
+}
+
+/**
+ * Returns the horizontal position of "ts" on a graph,
+ * interpolated between the bins (clamped).
+ */
+static inline int ts_to_x(const kshark_trace_histo *histo,
+                            const KsPlot::Graph *graph, int64_t ts)
+{
+    int bin = ts_to_bin(histo, ts),
+        x = graph->bin(bin)._base.x();
+
+    if (bin + 1 < histo->n_bins && ts > histo->min) {
+        int next_x = graph->bin(bin + 1)._base.x();
+        int64_t offset = (ts - histo->min) - (int64_t)bin * histo->bin_size;
+        x += (next_x - x) * offset / histo->bin_size;
+    }
+
+    return x;
+}
+
+#endif
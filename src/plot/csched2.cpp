@@ -0,0 +1,101 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include <vector>
+
+// KernelShark.v2-Beta
+#include "KsPlugins.hpp"
+
+#include "plot.h"
+#include "common.hpp"
+#include "analysis/analysis.h"
+
+/**
+ * Draws the decimated points of a series in the visible range
+ * as a polyline, scaled between its minimum and maximum value.
+ */
+static void draw_series(KsCppArgV *argvCpp, const struct time_series *series,
+                        const KsPlot::Color &color)
+{
+    if (!series)
+        return;
+
+    const kshark_trace_histo *histo = argvCpp->_histo;
+    const KsPlot::Graph *graph = argvCpp->_graph;
+
+    // About one point per bin
+    size_t n_out = histo->n_bins + 2;
+    std::vector<int64_t> ts(n_out);
+    std::vector<double> val(n_out);
+
+    n_out = series_decimate(series, histo->min, histo->max,
+                            n_out, ts.data(), val.data());
+    if (n_out < 2)
+        return;
+
+    double min = val[0],
+           max = val[0];
+    for (size_t i = 1; i < n_out; ++i) {
+        min = (val[i] < min) ? val[i] : min;
+        max = (val[i] > max) ? val[i] : max;
+    }
+
+    double range = (max > min) ? max - min : 1;
+    int base = graph->bin(0)._base.y(),
+        height = graph->height() - 2;
+
+    KsPlot::Point prev;
+    for (size_t i = 0; i < n_out; ++i) {
+        KsPlot::Point curr(ts_to_x(histo, graph, ts[i]),
+                            base - (int)((val[i] - min) / range * height));
+        if (i) {
+            KsPlot::Line *line = new KsPlot::Line(prev, curr);
+            line->_color = color;
+            line->_size = 1;
+            argvCpp->_shapes->push_front(line);
+        }
+        prev = curr;
+    }
+}
+
+/**
+ * Draws the average load of the runqueue on the pCPU graphs
+ * and the credit and the load of each vCPU on the task graphs.
+ */
+void draw_csched2_series(struct kshark_cpp_argv *argv_c, int sd,
+                            int val, int draw_action)
+{
+    KsCppArgV *argvCpp = KS_ARGV_TO_CPP(argv_c);
+    if (!argvCpp->_histo || !argvCpp->_graph || argvCpp->_histo->n_bins < 2)
+        return;
+
+    if (draw_action & KSHARK_CPU_DRAW) {
+        draw_series(argvCpp, csched2_series(CS2_RUNQ_LOAD, val),
+                    KsPlot::Color(0xd0, 0x30, 0x30));
+        draw_series(argvCpp, csched2_series(CS2_RUNQ_BLOAD, val),
+                    KsPlot::Color(0xe0, 0x90, 0x20));
+    } else if (draw_action & KSHARK_TASK_DRAW) {
+        draw_series(argvCpp, csched2_series(CS2_VCPU_CREDIT, val),
+                    KsPlot::Color(0x20, 0x60, 0xd0));
+        draw_series(argvCpp, csched2_series(CS2_VCPU_LOAD, val),
+                    KsPlot::Color(0x20, 0xa0, 0x50));
+    }
+}
@@ -0,0 +1,100 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+// KernelShark.v2-Beta
+#include "KsPlugins.hpp"
+
+#include "plot.h"
+#include "common.hpp"
+#include "analysis/analysis.h"
+
+// Height of the boxes, relative to the graph
+#define BOX_HEIGHT_DIV 3
+
+static KsPlot::Rectangle *make_box(const KsPlot::Graph *graph,
+                                    int first_bin, int last_bin,
+                                    int task_id)
+{
+    int x0 = graph->bin(first_bin)._base.x(),
+        x1 = graph->bin(last_bin)._base.x(),
+        y0 = graph->bin(first_bin)._base.y(),
+        y1 = y0 - graph->height() / BOX_HEIGHT_DIV;
+
+    KsPlot::Rectangle *box = new KsPlot::Rectangle;
+    box->setPoint(0, x0, y0);
+    box->setPoint(1, x0, y1);
+    box->setPoint(2, x1, y1);
+    box->setPoint(3, x1, y0);
+    box->setFill(true);
+    box->_color.setRainbowColor(task_id);
+
+    return box;
+}
+
+/**
+ * Draws on a pCPU graph the domain/vCPU that was running, using
+ * the run intervals precomputed while loading the trace.
+ * Only the intervals overlapping the visible range are visited,
+ * and the ones falling inside an already drawn bin are skipped
+ * with a binary search, so at most one box per bin is drawn.
+ */
+void draw_pcpu_occupancy(struct kshark_cpp_argv *argv_c, int sd,
+                            int cpu, int draw_action)
+{
+    if (!(draw_action & KSHARK_CPU_DRAW))
+        return;
+
+    KsCppArgV *argvCpp = KS_ARGV_TO_CPP(argv_c);
+    const kshark_trace_histo *histo = argvCpp->_histo;
+    const KsPlot::Graph *graph = argvCpp->_graph;
+    if (!histo || !graph || histo->n_bins < 1)
+        return;
+
+    const struct run_interval *intervals;
+    ssize_t n_intervals = occupancy_get(cpu, &intervals);
+    int last_bin = -1;
+
+    for (ssize_t i = occupancy_find(cpu, histo->min); i < n_intervals; ++i) {
+        const struct run_interval *iv = &intervals[i];
+        if (iv->start > histo->max)
+            break;
+
+        int first_bin = ts_to_bin(histo, iv->start),
+            end_bin = ts_to_bin(histo, iv->end);
+
+        // Too short to be seen next to the previous box:
+        // jump to the first interval ending after this bin.
+        if (end_bin <= last_bin) {
+            int64_t bin_end = histo->min + (last_bin + 1) * histo->bin_size;
+            ssize_t next = occupancy_find(cpu, bin_end);
+            if (next > i + 1)
+                i = next - 1;
+            continue;
+        }
+
+        if (first_bin < last_bin)
+            first_bin = last_bin;
+
+        argvCpp->_shapes->push_front(make_box(graph, first_bin,
+                                                end_bin, iv->task_id));
+        last_bin = end_bin;
+    }
+}
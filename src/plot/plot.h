@@ -0,0 +1,52 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef __KSXT_PLOT
+#define __KSXT_PLOT
+
+// KernelShark.v2-Beta
+#include "libkshark-plugin.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// pCPU occupancy boxes | occupancy.cpp
+void draw_pcpu_occupancy(struct kshark_cpp_argv *argv_c, int sd,
+                            int cpu, int draw_action);
+
+// Credit2 time series | csched2.cpp
+void draw_csched2_series(struct kshark_cpp_argv *argv_c, int sd,
+                            int val, int draw_action);
+
+// Lossy windows | tloss.cpp
+void draw_lossy_windows(struct kshark_cpp_argv *argv_c, int sd,
+                            int cpu, int draw_action);
+
+// C-state and frequency tracks | power.cpp
+void draw_power_tracks(struct kshark_cpp_argv *argv_c, int sd,
+                        int cpu, int draw_action);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
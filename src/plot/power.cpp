@@ -0,0 +1,134 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include <algorithm>
+
+// KernelShark.v2-Beta
+#include "KsPlugins.hpp"
+
+#include "plot.h"
+#include "common.hpp"
+#include "analysis/analysis.h"
+
+// Height of a track, relative to the graph
+#define TRACK_HEIGHT_DIV 8
+// States drawn per track
+#define MAX_STATES 32
+
+static KsPlot::Color state_color(enum power_kind kind, int rank, int n_states,
+                                    uint32_t state)
+{
+    if (kind == POWER_CSTATE) {
+        // Deeper C-states are darker
+        int shade = 200 - 40 * (int)state;
+        shade = (shade < 40) ? 40 : shade;
+        return KsPlot::Color(shade, shade, shade);
+    }
+
+    // Lower frequencies are blue, higher ones red
+    int red = (n_states > 1) ? 255 * rank / (n_states - 1) : 255;
+    return KsPlot::Color(red, 0x40, 255 - red);
+}
+
+static void push_box(KsCppArgV *argvCpp, const KsPlot::Graph *graph,
+                        int first_bin, int last_bin, int y0, int y1,
+                        const KsPlot::Color &color)
+{
+    KsPlot::Rectangle *box = new KsPlot::Rectangle;
+    box->setPoint(0, graph->bin(first_bin)._base.x(), y0);
+    box->setPoint(1, graph->bin(first_bin)._base.x(), y1);
+    box->setPoint(2, graph->bin(last_bin)._base.x(), y1);
+    box->setPoint(3, graph->bin(last_bin)._base.x(), y0);
+    box->setFill(true);
+    box->_color = color;
+    argvCpp->_shapes->push_front(box);
+}
+
+/**
+ * Draws a state track between "y0" and "y1". Each bin takes the
+ * state in which the pCPU spent most of it (residency from the
+ * prefix sums), and adjacent bins with the same state are merged.
+ * C0 is not drawn.
+ */
+static void draw_track(KsCppArgV *argvCpp, int cpu, enum power_kind kind,
+                        int y0, int y1)
+{
+    const kshark_trace_histo *histo = argvCpp->_histo;
+    const KsPlot::Graph *graph = argvCpp->_graph;
+
+    uint32_t states[MAX_STATES];
+    int n_states = std::min(power_states(cpu, kind, states, MAX_STATES), MAX_STATES);
+    if (!n_states)
+        return;
+
+    std::sort(states, states + n_states);
+
+    int curr = -1,
+        first_bin = 0;
+    for (int bin = 0; bin <= histo->n_bins; ++bin) {
+        int best = -1;
+        if (bin < histo->n_bins) {
+            int64_t from = histo->min + (int64_t)bin * histo->bin_size,
+                    best_time = 0;
+            for (int s = 0; s < n_states; ++s) {
+                int64_t t = power_residency(cpu, kind, states[s],
+                                            from, from + histo->bin_size);
+                if (t > best_time) {
+                    best_time = t;
+                    best = s;
+                }
+            }
+        }
+
+        if (best == curr)
+            continue;
+
+        if (curr >= 0 && !(kind == POWER_CSTATE && states[curr] == 0))
+            push_box(argvCpp, graph, first_bin, bin - 1, y0, y1,
+                        state_color(kind, curr, n_states, states[curr]));
+
+        curr = best;
+        first_bin = bin;
+    }
+}
+
+/**
+ * Draws, at the top of a pCPU graph, the C-state
+ * track and below it the frequency track.
+ */
+void draw_power_tracks(struct kshark_cpp_argv *argv_c, int sd,
+                        int cpu, int draw_action)
+{
+    if (!(draw_action & KSHARK_CPU_DRAW))
+        return;
+
+    KsCppArgV *argvCpp = KS_ARGV_TO_CPP(argv_c);
+    const kshark_trace_histo *histo = argvCpp->_histo;
+    const KsPlot::Graph *graph = argvCpp->_graph;
+    if (!histo || !graph || histo->n_bins < 1)
+        return;
+
+    int top = graph->bin(0)._base.y() - graph->height(),
+        height = graph->height() / TRACK_HEIGHT_DIV;
+
+    draw_track(argvCpp, cpu, POWER_CSTATE, top + height, top);
+    draw_track(argvCpp, cpu, POWER_FREQ, top + 2 * height, top + height);
+}
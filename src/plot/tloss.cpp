@@ -0,0 +1,91 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+// KernelShark.v2-Beta
+#include "KsPlugins.hpp"
+
+#include "plot.h"
+#include "common.hpp"
+#include "analysis/analysis.h"
+
+/**
+ * Registers (once) the data collection of the lossy windows of a
+ * pCPU, so that searches and other plugins can use or skip them.
+ */
+static void register_lossy_collection(const kshark_trace_histo *histo,
+                                        int sd, int cpu)
+{
+    kshark_context *kshark_ctx = nullptr;
+    if (!kshark_instance(&kshark_ctx) || !histo->data)
+        return;
+
+    if (kshark_find_data_collection(kshark_ctx->collections,
+                                    tloss_match_lossy, sd, &cpu, 1))
+        return;
+
+    kshark_register_data_collection(kshark_ctx, histo->data, histo->data_size,
+                                    tloss_match_lossy, sd, &cpu, 1, 0);
+}
+
+/**
+ * Highlights on the pCPU graphs the windows in which records were lost.
+ */
+void draw_lossy_windows(struct kshark_cpp_argv *argv_c, int sd,
+                            int cpu, int draw_action)
+{
+    if (!(draw_action & KSHARK_CPU_DRAW))
+        return;
+
+    KsCppArgV *argvCpp = KS_ARGV_TO_CPP(argv_c);
+    const kshark_trace_histo *histo = argvCpp->_histo;
+    const KsPlot::Graph *graph = argvCpp->_graph;
+    if (!histo || !graph || histo->n_bins < 1)
+        return;
+
+    const struct loss_window *windows;
+    ssize_t n_windows = tloss_windows(cpu, &windows);
+    if (!n_windows)
+        return;
+
+    register_lossy_collection(histo, sd, cpu);
+
+    int y0 = graph->bin(0)._base.y(),
+        y1 = y0 - graph->height();
+
+    for (ssize_t i = 0; i < n_windows; ++i) {
+        if (windows[i].end < histo->min)
+            continue;
+        if (windows[i].start > histo->max)
+            break;
+
+        int x0 = ts_to_x(histo, graph, windows[i].start),
+            x1 = ts_to_x(histo, graph, windows[i].end);
+
+        KsPlot::Rectangle *box = new KsPlot::Rectangle;
+        box->setPoint(0, x0, y0);
+        box->setPoint(1, x0, y1);
+        box->setPoint(2, x1 + 1, y1);
+        box->setPoint(3, x1 + 1, y0);
+        box->setFill(false);
+        box->_color = KsPlot::Color(0xff, 0x00, 0x00);
+        argvCpp->_shapes->push_front(box);
+    }
+}
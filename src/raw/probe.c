@@ -0,0 +1,224 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef _GNU_SOURCE
+/** Use GNU C Library. */
+#define _GNU_SOURCE
+#endif // _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Xen Project
+#include <trace.h>
+
+#include "xtraw.h"
+
+/*
+ * Validates the first windows of a trace and samples its end,
+ * reading a fixed amount of data whatever the size of the file.
+ */
+
+// Records and bytes sampled, pCPUs and TSCs seen
+struct sample {
+    uint64_t records,
+             bytes,
+             min_tsc,
+             max_tsc;
+    int max_cpu;
+    bool truncated;
+};
+
+static ssize_t read_at(int fd, uint8_t *buf, size_t len, off_t offset)
+{
+    size_t done = 0;
+    while (done < len) {
+        ssize_t ret = pread(fd, buf + done, len - done, offset + done);
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret <= 0)
+            return ret ? -errno : (ssize_t)done;
+        done += ret;
+    }
+    return done;
+}
+
+static bool is_cpu_change(const struct xtr_record *rec)
+{
+    return rec->id == TRC_TRACE_CPU_CHANGE && rec->n_extra >= 2 &&
+            rec->extra[0] < XTR_MAX_CPUS;
+}
+
+/**
+ * Walks the windows in "buf" (starting at "file_off" in a file of
+ * "file_size" bytes) up to "max_windows" or to the end of the buffer.
+ * Returns the number of windows, or -1 if the data is not well formed.
+ */
+static int walk_windows(const uint8_t *buf, size_t len, uint64_t file_off,
+                        uint64_t file_size, int max_windows, struct sample *s)
+{
+    size_t pos = 0;
+    int n = 0;
+
+    while (pos < len && n < max_windows) {
+        struct xtr_record rec;
+        if (xtr_parse_record(buf + pos, len - pos, &rec) < 0)
+            break;
+        if (!is_cpu_change(&rec))
+            return -1;
+
+        int cpu = rec.extra[0];
+        uint64_t end = pos + rec.size + (uint64_t)rec.extra[1],
+                 last_tsc = 0;
+        if (file_off + end > file_size)
+            s->truncated = true;
+
+        s->max_cpu = (cpu > s->max_cpu) ? cpu : s->max_cpu;
+        s->bytes += rec.size;
+        pos += rec.size;
+        n++;
+
+        // Records of the window (in the buffer)
+        size_t limit = (end < len) ? end : len;
+        while (pos < limit) {
+            if (xtr_parse_record(buf + pos, limit - pos, &rec) < 0) {
+                // A record may only be cut by the buffer
+                if (limit == end)
+                    return -1;
+                return n;
+            }
+            if (rec.id == TRC_TRACE_CPU_CHANGE)
+                return -1;
+
+            // The records of a window are sorted by time
+            if (rec.has_tsc) {
+                if (rec.tsc < last_tsc)
+                    return -1;
+                last_tsc = rec.tsc;
+
+                if (!s->min_tsc || rec.tsc < s->min_tsc)
+                    s->min_tsc = rec.tsc;
+                if (rec.tsc > s->max_tsc)
+                    s->max_tsc = rec.tsc;
+            }
+            s->records++;
+            s->bytes += rec.size;
+            pos += rec.size;
+        }
+    }
+
+    return n;
+}
+
+/**
+ * Finds the first window header of the tail from which the windows
+ * chain up to its end, and walks them.
+ */
+static int sample_tail(const uint8_t *buf, size_t len, uint64_t file_off,
+                        uint64_t file_size, struct sample *s)
+{
+    for (size_t pos = 0; pos + XTR_CPU_CHANGE_SIZE <= len; pos += sizeof(uint32_t)) {
+        struct xtr_record rec;
+        if (xtr_parse_record(buf + pos, len - pos, &rec) < 0 || !is_cpu_change(&rec))
+            continue;
+
+        struct sample tmp = { .max_cpu = -1 };
+        if (walk_windows(buf + pos, len - pos, file_off + pos, file_size,
+                            INT32_MAX, &tmp) > 0 && tmp.records) {
+            *s = tmp;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * Checks that "path" starts with well formed XenTrace windows and
+ * estimates its content from its first and last bytes.
+ * Returns 0 on success, -EINVAL if the file is not a XenTrace trace,
+ * -EBADMSG if it is corrupted or a negative errno.
+ */
+int xtr_probe(const char *path, struct xtr_probe *probe)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -errno;
+
+    struct stat st;
+    uint8_t *buf = NULL;
+    int ret = -errno;
+    if (fstat(fd, &st) < 0)
+        goto out;
+
+    ret = -ENOMEM;
+    size_t tail_len = (st.st_size < XTR_PROBE_TAIL) ? st.st_size : XTR_PROBE_TAIL,
+           // The tail is read from up to 3 bytes earlier (aligned)
+           buf_size = tail_len + sizeof(uint32_t) - 1;
+    if (buf_size < XTR_PROBE_HEAD)
+        buf_size = XTR_PROBE_HEAD;
+    if (!(buf = malloc(buf_size)))
+        goto out;
+
+    // Start of the file
+    ssize_t len = read_at(fd, buf, XTR_PROBE_HEAD, 0);
+    ret = (len < 0) ? len : -EINVAL;
+    if (len < XTR_CPU_CHANGE_SIZE)
+        goto out;
+
+    struct xtr_record rec;
+    if (xtr_parse_record(buf, len, &rec) < 0 || !is_cpu_change(&rec))
+        goto out;
+
+    struct sample head = { .max_cpu = -1 };
+    ret = -EBADMSG;
+    if (walk_windows(buf, len, 0, st.st_size, XTR_PROBE_WINDOWS, &head) < 1 ||
+            !head.records)
+        goto out;
+
+    // End of the file (4 bytes aligned)
+    uint64_t tail_off = (st.st_size - tail_len) & ~3ULL;
+    len = read_at(fd, buf, st.st_size - tail_off, tail_off);
+    struct sample tail = head;
+    if (len < 0 || (tail_off && sample_tail(buf, len, tail_off, st.st_size, &tail)))
+        tail = head;
+
+    *probe = (struct xtr_probe) {
+        .file_size = st.st_size,
+        .n_cpus = ((head.max_cpu > tail.max_cpu) ? head.max_cpu : tail.max_cpu) + 1,
+        .first_tsc = head.min_tsc,
+        .last_tsc = (tail.max_tsc > head.max_tsc) ? tail.max_tsc : head.max_tsc,
+        .est_records = st.st_size * (head.records + tail.records) /
+                        (head.bytes + tail.bytes),
+        .truncated = head.truncated || tail.truncated
+    };
+    ret = 0;
+
+out:
+    free(buf);
+    close(fd);
+    return ret;
+}
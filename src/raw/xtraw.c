@@ -0,0 +1,203 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef _GNU_SOURCE
+/** Use GNU C Library. */
+#define _GNU_SOURCE
+#endif // _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Xen Project
+#include <trace.h>
+
+#include "xtraw.h"
+// USDT probes
+#include "stats/probes.h"
+
+/**
+ * Maps a trace file in memory (read-only).
+ */
+int xtr_open(struct xtr_file *file, const char *path)
+{
+    memset(file, 0, sizeof(*file));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -errno;
+
+    struct stat st;
+    if (fstat(fd, &st) || !st.st_size) {
+        close(fd);
+        return -EINVAL;
+    }
+
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return -errno;
+
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    file->data = data;
+    file->size = st.st_size;
+    return 0;
+}
+
+void xtr_close(struct xtr_file *file)
+{
+    if (file->data)
+        munmap((void *)file->data, file->size);
+    memset(file, 0, sizeof(*file));
+}
+
+/**
+ * Decodes the record at "data" (no more than "avail" bytes).
+ * Returns the size of the record, or -1 if it is truncated.
+ * The TSC is left untouched when the record does not carry one.
+ */
+int xtr_parse_record(const uint8_t *data, size_t avail, struct xtr_record *rec)
+{
+    uint32_t header;
+    if (avail < sizeof(header))
+        return -1;
+    memcpy(&header, data, sizeof(header));
+
+    rec->id = TRC_HD_TO_EVENT(header);
+    rec->n_extra = TRC_HD_EXTRA(header);
+    rec->has_tsc = TRC_HD_INCLUDES_CYCLE_COUNT(header);
+    rec->size = sizeof(uint32_t) * (1 + 2 * rec->has_tsc + rec->n_extra);
+    if (rec->size > avail)
+        return -1;
+
+    data += sizeof(header);
+    if (rec->has_tsc) {
+        uint32_t tsc[2];
+        memcpy(tsc, data, sizeof(tsc));
+        rec->tsc = ((uint64_t)tsc[1] << 32) | tsc[0];
+        data += sizeof(tsc);
+    }
+
+    memcpy(rec->extra, data, rec->n_extra * sizeof(uint32_t));
+    memset(rec->extra + rec->n_extra, 0,
+            (TRACE_EXTRA_MAX - rec->n_extra) * sizeof(uint32_t));
+
+    return rec->size;
+}
+
+int xtr_cursor_init(struct xtr_cursor *cur, const struct xtr_file *file, uint64_t offset)
+{
+    memset(cur, 0, sizeof(*cur));
+    cur->file = file;
+    cur->pos = cur->window_end = offset;
+    return 0;
+}
+
+/**
+ * Reads the TRC_TRACE_CPU_CHANGE record at the current position.
+ * Returns 1 on success, 0 at the end of the file
+ * and -1 if the position does not hold a window.
+ * A truncated window is clamped to the end of the file.
+ */
+int xtr_next_window(struct xtr_cursor *cur, struct xtr_window *win)
+{
+    const struct xtr_file *file = cur->file;
+    if (cur->pos >= file->size)
+        return 0;
+
+    struct xtr_record rec;
+    if (xtr_parse_record(file->data + cur->pos, file->size - cur->pos, &rec) < 0 ||
+            rec.id != TRC_TRACE_CPU_CHANGE || rec.n_extra < 2)
+        return -1;
+
+    win->cpu = rec.extra[0];
+    win->offset = cur->pos;
+    win->size = rec.extra[1];
+
+    cur->cpu = win->cpu;
+    cur->pos += rec.size;
+    cur->window_end = cur->pos + win->size;
+    if (cur->window_end > file->size)
+        cur->window_end = file->size;
+
+    return 1;
+}
+
+static uint64_t *cpu_last_tsc(struct xtr_cursor *cur, int cpu)
+{
+    if (cpu >= cur->n_cpus) {
+        int n_cpus = cpu + 1;
+        uint64_t *tmp = realloc(cur->last_tsc, n_cpus * sizeof(*tmp));
+        if (!tmp)
+            return NULL;
+
+        memset(tmp + cur->n_cpus, 0, (n_cpus - cur->n_cpus) * sizeof(*tmp));
+        cur->last_tsc = tmp;
+        cur->n_cpus = n_cpus;
+    }
+
+    return &cur->last_tsc[cpu];
+}
+
+/**
+ * Reads the next record, in file order.
+ * Returns 1 on success, 0 at the end of the file
+ * and -1 if the file is corrupted or truncated.
+ */
+int xtr_next(struct xtr_cursor *cur, struct xtr_record *rec)
+{
+    const struct xtr_file *file = cur->file;
+
+    while (cur->pos >= cur->window_end) {
+        struct xtr_window win;
+        int ret = xtr_next_window(cur, &win);
+        if (ret < 1)
+            return ret;
+    }
+
+    uint64_t *last_tsc = cpu_last_tsc(cur, cur->cpu);
+    if (!last_tsc)
+        return -1;
+
+    rec->tsc = *last_tsc;
+    if (xtr_parse_record(file->data + cur->pos, cur->window_end - cur->pos, rec) < 0)
+        return -1;
+
+    rec->cpu = cur->cpu;
+    rec->offset = cur->pos;
+    *last_tsc = rec->tsc;
+    cur->pos += rec->size;
+    XT_PROBE4(raw__record, rec->offset, rec->id, rec->cpu, rec->tsc);
+    return 1;
+}
+
+void xtr_cursor_free(struct xtr_cursor *cur)
+{
+    free(cur->last_tsc);
+    cur->last_tsc = NULL;
+    cur->n_cpus = 0;
+}
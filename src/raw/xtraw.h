@@ -0,0 +1,129 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef __KSXT_RAW
+#define __KSXT_RAW
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Sequential reader of the raw XenTrace binary format.
+ *
+ * The file is a sequence of per-CPU windows, each one starting with a
+ * TRC_TRACE_CPU_CHANGE record (cpu, window size in bytes) and followed
+ * by the "t_rec" records of that CPU. The reader maps the file and
+ * walks it without allocating or sorting anything.
+ */
+
+// Size of the TRC_TRACE_CPU_CHANGE record (header + 2 extra words)
+#define XTR_CPU_CHANGE_SIZE 12
+
+// Read-only mapping of a trace file
+struct xtr_file {
+    const uint8_t *data;
+    size_t size;
+};
+
+// A single record
+struct xtr_record {
+    // Event id (28 bits)
+    uint32_t id;
+    // Number of extra words
+    uint8_t n_extra;
+    // Whether the record carries its own TSC
+    uint8_t has_tsc;
+    // pCPU of the window containing the record
+    uint16_t cpu;
+    // TSC of the record (inherited from the previous
+    // record of the same pCPU when "has_tsc" is 0)
+    uint64_t tsc;
+    uint32_t extra[7];
+    // Position and size (in bytes) inside the file
+    uint64_t offset;
+    uint32_t size;
+};
+
+// A per-CPU window (TRC_TRACE_CPU_CHANGE + records)
+struct xtr_window {
+    uint16_t cpu;
+    // Offset of the TRC_TRACE_CPU_CHANGE record
+    uint64_t offset;
+    // Size of the records following it
+    uint32_t size;
+};
+
+// Iteration state (one per caller)
+struct xtr_cursor {
+    const struct xtr_file *file;
+    uint64_t pos,
+             window_end;
+    uint16_t cpu;
+    // Last TSC of each pCPU
+    uint64_t *last_tsc;
+    int n_cpus;
+};
+
+int xtr_open(struct xtr_file *file, const char *path);
+void xtr_close(struct xtr_file *file);
+
+int xtr_cursor_init(struct xtr_cursor *cur, const struct xtr_file *file, uint64_t offset);
+int xtr_next_window(struct xtr_cursor *cur, struct xtr_window *win);
+int xtr_next(struct xtr_cursor *cur, struct xtr_record *rec);
+void xtr_cursor_free(struct xtr_cursor *cur);
+
+int xtr_parse_record(const uint8_t *data, size_t avail, struct xtr_record *rec);
+
+//
+// Quick look at a trace file | probe.c
+//
+
+// Bytes read at the start and at the end of the file
+#define XTR_PROBE_HEAD (64 * 1024)
+#define XTR_PROBE_TAIL (256 * 1024)
+// Windows validated at the start of the file
+#define XTR_PROBE_WINDOWS 16
+#define XTR_MAX_CPUS 4096
+
+// Estimate of the content of a trace
+struct xtr_probe {
+    uint64_t file_size;
+    int n_cpus;
+    // TSCs of the first (start) and last (end) records sampled
+    uint64_t first_tsc,
+             last_tsc;
+    uint64_t est_records;
+    // Whether the last window goes past the end of the file
+    bool truncated;
+};
+
+int xtr_probe(const char *path, struct xtr_probe *probe);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,220 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef _GNU_SOURCE
+/** Use GNU C Library. */
+#define _GNU_SOURCE
+#endif // _GNU_SOURCE
+
+#include <inttypes.h>
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "stats.h"
+
+#define NS_PER_SEC 1000000000ULL
+
+static const char *phase_names[LDSTAT_N_PHASES] = {
+    [LDSTAT_XTP_INIT]       = "xtp_init",
+    [LDSTAT_XTP_EXECUTE]    = "xtp_execute",
+    [LDSTAT_STORE]          = "store",
+    [LDSTAT_PREVIEW]        = "preview",
+    [LDSTAT_ENV]            = "read_env_vars",
+    [LDSTAT_LOAD]           = "load_entries",
+    [LDSTAT_ROWS_ALLOC]     = "rows_alloc",
+    [LDSTAT_TSC]            = "tsc_to_ns",
+    [LDSTAT_ANALYSES]       = "analyses",
+    [LDSTAT_TASKS]          = "hash_id_add",
+    [LDSTAT_INDEXES]        = "indexes",
+    [LDSTAT_FINISH]         = "finish",
+    [LDSTAT_REPORTS]        = "reports",
+    [LDSTAT_RAW_SCAN]       = "raw_scan",
+    [LDSTAT_DRAW_OCCUPANCY] = "draw_occupancy",
+    [LDSTAT_DRAW_CSCHED2]   = "draw_csched2",
+    [LDSTAT_DRAW_LOSS]      = "draw_loss",
+    [LDSTAT_DRAW_POWER]     = "draw_power"
+};
+
+static const char *mem_names[LDSTAT_N_MEMS] = {
+    [LDSTAT_MEM_PARSER]   = "parser",
+    [LDSTAT_MEM_STORE]    = "store",
+    [LDSTAT_MEM_ROWS]     = "rows",
+    [LDSTAT_MEM_ANALYSES] = "analyses",
+    [LDSTAT_MEM_RAW_SCAN] = "raw_scan"
+};
+
+static struct {
+    bool enabled;
+    // Time of "ldstat_init" and delay of the first draw call
+    uint64_t origin,
+             first_draw;
+    struct ldstat_counter phases[LDSTAT_N_PHASES];
+    int64_t mems[LDSTAT_N_MEMS];
+} S;
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+/**
+ * Resets the counters. Nothing is measured unless "enabled".
+ */
+void ldstat_init(bool enabled)
+{
+    memset(&S, 0, sizeof(S));
+    S.enabled = enabled;
+    S.origin = enabled ? now_ns() : 0;
+}
+
+bool ldstat_enabled()
+{
+    return S.enabled;
+}
+
+/**
+ * Returns the start time of a phase (0 if disabled).
+ */
+uint64_t ldstat_begin()
+{
+    return S.enabled ? now_ns() : 0;
+}
+
+/**
+ * Accounts the time elapsed since "begin" to "phase" and returns
+ * the current time, so that it can begin the next phase.
+ */
+uint64_t ldstat_lap(enum ldstat_phase phase, uint64_t begin)
+{
+    if (!begin)
+        return 0;
+
+    uint64_t now = now_ns(),
+             elapsed = now - begin;
+    struct ldstat_counter *c = &S.phases[phase];
+    if (!c->calls)
+        c->first_ns = elapsed;
+    if (elapsed > c->max_ns)
+        c->max_ns = elapsed;
+    c->ns += elapsed;
+    c->calls++;
+
+    if (phase >= LDSTAT_DRAW_OCCUPANCY && !S.first_draw)
+        S.first_draw = begin - S.origin;
+    return now;
+}
+
+void ldstat_end(enum ldstat_phase phase, uint64_t begin)
+{
+    ldstat_lap(phase, begin);
+}
+
+/**
+ * Returns the bytes in use on the heap (0 if disabled).
+ * Only the main arena is accounted.
+ */
+uint64_t ldstat_heap()
+{
+    if (!S.enabled)
+        return 0;
+
+    struct mallinfo2 mi = mallinfo2();
+    return mi.uordblks + mi.hblkhd;
+}
+
+/**
+ * Returns the heap bytes taken by a block (header included).
+ */
+size_t ldstat_chunk(void *ptr)
+{
+    return ptr ? malloc_usable_size(ptr) + sizeof(size_t) : 0;
+}
+
+void ldstat_mem_add(enum ldstat_mem mem, int64_t bytes)
+{
+    if (S.enabled)
+        S.mems[mem] += bytes;
+}
+
+const struct ldstat_counter *ldstat_get(enum ldstat_phase phase)
+{
+    return (phase < LDSTAT_N_PHASES) ? &S.phases[phase] : NULL;
+}
+
+const char *ldstat_phase_name(enum ldstat_phase phase)
+{
+    return (phase < LDSTAT_N_PHASES) ? phase_names[phase] : NULL;
+}
+
+int64_t ldstat_mem_get(enum ldstat_mem mem)
+{
+    return (mem < LDSTAT_N_MEMS) ? S.mems[mem] : 0;
+}
+
+const char *ldstat_mem_name(enum ldstat_mem mem)
+{
+    return (mem < LDSTAT_N_MEMS) ? mem_names[mem] : NULL;
+}
+
+/**
+ * Returns the time from "ldstat_init" to the first draw call
+ * (0 if nothing has been drawn yet).
+ */
+uint64_t ldstat_first_draw_ns()
+{
+    return S.first_draw;
+}
+
+/**
+ * Returns the peak resident set size of the process (KiB).
+ */
+long ldstat_peak_rss_kb()
+{
+    struct rusage usage;
+    return getrusage(RUSAGE_SELF, &usage) ? -1 : usage.ru_maxrss;
+}
+
+/**
+ * Writes the counters as a single line of JSON.
+ */
+void ldstat_json(FILE *fp, const char *stage)
+{
+    fprintf(fp, "{\"stage\":\"%s\",\"phases\":{", stage);
+    for (int i = 0; i < LDSTAT_N_PHASES; ++i) {
+        const struct ldstat_counter *c = &S.phases[i];
+        fprintf(fp, "%s\"%s\":{\"ns\":%"PRIu64",\"calls\":%"PRIu64",\"first_ns\":%"PRIu64
+                    ",\"max_ns\":%"PRIu64"}", i ? "," : "", phase_names[i], c->ns,
+                    c->calls, c->first_ns, c->max_ns);
+    }
+
+    fprintf(fp, "},\"heap_bytes\":{");
+    for (int i = 0; i < LDSTAT_N_MEMS; ++i)
+        fprintf(fp, "%s\"%s\":%"PRId64, i ? "," : "", mem_names[i], S.mems[i]);
+
+    fprintf(fp, "},\"first_draw_ns\":%"PRIu64",\"peak_rss_kb\":%ld}\n",
+                S.first_draw, ldstat_peak_rss_kb());
+}
@@ -0,0 +1,57 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef __KSXT_PROBES
+#define __KSXT_PROBES
+
+/*
+ * USDT probes of the "xentrace" provider. Each probe is a single
+ * NOP in the code plus a note in the ELF file, so it costs nothing
+ * until a tracer (bpftrace, "perf probe", SystemTap) attaches to it.
+ * Without <sys/sdt.h> (or with NO_SDT defined) the probes are removed.
+ */
+
+#if !defined(NO_SDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define XT_HAVE_SDT
+#endif
+#endif
+
+#ifdef XT_HAVE_SDT
+#define XT_PROBE0(_name) DTRACE_PROBE(xentrace, _name)
+#define XT_PROBE1(_name, _a1) DTRACE_PROBE1(xentrace, _name, _a1)
+#define XT_PROBE2(_name, _a1, _a2) DTRACE_PROBE2(xentrace, _name, _a1, _a2)
+#define XT_PROBE3(_name, _a1, _a2, _a3) DTRACE_PROBE3(xentrace, _name, _a1, _a2, _a3)
+#define XT_PROBE4(_name, _a1, _a2, _a3, _a4) \
+            DTRACE_PROBE4(xentrace, _name, _a1, _a2, _a3, _a4)
+#define XT_PROBE5(_name, _a1, _a2, _a3, _a4, _a5) \
+            DTRACE_PROBE5(xentrace, _name, _a1, _a2, _a3, _a4, _a5)
+#else
+#define XT_PROBE0(_name) do {} while (0)
+#define XT_PROBE1(_name, _a1) do {} while (0)
+#define XT_PROBE2(_name, _a1, _a2) do {} while (0)
+#define XT_PROBE3(_name, _a1, _a2, _a3) do {} while (0)
+#define XT_PROBE4(_name, _a1, _a2, _a3, _a4) do {} while (0)
+#define XT_PROBE5(_name, _a1, _a2, _a3, _a4, _a5) do {} while (0)
+#endif
+
+#endif
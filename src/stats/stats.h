@@ -0,0 +1,102 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef __KSXT_STATS
+#define __KSXT_STATS
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// Load-phase timers and memory accounting | loadstat.c
+//
+
+enum ldstat_phase {
+    // Plugin initialization
+    LDSTAT_XTP_INIT,
+    LDSTAT_XTP_EXECUTE,
+    LDSTAT_STORE,
+    // Whole preview (see "XEN_PREVIEW")
+    LDSTAT_PREVIEW,
+    LDSTAT_ENV,
+    // Whole "load_entries" and its parts
+    LDSTAT_LOAD,
+    LDSTAT_ROWS_ALLOC,
+    LDSTAT_TSC,
+    LDSTAT_ANALYSES,
+    LDSTAT_TASKS,
+    LDSTAT_INDEXES,
+    LDSTAT_FINISH,
+    LDSTAT_REPORTS,
+    LDSTAT_RAW_SCAN,
+    // Draw handlers of the plot plugin
+    LDSTAT_DRAW_OCCUPANCY,
+    LDSTAT_DRAW_CSCHED2,
+    LDSTAT_DRAW_LOSS,
+    LDSTAT_DRAW_POWER,
+    LDSTAT_N_PHASES
+};
+
+// Heap growth per subsystem
+enum ldstat_mem {
+    LDSTAT_MEM_PARSER,
+    LDSTAT_MEM_STORE,
+    LDSTAT_MEM_ROWS,
+    // Load-time analyses and entry indexes
+    LDSTAT_MEM_ANALYSES,
+    LDSTAT_MEM_RAW_SCAN,
+    LDSTAT_N_MEMS
+};
+
+struct ldstat_counter {
+    uint64_t ns,
+             calls,
+             // Duration of the first and of the longest call
+             first_ns,
+             max_ns;
+};
+
+void ldstat_init(bool enabled);
+bool ldstat_enabled();
+uint64_t ldstat_begin();
+uint64_t ldstat_lap(enum ldstat_phase phase, uint64_t begin);
+void ldstat_end(enum ldstat_phase phase, uint64_t begin);
+uint64_t ldstat_heap();
+size_t ldstat_chunk(void *ptr);
+void ldstat_mem_add(enum ldstat_mem mem, int64_t bytes);
+const struct ldstat_counter *ldstat_get(enum ldstat_phase phase);
+const char *ldstat_phase_name(enum ldstat_phase phase);
+int64_t ldstat_mem_get(enum ldstat_mem mem);
+const char *ldstat_mem_name(enum ldstat_mem mem);
+uint64_t ldstat_first_draw_ns();
+long ldstat_peak_rss_kb();
+void ldstat_json(FILE *fp, const char *stage);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
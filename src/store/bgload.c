@@ -0,0 +1,478 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef _GNU_SOURCE
+/** Use GNU C Library. */
+#define _GNU_SOURCE
+#endif // _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "store.h"
+// Entry indexes
+#include "index/index.h"
+// Raw trace reader
+#include "raw/xtraw.h"
+#include "stats/probes.h"
+
+// Windows scanned past the limit of a chunk, looking for the first
+// window of each pCPU that starts after it: at most the bytes of the
+// chunk before the limit (and at least SCAN_SLACK)
+#define SCAN_SLACK (16 << 20)
+// Bytes of the file parsed by each chunk of the background load
+// (after the preview) if not given, about the most a stop waits for
+#define CHUNK_BYTES (64 << 20)
+
+static struct {
+    pthread_t thread;
+    bool running,
+         // Set by "xtbg_stop", read by the thread
+         cancel;
+    char *path;
+    uint64_t chunk_bytes,
+             file_size,
+             // Bytes of the file held by the store (0 if whole)
+             preview_end,
+             // Offset the next chunk is parsed from and TSC
+             // its records must not be older than
+             resume,
+             cut;
+    // Domain running on each pCPU at the cut
+    xt_domain *doms;
+    int64_t start_ns,
+            end_ns;
+    // Written by the thread, "state" last
+    enum xtbg_state state;
+    uint64_t parsed;
+    size_t packed;
+    int n_cpus,
+        ret;
+} B;
+
+static int64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * Returns the TSC of the first record of the window the cursor
+ * has just entered carrying one ("fallback" if none does).
+ */
+static uint64_t window_tsc(const struct xtr_cursor *cur, uint64_t fallback)
+{
+    struct xtr_record rec;
+    for (uint64_t pos = cur->pos; pos < cur->window_end; pos += rec.size) {
+        if (xtr_parse_record(cur->file->data + pos, cur->window_end - pos, &rec) < 0)
+            break;
+        if (rec.has_tsc)
+            return rec.tsc;
+    }
+    return fallback;
+}
+
+/**
+ * Finds the windows of a chunk of the file, from "start": the bytes to
+ * parse ("end") and the TSC its records must be older than ("cut"),
+ * the first TSC after "from_tsc" of a window reaching the limit. As
+ * the pCPUs write their windows at different paces, the chunk then
+ * goes on up to the first window of each pCPU starting after the cut,
+ * and the next one starts from the last window of each pCPU starting
+ * before it ("resume"). Returns 1 if the chunk ends the file.
+ */
+static int find_chunk(const struct xtr_file *file, uint64_t start, uint64_t from_tsc,
+                        const struct xtbg_limit *limit, uint64_t *end, uint64_t *cut,
+                        uint64_t *resume)
+{
+    uint64_t *last_tsc = calloc(XTR_MAX_CPUS, sizeof(*last_tsc)),
+             *resume_at = malloc(XTR_MAX_CPUS * sizeof(*resume_at));
+    // 1: window seen before the cut, 2: window starting after the cut
+    uint8_t *cpus = calloc(XTR_MAX_CPUS, 1);
+    if (!(last_tsc && resume_at && cpus)) {
+        free(last_tsc);
+        free(resume_at);
+        free(cpus);
+        return -ENOMEM;
+    }
+
+    struct xtr_cursor cur;
+    struct xtr_window win;
+    uint64_t first_tsc = 0,
+             cut_offset = 0;
+    int n_seen = 0,
+        n_reached = 0,
+        ret;
+
+    *end = file->size;
+    *cut = UINT64_MAX;
+    xtr_cursor_init(&cur, file, start);
+    while ((ret = xtr_next_window(&cur, &win)) > 0) {
+        if (win.cpu >= XTR_MAX_CPUS) {
+            ret = -EINVAL;
+            break;
+        }
+
+        uint64_t tsc = last_tsc[win.cpu] = window_tsc(&cur, last_tsc[win.cpu]);
+        if (!first_tsc)
+            first_tsc = tsc;
+
+        if (*cut == UINT64_MAX) {
+            n_seen += !cpus[win.cpu];
+            cpus[win.cpu] = 1;
+            if (tsc > from_tsc && ((limit->cycles && tsc > first_tsc && tsc - first_tsc >= limit->cycles) ||
+                    (limit->bytes && win.offset >= limit->bytes))) {
+                *cut = tsc;
+                cut_offset = win.offset;
+            }
+        }
+
+        if (*cut != UINT64_MAX && cpus[win.cpu] == 1 && tsc >= *cut) {
+            cpus[win.cpu] = 2;
+            n_reached++;
+        }
+
+        uint64_t before = cut_offset - start;
+        if (*cut != UINT64_MAX && (n_reached == n_seen ||
+                win.offset - cut_offset > (before > SCAN_SLACK ? before : SCAN_SLACK))) {
+            *end = win.offset;
+            break;
+        }
+
+        // Jump to the next window
+        cur.pos = cur.window_end;
+    }
+    xtr_cursor_free(&cur);
+
+    // Knowing the cut, the windows of the chunk holding records after it
+    *resume = cut_offset;
+    if (ret >= 0 && *cut != UINT64_MAX) {
+        memset(cpus, 0, XTR_MAX_CPUS);
+        memset(last_tsc, 0, XTR_MAX_CPUS * sizeof(*last_tsc));
+        xtr_cursor_init(&cur, file, start);
+        while (xtr_next_window(&cur, &win) > 0 && win.offset < *end) {
+            uint64_t tsc = last_tsc[win.cpu] = window_tsc(&cur, last_tsc[win.cpu]);
+            // Last window before the cut, else first one after it
+            if (cpus[win.cpu] != 2) {
+                if (!cpus[win.cpu] || tsc < *cut)
+                    resume_at[win.cpu] = win.offset;
+                cpus[win.cpu] = (tsc < *cut) ? 1 : 2;
+            }
+            cur.pos = cur.window_end;
+        }
+        xtr_cursor_free(&cur);
+
+        for (int cpu = 0; cpu < XTR_MAX_CPUS; ++cpu) {
+            if (cpus[cpu] && resume_at[cpu] < *resume)
+                *resume = resume_at[cpu];
+        }
+    }
+
+    free(last_tsc);
+    free(resume_at);
+    free(cpus);
+    if (ret < 0)
+        return ret;
+    if (*end < file->size)
+        return 0;
+
+    // Up to the last record
+    *cut = UINT64_MAX;
+    return 1;
+}
+
+static void set_state(enum xtbg_state state)
+{
+    __atomic_store_n(&B.state, state, __ATOMIC_RELEASE);
+    XT_PROBE2(bgload__state, state, __atomic_load_n(&B.packed, __ATOMIC_RELAXED));
+}
+
+/**
+ * Parses the bytes of "file" from "start" to "end" (from a copy in
+ * memory) and packs their records in "slice": into the store for the
+ * preview, aside until the next "xtbg_commit" otherwise.
+ */
+static int parse_chunk(const struct xtr_file *file, uint64_t start, uint64_t end,
+                        const struct xts_slice *slice, bool preview)
+{
+    int fd = memfd_create("xentrace-chunk", MFD_CLOEXEC);
+    if (fd < 0)
+        return -errno;
+
+    for (uint64_t done = start; done < end; ) {
+        ssize_t n = write(fd, file->data + done, end - done);
+        if (n < 0) {
+            int ret = -errno;
+            close(fd);
+            return ret;
+        }
+        done += n;
+    }
+
+    char path[32];
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+    xentrace_parser parser = xtp_init(path);
+    size_t n_events = parser ? xtp_execute(parser) : 0;
+    int ret = n_events ? 0 : -ENOMEM;
+    // Entries are indexed by 32-bit positions (counting the
+    // records of the chunk older than the slice too)
+    if (!ret && __atomic_load_n(&B.packed, __ATOMIC_RELAXED) + n_events > XTI_MAX_ENTRIES)
+        ret = -EFBIG;
+
+    if (!ret) {
+        int n_cpus = xtp_cpus_count(parser);
+        if (n_cpus > B.n_cpus)
+            __atomic_store_n(&B.n_cpus, n_cpus, __ATOMIC_RELAXED);
+
+        if (preview) {
+            ret = xts_build_slice(parser, slice);
+        } else {
+            set_state(XTBG_PACKING);
+            ret = xts_build_pending(parser, slice, end, &B.packed);
+        }
+    }
+
+    if (parser)
+        xtp_free(parser);
+    close(fd);
+    return ret;
+}
+
+/**
+ * Loads the store with the records of the file up to "limit".
+ * Returns 1 (and loads nothing) if the limit covers the whole file.
+ */
+int xtbg_preview(const char *path, const struct xtbg_limit *limit, int *n_cpus)
+{
+    xtbg_stop();
+
+    struct xtr_file file;
+    int ret = xtr_open(&file, path);
+    if (ret)
+        return ret;
+
+    B.doms = malloc(XTR_MAX_CPUS * sizeof(*B.doms));
+    if (!B.doms) {
+        xtr_close(&file);
+        return -ENOMEM;
+    }
+    for (int cpu = 0; cpu < XTR_MAX_CPUS; ++cpu)
+        B.doms[cpu] = (xt_domain){ .id = XEN_DOM_DFLT, .vcpu = 0 };
+
+    uint64_t end,
+             cut,
+             resume;
+    ret = find_chunk(&file, 0, 0, limit, &end, &cut, &resume);
+    if (!ret) {
+        struct xts_slice slice = { 0, cut, B.doms, XTR_MAX_CPUS, NULL };
+        ret = parse_chunk(&file, 0, end, &slice, true);
+    }
+
+    if (!ret) {
+        B.file_size = file.size;
+        B.preview_end = B.parsed = end;
+        B.resume = resume;
+        B.cut = cut;
+        B.packed = xts_count();
+        *n_cpus = B.n_cpus;
+    } else {
+        xtbg_stop();
+    }
+
+    xtr_close(&file);
+    return ret;
+}
+
+/**
+ * Parses and packs the rest of the file, one chunk of about
+ * "chunk_bytes" at a time, each one resuming where the last one
+ * stopped (see "find_chunk").
+ */
+static int load_chunks(const struct xtr_file *file)
+{
+    uint64_t start = B.resume,
+             from_tsc = B.cut,
+             done = B.preview_end;
+    int last = 0;
+
+    while (!last) {
+        if (__atomic_load_n(&B.cancel, __ATOMIC_RELAXED))
+            return -ECANCELED;
+
+        struct xtbg_limit limit = { 0, done + B.chunk_bytes };
+        uint64_t end,
+                 cut,
+                 resume;
+        set_state(XTBG_PARSING);
+        last = find_chunk(file, start, from_tsc, &limit, &end, &cut, &resume);
+        if (last < 0)
+            return last;
+
+        struct xts_slice slice = { from_tsc, cut, B.doms, XTR_MAX_CPUS, &B.cancel };
+        int ret = parse_chunk(file, start, end, &slice, false);
+        if (ret)
+            return ret;
+
+        __atomic_store_n(&B.parsed, end, __ATOMIC_RELAXED);
+        start = resume;
+        from_tsc = cut;
+        done = end;
+    }
+    return 0;
+}
+
+static void *load(void *arg)
+{
+    struct xtr_file file;
+    int ret = xtr_open(&file, B.path);
+    if (!ret) {
+        ret = load_chunks(&file);
+        xtr_close(&file);
+    }
+
+    B.ret = ret;
+    B.end_ns = now_ns();
+    if (ret && ret != -ECANCELED)
+        fprintf(stderr, "[XenTrace WARN] Cannot load the whole trace (%s), "
+                        "only its beginning is shown.\n", strerror(-ret));
+    else if (!ret)
+        fprintf(stderr, "[XenTrace INFO] Whole trace loaded in background: %zu records "
+                        "in %.1f s, shown at the next reload of the stream.\n",
+                    B.packed, (B.end_ns - B.start_ns) / 1e9);
+    set_state(ret ? XTBG_FAILED : XTBG_READY);
+    return NULL;
+}
+
+/**
+ * Parses and packs the rest of the file on a background thread,
+ * after "xtbg_preview", in chunks of about "chunk_bytes" of the
+ * file (CHUNK_BYTES if 0).
+ */
+int xtbg_start(const char *path, uint64_t chunk_bytes)
+{
+    B.path = strdup(path);
+    if (!B.path)
+        return -ENOMEM;
+
+    B.chunk_bytes = chunk_bytes ? chunk_bytes : CHUNK_BYTES;
+    B.start_ns = now_ns();
+    B.state = XTBG_PARSING;
+    int ret = pthread_create(&B.thread, NULL, load, NULL);
+    if (ret) {
+        free(B.path);
+        B.path = NULL;
+        B.state = XTBG_IDLE;
+        return -ret;
+    }
+
+    B.running = true;
+    return 0;
+}
+
+/**
+ * Reads the progress of the background load (from any thread).
+ */
+void xtbg_progress(struct xtbg_progress *progress)
+{
+    progress->state = __atomic_load_n(&B.state, __ATOMIC_ACQUIRE);
+    progress->packed = __atomic_load_n(&B.packed, __ATOMIC_RELAXED);
+
+    bool done = progress->state == XTBG_READY || progress->state == XTBG_FAILED;
+    progress->elapsed_ns = (progress->state == XTBG_IDLE) ? 0 :
+                            (done ? B.end_ns : now_ns()) - B.start_ns;
+
+    uint64_t parsed = __atomic_load_n(&B.parsed, __ATOMIC_RELAXED);
+    progress->parsed = (progress->state == XTBG_IDLE || !B.file_size) ? 1.0 :
+                        (double)parsed / B.file_size;
+}
+
+static void join()
+{
+    if (B.running)
+        pthread_join(B.thread, NULL);
+
+    B.running = false;
+    free(B.path);
+    B.path = NULL;
+}
+
+/**
+ * Appends the records packed by the background load since the last
+ * call to the ones of the store. Returns 1 if some have been appended
+ * (and sets "n_cpus"), 0 if there is nothing to append (yet) or a
+ * negative errno if the background load failed.
+ */
+int xtbg_commit(int *n_cpus)
+{
+    if (!B.running)
+        return 0;
+
+    // Read before the records, all there once the load is over
+    enum xtbg_state state = __atomic_load_n(&B.state, __ATOMIC_ACQUIRE);
+    uint64_t mark = 0;
+    ssize_t n = xts_commit(&mark);
+    if (n > 0)
+        *n_cpus = __atomic_load_n(&B.n_cpus, __ATOMIC_RELAXED);
+    if (n >= 0 && mark)
+        B.preview_end = (mark >= B.file_size) ? 0 : mark;
+
+    if (state == XTBG_READY || state == XTBG_FAILED) {
+        join();
+        B.state = XTBG_IDLE;
+        if (state == XTBG_FAILED && n <= 0)
+            return B.ret;
+    }
+
+    return (n < 0) ? (int)n : (n > 0);
+}
+
+/**
+ * Returns the bytes of the file held by the store,
+ * 0 if it holds the whole file.
+ */
+uint64_t xtbg_preview_end()
+{
+    return B.preview_end;
+}
+
+/**
+ * Stops the background load and forgets the preview. The parser
+ * cannot be interrupted: this waits for the parse of the current
+ * chunk (about "chunk_bytes" of the file), while the packing stops
+ * at once.
+ */
+void xtbg_stop()
+{
+    __atomic_store_n(&B.cancel, true, __ATOMIC_RELAXED);
+    join();
+    xts_drop_pending();
+    free(B.doms);
+    memset(&B, 0, sizeof(B));
+}
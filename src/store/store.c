@@ -0,0 +1,405 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef _GNU_SOURCE
+/** Use GNU C Library. */
+#define _GNU_SOURCE
+#endif // _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "store.h"
+
+// Records per TSC base
+#define BLOCK_SHIFT 8
+#define ARENA_INIT_SIZE (1 << 20)
+// Bytes of a packed record with no extras and a 32-bit TSC delta
+#define RECORD_MIN_SIZE 14
+#define RECORD_MAX_SIZE (RECORD_MIN_SIZE + 4 + 7 * sizeof(uint32_t))
+// Records packed between two updates of the progress
+#define PROGRESS_STEP 4096
+
+// Header word: id (28 bits), extra words (3 bits), 64-bit TSC flag
+#define HDR_ID_MASK 0x0fffffffu
+#define HDR_EXTRA_SHIFT 28
+#define HDR_WIDE_TSC (1u << 31)
+
+/*
+ * Packed records, one after the other in a byte arena:
+ * header word, pCPU (16 bits), domain/vCPU (32 bits), TSC (32-bit
+ * delta from the base of the block of the record, or 64 bits when it
+ * does not fit) and only the extra words up to the last non-zero one.
+ * A record is found by its 40-bit offset (32 low bits + 8 high bits),
+ * and decoded on its own.
+ */
+struct records {
+    uint8_t *arena;
+    size_t arena_size,
+           arena_cap;
+    uint32_t *off_lo;
+    uint8_t *off_hi;
+    // TSC of the first record of each block
+    uint64_t *tsc_base;
+    size_t size;
+    // Position of the first record and offset of the start of the
+    // arena (0 but for "xts_build_at")
+    size_t first;
+    uint64_t arena_off;
+};
+
+// Records read by "xts_get" and records built
+// by a background load ("xts_build_pending")
+static struct records R,
+                      P;
+// Guards "P" and the mark of its last chunk
+static pthread_mutex_t pending_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t pending_mark;
+
+static void put(uint8_t **p, const void *val, size_t size)
+{
+    memcpy(*p, val, size);
+    *p += size;
+}
+
+static int append(struct records *s, size_t pos, const xt_event *event)
+{
+    if (s->arena_size + RECORD_MAX_SIZE > s->arena_cap) {
+        size_t cap = s->arena_cap ? s->arena_cap * 2 : ARENA_INIT_SIZE;
+        uint8_t *tmp = realloc(s->arena, cap);
+        if (!tmp)
+            return -ENOMEM;
+        s->arena = tmp;
+        s->arena_cap = cap;
+    }
+
+    const xt_record *rec = &event->rec;
+    size_t block = (pos >> BLOCK_SHIFT) - (s->first >> BLOCK_SHIFT),
+           i = pos - s->first;
+    if (!(pos & ((1 << BLOCK_SHIFT) - 1)) || pos == s->first)
+        s->tsc_base[block] = rec->tsc;
+
+    uint32_t n_extra = 7;
+    while (n_extra && !rec->extra[n_extra - 1])
+        --n_extra;
+
+    uint64_t delta = rec->tsc - s->tsc_base[block];
+    bool wide = rec->tsc < s->tsc_base[block] || delta > UINT32_MAX;
+    uint32_t hdr = (rec->id & HDR_ID_MASK) | (n_extra << HDR_EXTRA_SHIFT) |
+                    (wide ? HDR_WIDE_TSC : 0),
+             delta32 = delta;
+    uint16_t cpu = event->cpu;
+
+    uint64_t offset = s->arena_off + s->arena_size;
+    s->off_lo[i] = offset;
+    s->off_hi[i] = offset >> 32;
+
+    uint8_t *p = s->arena + s->arena_size;
+    put(&p, &hdr, sizeof(hdr));
+    put(&p, &cpu, sizeof(cpu));
+    put(&p, &(event->dom).u32, sizeof(uint32_t));
+    if (wide)
+        put(&p, &rec->tsc, sizeof(uint64_t));
+    else
+        put(&p, &delta32, sizeof(delta32));
+    put(&p, rec->extra, n_extra * sizeof(uint32_t));
+
+    s->arena_size = p - s->arena;
+    return 0;
+}
+
+static void free_records(struct records *s)
+{
+    free(s->arena);
+    free(s->off_lo);
+    free(s->off_hi);
+    free(s->tsc_base);
+    memset(s, 0, sizeof(*s));
+}
+
+// Makes room for the offsets and the TSC bases of "capacity" records
+static int reserve(struct records *s, size_t capacity)
+{
+    size_t n_blocks = (capacity >> BLOCK_SHIFT) + 2;
+    uint32_t *off_lo = realloc(s->off_lo, (capacity ? capacity : 1) * sizeof(*off_lo));
+    if (off_lo)
+        s->off_lo = off_lo;
+    uint8_t *off_hi = realloc(s->off_hi, capacity ? capacity : 1);
+    if (off_hi)
+        s->off_hi = off_hi;
+    uint64_t *tsc_base = realloc(s->tsc_base, n_blocks * sizeof(*tsc_base));
+    if (tsc_base)
+        s->tsc_base = tsc_base;
+
+    return (off_lo && off_hi && tsc_base) ? 0 : -ENOMEM;
+}
+
+// Gives back the unused capacity of the arena
+static void shrink(struct records *s)
+{
+    uint8_t *tmp = realloc(s->arena, s->arena_size ? s->arena_size : 1);
+    if (tmp) {
+        s->arena = tmp;
+        s->arena_cap = s->arena_size;
+    }
+}
+
+static const xt_event *decode(const struct records *s, size_t pos, xt_event *buf)
+{
+    size_t i = pos - s->first;
+    const uint8_t *p = s->arena + ((((uint64_t)s->off_hi[i] << 32) | s->off_lo[i]) - s->arena_off);
+    uint32_t hdr,
+             delta32;
+    uint16_t cpu;
+
+    memset(buf, 0, sizeof(*buf));
+    memcpy(&hdr, p, sizeof(hdr));
+    memcpy(&cpu, p + 4, sizeof(cpu));
+    memcpy(&(buf->dom).u32, p + 6, sizeof(uint32_t));
+    p += 10;
+
+    buf->cpu = cpu;
+    xt_record *rec = &buf->rec;
+    rec->id = hdr & HDR_ID_MASK;
+    if (hdr & HDR_WIDE_TSC) {
+        memcpy(&rec->tsc, p, sizeof(uint64_t));
+        p += sizeof(uint64_t);
+    } else {
+        memcpy(&delta32, p, sizeof(delta32));
+        rec->tsc = s->tsc_base[(pos >> BLOCK_SHIFT) - (s->first >> BLOCK_SHIFT)] + delta32;
+        p += sizeof(delta32);
+    }
+
+    memcpy(rec->extra, p, ((hdr >> HDR_EXTRA_SHIFT) & 7) * sizeof(uint32_t));
+    return buf;
+}
+
+/**
+ * Packs the records of an executed parser in the TSC range of
+ * "slice" (all if NULL), in order from position "first" and arena
+ * offset "arena_off", publishing the number of records packed
+ * (added to the one found) in "packed" (if not NULL).
+ */
+static int build(struct records *s, xentrace_parser parser, const struct xts_slice *slice,
+                    size_t first, uint64_t arena_off, size_t *packed)
+{
+    free_records(s);
+    s->first = first;
+    s->arena_off = arena_off;
+
+    size_t capacity = xtp_events_count(parser),
+           base = packed ? *packed : 0;
+    uint64_t from_tsc = slice ? slice->from_tsc : 0,
+             until_tsc = slice ? slice->until_tsc : UINT64_MAX;
+    if (reserve(s, capacity))
+        goto error;
+
+    xt_event *event,
+             fixed;
+    while (s->size < capacity && (event = xtp_next_event(parser))) {
+        if ((event->rec).tsc < from_tsc || (event->rec).tsc >= until_tsc)
+            continue;
+
+        // Domain running since before the slice
+        if (slice && slice->doms && event->cpu < slice->n_doms) {
+            if ((event->dom).id == XEN_DOM_DFLT) {
+                fixed = *event;
+                fixed.dom = slice->doms[event->cpu];
+                event = &fixed;
+            }
+            slice->doms[event->cpu] = event->dom;
+        }
+
+        // 40-bit offsets
+        if ((s->arena_off + s->arena_size) >> 40 || append(s, first + s->size, event))
+            goto error;
+        if (++s->size % PROGRESS_STEP)
+            continue;
+
+        if (packed)
+            __atomic_store_n(packed, base + s->size, __ATOMIC_RELAXED);
+        if (slice && slice->cancel && __atomic_load_n(slice->cancel, __ATOMIC_RELAXED)) {
+            free_records(s);
+            return -ECANCELED;
+        }
+    }
+
+    shrink(s);
+    if (packed)
+        __atomic_store_n(packed, base + s->size, __ATOMIC_RELAXED);
+    return 0;
+
+error:
+    free_records(s);
+    return -ENOMEM;
+}
+
+/*
+ * Moves the records of "src" after those of "dst" (packed again, their
+ * TSC bases differ). On failure "dst" holds the records it had and
+ * "src" all of its own.
+ */
+static int concat(struct records *dst, struct records *src)
+{
+    if (!dst->size && !dst->first) {
+        free_records(dst);
+        *dst = *src;
+        memset(src, 0, sizeof(*src));
+        return 0;
+    }
+
+    if (reserve(dst, dst->size + src->size))
+        return -ENOMEM;
+
+    // The offsets and TSC bases past them are written again by the next append
+    size_t size = dst->size,
+           arena_size = dst->arena_size;
+    xt_event buf;
+    for (size_t i = 0; i < src->size; ++i) {
+        if ((dst->arena_off + dst->arena_size) >> 40 ||
+                append(dst, dst->first + dst->size, decode(src, src->first + i, &buf))) {
+            dst->size = size;
+            dst->arena_size = arena_size;
+            return -ENOMEM;
+        }
+        dst->size++;
+    }
+
+    shrink(dst);
+    free_records(src);
+    return 0;
+}
+
+/**
+ * Packs the records of an executed parser, in order. The parser
+ * cursor is used only here and the parser can be freed afterwards.
+ */
+int xts_build(xentrace_parser parser)
+{
+    return build(&R, parser, NULL, 0, 0, NULL);
+}
+
+/**
+ * Same as "xts_build", keeping only the records of a slice of the trace.
+ */
+int xts_build_slice(xentrace_parser parser, const struct xts_slice *slice)
+{
+    return build(&R, parser, slice, 0, 0, NULL);
+}
+
+/**
+ * Same as "xts_build", numbering the records from "first" and placing
+ * them at the 40-bit offset "arena_off" (the positions and the bytes
+ * before them are not there). Lets the checks read the records of a
+ * small trace as those of one with billions of records.
+ */
+int xts_build_at(xentrace_parser parser, size_t first, uint64_t arena_off)
+{
+    return build(&R, parser, NULL, first, arena_off, NULL);
+}
+
+/**
+ * Packs the records of a slice of the trace aside, after the ones
+ * already set aside, without touching the records read by "xts_get".
+ * "mark" is given back by the "xts_commit" taking them. The number of
+ * records packed so far is added to "packed" (atomically, it can be
+ * read by other threads).
+ */
+int xts_build_pending(xentrace_parser parser, const struct xts_slice *slice,
+                        uint64_t mark, size_t *packed)
+{
+    struct records chunk = { 0 };
+    int ret = build(&chunk, parser, slice, 0, 0, packed);
+    if (ret)
+        return ret;
+
+    pthread_mutex_lock(&pending_lock);
+    ret = concat(&P, &chunk);
+    if (!ret)
+        pending_mark = mark;
+    pthread_mutex_unlock(&pending_lock);
+
+    free_records(&chunk);
+    return ret;
+}
+
+/**
+ * Appends the records set aside by "xts_build_pending" to the ones
+ * read by "xts_get", setting "mark" to the one of the last slice set
+ * aside (0 if none). Returns the number of records appended or a
+ * negative errno, leaving the records read and those set aside as
+ * they were.
+ */
+ssize_t xts_commit(uint64_t *mark)
+{
+    pthread_mutex_lock(&pending_lock);
+    size_t n = P.size;
+    int ret = n ? concat(&R, &P) : 0;
+    *mark = pending_mark;
+    pthread_mutex_unlock(&pending_lock);
+    return ret ? ret : (ssize_t)n;
+}
+
+/**
+ * Forgets the records set aside by "xts_build_pending".
+ */
+void xts_drop_pending()
+{
+    pthread_mutex_lock(&pending_lock);
+    free_records(&P);
+    pending_mark = 0;
+    pthread_mutex_unlock(&pending_lock);
+}
+
+size_t xts_count()
+{
+    return R.first + R.size;
+}
+
+/**
+ * Returns the bytes taken by the packed records and their offsets.
+ */
+size_t xts_bytes()
+{
+    return R.arena_cap + R.size * (sizeof(*R.off_lo) + sizeof(*R.off_hi)) +
+            ((R.size >> BLOCK_SHIFT) + 1) * sizeof(*R.tsc_base);
+}
+
+/**
+ * Decodes the record at "pos" in "buf" and returns it
+ * (NULL if out of range).
+ */
+const xt_event *xts_get(size_t pos, xt_event *buf)
+{
+    if (pos < R.first || pos - R.first >= R.size)
+        return NULL;
+    return decode(&R, pos, buf);
+}
+
+void xts_free()
+{
+    free_records(&R);
+    xts_drop_pending();
+}
@@ -0,0 +1,172 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef __KSXT_STORE
+#define __KSXT_STORE
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// XenTrace-Parser
+#include "xentrace-event.h"
+#include "xentrace-parser.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// Record store | store.c
+//
+
+/*
+ * Records of the loaded trace, by position (the "offset" of the
+ * KernelShark entries).
+ *
+ * Records are kept packed (only the extra words they carry, TSC as a
+ * delta) and decoded on access.
+ *
+ * Thread safety: "xts_build", "xts_commit" and "xts_free" must not
+ * run concurrently with the readers of the store (they are called by
+ * the initializer, "load_entries" and the deinitializer), while
+ * "xts_build_pending" only touches the records set aside, under a
+ * lock shared with "xts_commit" and "xts_drop_pending" (see
+ * "xtbg_start"). Otherwise the store is immutable: "xts_get" and
+ * "xts_count" take no locks and can be called by any number of
+ * threads. There is no shared cursor, each caller iterates over the
+ * positions it holds and gets the record decoded in its own "buf"
+ * (the returned pointer is "buf" itself). The stream callbacks of the plugin ("get_pid",
+ * "get_task", "get_event_id", "get_event_name", "get_info" and
+ * "dump_entry") only read the store, the event ids and the task
+ * names, so they are safe to call concurrently once "load_entries"
+ * has returned.
+ */
+
+// Records of a slice of the trace, loaded in chunks
+struct xts_slice {
+    // TSC range of the records kept, [from_tsc, until_tsc)
+    uint64_t from_tsc,
+             until_tsc;
+    // Domain running on each pCPU, given to the records the parser
+    // does not know the domain of (it started before the chunk) and
+    // updated to the one of the last record
+    xt_domain *doms;
+    int n_doms;
+    // Stops the packing when set (NULL if it cannot be stopped)
+    const bool *cancel;
+};
+
+int xts_build(xentrace_parser parser);
+int xts_build_slice(xentrace_parser parser, const struct xts_slice *slice);
+int xts_build_at(xentrace_parser parser, size_t first, uint64_t arena_off);
+int xts_build_pending(xentrace_parser parser, const struct xts_slice *slice,
+                        uint64_t mark, size_t *packed);
+ssize_t xts_commit(uint64_t *mark);
+void xts_drop_pending();
+size_t xts_count();
+size_t xts_bytes();
+const xt_event *xts_get(size_t pos, xt_event *buf);
+void xts_free();
+
+//
+// Delta-encoded timestamps | tscol.c
+//
+
+// Entries per block (power of two)
+#define TSCOL_BLOCK_SHIFT 12
+#define TSCOL_BLOCK (1 << TSCOL_BLOCK_SHIFT)
+
+/*
+ * Column of timestamps (ns), each kept as a 32-bit delta from the
+ * first timestamp of its block. A block where a delta does not fit
+ * (or a timestamp goes backward) keeps its timestamps as they are.
+ */
+struct ts_column {
+    // First timestamp of each block
+    int64_t *bases;
+    uint32_t *deltas;
+    // Timestamps of the "wide" blocks (NULL for the others)
+    int64_t **wide;
+    size_t size,
+           capacity;
+};
+
+int tscol_append(struct ts_column *c, int64_t ts);
+int64_t tscol_get(const struct ts_column *c, size_t i);
+void tscol_decode(const struct ts_column *c, size_t first, size_t n, int64_t *out);
+size_t tscol_find(const struct ts_column *c, int64_t ts);
+size_t tscol_bytes(const struct ts_column *c);
+void tscol_free(struct ts_column *c);
+
+//
+// Progressive load | bgload.c
+//
+
+/*
+ * The parser reads a whole file at once. To show a trace before it is
+ * all parsed, "xtbg_preview" loads the store from a copy of its first
+ * windows (up to a time or size limit), then "xtbg_start" parses the
+ * rest of the file on a background thread, one chunk of windows at a
+ * time, resuming after the records already packed, into the records
+ * set aside by "xts_build_pending". At each "load_entries" (each
+ * reload of the stream), "xtbg_commit" appends the records packed so
+ * far to the ones of the store.
+ */
+
+enum xtbg_state {
+    XTBG_IDLE,
+    XTBG_PARSING,
+    XTBG_PACKING,
+    XTBG_READY,
+    XTBG_FAILED
+};
+
+// Limit of the preview (the first one reached)
+struct xtbg_limit {
+    // Time from the first record (cycles, 0 if not set)
+    uint64_t cycles;
+    // Bytes of the file (0 if not set)
+    uint64_t bytes;
+};
+
+struct xtbg_progress {
+    enum xtbg_state state;
+    // Fraction of the file parsed and records packed
+    // (with the ones of the preview)
+    double parsed;
+    size_t packed;
+    int64_t elapsed_ns;
+};
+
+int xtbg_preview(const char *path, const struct xtbg_limit *limit, int *n_cpus);
+int xtbg_start(const char *path, uint64_t chunk_bytes);
+void xtbg_progress(struct xtbg_progress *progress);
+int xtbg_commit(int *n_cpus);
+uint64_t xtbg_preview_end();
+void xtbg_stop();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,206 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef _GNU_SOURCE
+/** Use GNU C Library. */
+#define _GNU_SOURCE
+#endif // _GNU_SOURCE
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "store.h"
+
+#define BLOCKS_INIT_SIZE 4
+#define BLOCK_MASK (TSCOL_BLOCK - 1)
+
+static int grow(struct ts_column *c)
+{
+    size_t n_blocks = c->capacity >> TSCOL_BLOCK_SHIFT,
+           new_blocks = n_blocks ? n_blocks * 2 : BLOCKS_INIT_SIZE;
+
+    int64_t *bases = realloc(c->bases, new_blocks * sizeof(*bases));
+    if (!bases)
+        return -ENOMEM;
+    c->bases = bases;
+
+    int64_t **wide = realloc(c->wide, new_blocks * sizeof(*wide));
+    if (!wide)
+        return -ENOMEM;
+    memset(wide + n_blocks, 0, (new_blocks - n_blocks) * sizeof(*wide));
+    c->wide = wide;
+
+    uint32_t *deltas = realloc(c->deltas, (new_blocks << TSCOL_BLOCK_SHIFT) * sizeof(*deltas));
+    if (!deltas)
+        return -ENOMEM;
+    c->deltas = deltas;
+
+    c->capacity = new_blocks << TSCOL_BLOCK_SHIFT;
+    return 0;
+}
+
+/**
+ * Switches the block "b" to plain timestamps.
+ */
+static int widen(struct ts_column *c, size_t b)
+{
+    int64_t *wide = malloc(TSCOL_BLOCK * sizeof(*wide));
+    if (!wide)
+        return -ENOMEM;
+
+    size_t first = b << TSCOL_BLOCK_SHIFT;
+    for (size_t i = first; i < c->size; ++i)
+        wide[i - first] = c->bases[b] + c->deltas[i];
+    c->wide[b] = wide;
+    return 0;
+}
+
+int tscol_append(struct ts_column *c, int64_t ts)
+{
+    if (c->size == c->capacity && grow(c))
+        return -ENOMEM;
+
+    size_t b = c->size >> TSCOL_BLOCK_SHIFT;
+    if (!(c->size & BLOCK_MASK))
+        c->bases[b] = ts;
+
+    if (!c->wide[b] && (ts < c->bases[b] || (uint64_t)(ts - c->bases[b]) > UINT32_MAX) &&
+            widen(c, b))
+        return -ENOMEM;
+
+    if (c->wide[b])
+        c->wide[b][c->size & BLOCK_MASK] = ts;
+    else
+        c->deltas[c->size] = ts - c->bases[b];
+    c->size++;
+    return 0;
+}
+
+int64_t tscol_get(const struct ts_column *c, size_t i)
+{
+    size_t b = i >> TSCOL_BLOCK_SHIFT;
+    return c->wide[b] ? c->wide[b][i & BLOCK_MASK] : c->bases[b] + c->deltas[i];
+}
+
+/**
+ * Adds "base" to "n" deltas.
+ */
+static void add_base(const uint32_t *deltas, size_t n, int64_t base, int64_t *out)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    __m128i vbase = _mm_set1_epi64x(base),
+            zero = _mm_setzero_si128();
+    for (; i + 4 <= n; i += 4) {
+        __m128i d = _mm_loadu_si128((const __m128i *)(deltas + i));
+        _mm_storeu_si128((__m128i *)(out + i), _mm_add_epi64(vbase, _mm_unpacklo_epi32(d, zero)));
+        _mm_storeu_si128((__m128i *)(out + i + 2), _mm_add_epi64(vbase, _mm_unpackhi_epi32(d, zero)));
+    }
+#endif
+    for (; i < n; ++i)
+        out[i] = base + deltas[i];
+}
+
+/**
+ * Decodes the timestamps [first, first + n) in "out".
+ */
+void tscol_decode(const struct ts_column *c, size_t first, size_t n, int64_t *out)
+{
+    size_t end = first + n;
+    while (first < end) {
+        size_t b = first >> TSCOL_BLOCK_SHIFT,
+               block_end = (b + 1) << TSCOL_BLOCK_SHIFT,
+               count = ((block_end < end) ? block_end : end) - first;
+
+        if (c->wide[b])
+            memcpy(out, c->wide[b] + (first & BLOCK_MASK), count * sizeof(*out));
+        else
+            add_base(c->deltas + first, count, c->bases[b], out);
+
+        first += count;
+        out += count;
+    }
+}
+
+/**
+ * Returns the index of the first timestamp at or after "ts"
+ * (the column must be sorted). The blocks are found by their base.
+ */
+size_t tscol_find(const struct ts_column *c, int64_t ts)
+{
+    size_t n_blocks = (c->size + BLOCK_MASK) >> TSCOL_BLOCK_SHIFT,
+           l = 0,
+           h = n_blocks;
+
+    // First block with base >= ts, the match is in the one before
+    while (l < h) {
+        size_t m = l + (h - l) / 2;
+        if (c->bases[m] < ts)
+            l = m + 1;
+        else
+            h = m;
+    }
+    if (!l)
+        return 0;
+
+    size_t b = l - 1;
+    l = b << TSCOL_BLOCK_SHIFT;
+    h = (l + TSCOL_BLOCK < c->size) ? l + TSCOL_BLOCK : c->size;
+    while (l < h) {
+        size_t m = l + (h - l) / 2;
+        if (tscol_get(c, m) < ts)
+            l = m + 1;
+        else
+            h = m;
+    }
+
+    return l;
+}
+
+/**
+ * Returns the bytes allocated by the column.
+ */
+size_t tscol_bytes(const struct ts_column *c)
+{
+    size_t n_blocks = c->capacity >> TSCOL_BLOCK_SHIFT,
+           bytes = c->capacity * sizeof(*c->deltas) +
+                    n_blocks * (sizeof(*c->bases) + sizeof(*c->wide));
+    for (size_t b = 0; b < n_blocks; ++b)
+        if (c->wide[b])
+            bytes += TSCOL_BLOCK * sizeof(**c->wide);
+    return bytes;
+}
+
+void tscol_free(struct ts_column *c)
+{
+    for (size_t b = 0; b < (c->capacity >> TSCOL_BLOCK_SHIFT); ++b)
+        free(c->wide[b]);
+    free(c->bases);
+    free(c->deltas);
+    free(c->wide);
+    memset(c, 0, sizeof(*c));
+}
@@ -0,0 +1,69 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef __KSXT_TOOLS
+#define __KSXT_TOOLS
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Helpers shared by the command-line tools.
+ */
+
+#define DEFAULT_CPU_HZ 2400000000ULL
+#define NS_PER_SEC 1000000000ULL
+
+/**
+ * Parses a CPU frequency with an optional G/M/K suffix
+ * (as "XEN_CPUHZ"), returns 0 if invalid.
+ */
+static inline uint64_t tools_parse_hz(const char *arg)
+{
+    char *next_ptr;
+    double hz = strtod(arg, &next_ptr);
+    if (next_ptr == arg || hz <= 0)
+        return 0;
+
+    switch (*next_ptr) {
+        case '\0':
+            return hz;
+        case 'G':
+            return hz * 1e9;
+        case 'M':
+            return hz * 1e6;
+        case 'K':
+            return hz * 1e3;
+        default:
+            return 0;
+    }
+}
+
+/**
+ * Converts a TSC to ns, without overflowing for large TSCs.
+ */
+static inline uint64_t tools_tsc_to_ns(uint64_t tsc, uint64_t hz)
+{
+    return (tsc / hz) * NS_PER_SEC + (tsc % hz) * NS_PER_SEC / hz;
+}
+
+#endif
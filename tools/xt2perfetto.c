@@ -0,0 +1,492 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef _GNU_SOURCE
+/** Use GNU C Library. */
+#define _GNU_SOURCE
+#endif // _GNU_SOURCE
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Xen Project
+#include <trace.h>
+// Raw trace reader
+#include "raw/xtraw.h"
+
+#include "tools.h"
+
+/*
+ * Converts a XenTrace binary file to the Perfetto trace format
+ * (protobuf, written by hand), streaming through the file:
+ *  - a track per pCPU with the vCPU slices (scheduler switches);
+ *  - a track per pCPU with the HVM exit slices (VMEXIT -> VMENTRY);
+ *  - counter tracks of the csched2 credit and load of each vCPU
+ *    and of the average load of each runqueue.
+ * Each pCPU is a packet sequence, as its records are time ordered.
+ */
+
+#define PB_MAXLEN 512
+#define TRACKS_INIT_SIZE 256
+#define NAME_MAXLEN 32
+#define IDLE_DOM 0x7fff
+
+#define CSCHED2_EVT(_e) TRC_SCHED_CLASS_EVT(CSCHED2, _e)
+#define TRC_CSCHED2_CREDIT_BURN      CSCHED2_EVT(3)
+#define TRC_CSCHED2_CREDIT_RESET     CSCHED2_EVT(7)
+#define TRC_CSCHED2_UPDATE_VCPU_LOAD CSCHED2_EVT(11)
+#define TRC_CSCHED2_UPDATE_RUNQ_LOAD CSCHED2_EVT(12)
+
+//
+// Protobuf encoding
+//
+
+// Perfetto field numbers
+#define TRACE_PACKET 1
+#define PACKET_TIMESTAMP 8
+#define PACKET_SEQUENCE_ID 10
+#define PACKET_TRACK_EVENT 11
+#define PACKET_TRACK_DESCRIPTOR 60
+#define TRACK_UUID 1
+#define TRACK_NAME 2
+#define TRACK_PARENT_UUID 5
+#define TRACK_COUNTER 8
+#define EVENT_DEBUG_ANNOTATION 4
+#define EVENT_TYPE 9
+#define EVENT_TRACK_UUID 11
+#define EVENT_NAME 23
+#define EVENT_COUNTER_VALUE 30
+#define EVENT_DOUBLE_COUNTER_VALUE 44
+#define ANNOTATION_UINT 3
+#define ANNOTATION_NAME 10
+
+enum event_type {
+    SLICE_BEGIN = 1,
+    SLICE_END = 2,
+    COUNTER = 4
+};
+
+// Message under construction
+struct pb {
+    uint8_t data[PB_MAXLEN];
+    size_t len;
+};
+
+static void pb_raw(struct pb *m, const void *data, size_t len)
+{
+    if (m->len + len > PB_MAXLEN)
+        return;
+    memcpy(m->data + m->len, data, len);
+    m->len += len;
+}
+
+static void pb_varint(struct pb *m, uint64_t v)
+{
+    uint8_t buf[10];
+    size_t n = 0;
+    do {
+        buf[n++] = (v & 0x7f) | ((v > 0x7f) << 7);
+        v >>= 7;
+    } while (v);
+    pb_raw(m, buf, n);
+}
+
+static void pb_uint(struct pb *m, int field, uint64_t v)
+{
+    pb_varint(m, (uint64_t)field << 3);
+    pb_varint(m, v);
+}
+
+static void pb_double(struct pb *m, int field, double v)
+{
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    pb_varint(m, (uint64_t)field << 3 | 1);
+
+    uint8_t buf[8];
+    for (int i = 0; i < 8; ++i)
+        buf[i] = bits >> (8 * i);
+    pb_raw(m, buf, sizeof(buf));
+}
+
+static void pb_bytes(struct pb *m, int field, const void *data, size_t len)
+{
+    pb_varint(m, (uint64_t)field << 3 | 2);
+    pb_varint(m, len);
+    pb_raw(m, data, len);
+}
+
+static void pb_string(struct pb *m, int field, const char *str)
+{
+    pb_bytes(m, field, str, strlen(str));
+}
+
+static void pb_msg(struct pb *m, int field, const struct pb *sub)
+{
+    pb_bytes(m, field, sub->data, sub->len);
+}
+
+//
+// Converter
+//
+
+// State of a pCPU
+struct cpu_state {
+    // Running vCPU (dom << 16 | vcpu, -1 if none)
+    int64_t running;
+    bool in_exit;
+    uint64_t last_ts;
+};
+
+static struct {
+    FILE *out;
+    uint64_t cpu_hz;
+    struct cpu_state *cpus;
+    int n_cpus;
+    // Tracks already described (open-addressing set)
+    uint64_t *tracks;
+    size_t n_tracks,
+           tracks_cap;
+} P;
+
+enum track_kind {
+    TRACK_CPU = 1,
+    TRACK_EXITS,
+    TRACK_CREDIT,
+    TRACK_VCPU_LOAD,
+    TRACK_RUNQ_LOAD,
+    TRACK_RUNQ_BLOAD
+};
+
+static uint64_t track_uuid(enum track_kind kind, uint32_t id)
+{
+    return (uint64_t)kind << 32 | id;
+}
+
+static void write_packet(const struct pb *packet)
+{
+    struct pb head = { .len = 0 };
+    pb_varint(&head, TRACE_PACKET << 3 | 2);
+    pb_varint(&head, packet->len);
+    fwrite(head.data, 1, head.len, P.out);
+    fwrite(packet->data, 1, packet->len, P.out);
+}
+
+static bool track_seen(uint64_t uuid)
+{
+    if (2 * (P.n_tracks + 1) > P.tracks_cap) {
+        size_t cap = P.tracks_cap ? P.tracks_cap * 2 : TRACKS_INIT_SIZE;
+        uint64_t *tmp = calloc(cap, sizeof(*tmp));
+        if (!tmp)
+            return true;
+
+        for (size_t i = 0; i < P.tracks_cap; ++i) {
+            if (!P.tracks[i])
+                continue;
+            size_t s = (P.tracks[i] * 0x9e3779b97f4a7c15ULL) >> 40 & (cap - 1);
+            while (tmp[s])
+                s = (s + 1) & (cap - 1);
+            tmp[s] = P.tracks[i];
+        }
+        free(P.tracks);
+        P.tracks = tmp;
+        P.tracks_cap = cap;
+    }
+
+    size_t s = (uuid * 0x9e3779b97f4a7c15ULL) >> 40 & (P.tracks_cap - 1);
+    while (P.tracks[s] && P.tracks[s] != uuid)
+        s = (s + 1) & (P.tracks_cap - 1);
+    if (P.tracks[s])
+        return true;
+
+    P.tracks[s] = uuid;
+    P.n_tracks++;
+    return false;
+}
+
+/**
+ * Describes a track the first time it is used.
+ */
+static void describe_track(enum track_kind kind, uint32_t id)
+{
+    uint64_t uuid = track_uuid(kind, id);
+    if (track_seen(uuid))
+        return;
+
+    char name[NAME_MAXLEN];
+    switch (kind) {
+        case TRACK_CPU:
+            snprintf(name, sizeof(name), "pCPU %u", id);
+            break;
+        case TRACK_EXITS:
+            describe_track(TRACK_CPU, id);
+            snprintf(name, sizeof(name), "pCPU %u HVM exits", id);
+            break;
+        case TRACK_CREDIT:
+            snprintf(name, sizeof(name), "d%u/v%u credit", id >> 16, id & 0xffff);
+            break;
+        case TRACK_VCPU_LOAD:
+            snprintf(name, sizeof(name), "d%u/v%u load", id >> 16, id & 0xffff);
+            break;
+        case TRACK_RUNQ_LOAD:
+            snprintf(name, sizeof(name), "runq %u load", id);
+            break;
+        case TRACK_RUNQ_BLOAD:
+            snprintf(name, sizeof(name), "runq %u avg load", id);
+            break;
+    }
+
+    struct pb desc = { .len = 0 },
+              empty = { .len = 0 },
+              packet = { .len = 0 };
+    pb_uint(&desc, TRACK_UUID, uuid);
+    pb_string(&desc, TRACK_NAME, name);
+    if (kind == TRACK_EXITS)
+        pb_uint(&desc, TRACK_PARENT_UUID, track_uuid(TRACK_CPU, id));
+    if (kind >= TRACK_CREDIT)
+        pb_msg(&desc, TRACK_COUNTER, &empty);
+
+    pb_msg(&packet, PACKET_TRACK_DESCRIPTOR, &desc);
+    write_packet(&packet);
+}
+
+static void write_event(int cpu, uint64_t ts, const struct pb *event)
+{
+    struct pb packet = { .len = 0 };
+    pb_uint(&packet, PACKET_TIMESTAMP, ts);
+    pb_uint(&packet, PACKET_SEQUENCE_ID, cpu + 1);
+    pb_msg(&packet, PACKET_TRACK_EVENT, event);
+    write_packet(&packet);
+}
+
+static void slice(int cpu, uint64_t ts, enum track_kind kind, enum event_type type,
+                    const char *name, uint32_t exitcode)
+{
+    describe_track(kind, cpu);
+
+    struct pb event = { .len = 0 };
+    pb_uint(&event, EVENT_TYPE, type);
+    pb_uint(&event, EVENT_TRACK_UUID, track_uuid(kind, cpu));
+    if (name)
+        pb_string(&event, EVENT_NAME, name);
+    if (kind == TRACK_EXITS && type == SLICE_BEGIN) {
+        struct pb annotation = { .len = 0 };
+        pb_string(&annotation, ANNOTATION_NAME, "exitcode");
+        pb_uint(&annotation, ANNOTATION_UINT, exitcode);
+        pb_msg(&event, EVENT_DEBUG_ANNOTATION, &annotation);
+    }
+
+    write_event(cpu, ts, &event);
+}
+
+static void counter(int cpu, uint64_t ts, enum track_kind kind, uint32_t id, double value)
+{
+    describe_track(kind, id);
+
+    struct pb event = { .len = 0 };
+    pb_uint(&event, EVENT_TYPE, COUNTER);
+    pb_uint(&event, EVENT_TRACK_UUID, track_uuid(kind, id));
+    if (kind == TRACK_CREDIT)
+        pb_uint(&event, EVENT_COUNTER_VALUE, (uint64_t)(int64_t)value);
+    else
+        pb_double(&event, EVENT_DOUBLE_COUNTER_VALUE, value);
+    write_event(cpu, ts, &event);
+}
+
+static struct cpu_state *get_cpu(int cpu)
+{
+    if (cpu >= P.n_cpus) {
+        struct cpu_state *tmp = realloc(P.cpus, (cpu + 1) * sizeof(*tmp));
+        if (!tmp)
+            return NULL;
+
+        for (int i = P.n_cpus; i <= cpu; ++i)
+            tmp[i] = (struct cpu_state) { .running = -1 };
+        P.cpus = tmp;
+        P.n_cpus = cpu + 1;
+    }
+
+    return &P.cpus[cpu];
+}
+
+static void end_exit(int cpu, struct cpu_state *c, uint64_t ts)
+{
+    if (c->in_exit)
+        slice(cpu, ts, TRACK_EXITS, SLICE_END, NULL, 0);
+    c->in_exit = false;
+}
+
+/**
+ * Switches the vCPU running on a pCPU (-1 for none or idle).
+ */
+static void switch_vcpu(int cpu, struct cpu_state *c, int64_t next, uint64_t ts)
+{
+    if (next >= 0 && (next >> 16) == IDLE_DOM)
+        next = -1;
+    if (c->running == next)
+        return;
+
+    end_exit(cpu, c, ts);
+    if (c->running >= 0)
+        slice(cpu, ts, TRACK_CPU, SLICE_END, NULL, 0);
+
+    c->running = next;
+    if (next >= 0) {
+        char name[NAME_MAXLEN];
+        snprintf(name, sizeof(name), "d%u/v%u", (uint32_t)(next >> 16), (uint32_t)(next & 0xffff));
+        slice(cpu, ts, TRACK_CPU, SLICE_BEGIN, name, 0);
+    }
+}
+
+static double load_value(uint32_t lo, uint32_t hi, int shift)
+{
+    return (double)((uint64_t)hi << 32 | lo) / (double)(1ULL << shift);
+}
+
+static void convert_record(const struct xtr_record *rec)
+{
+    struct cpu_state *c = get_cpu(rec->cpu);
+    if (!c)
+        return;
+
+    const uint32_t *extra = rec->extra;
+    uint64_t ts = tools_tsc_to_ns(rec->tsc, P.cpu_hz);
+    int cpu = rec->cpu;
+    c->last_ts = ts;
+
+    switch (rec->id) {
+        case TRC_SCHED_SWITCH:
+            switch_vcpu(cpu, c, (int64_t)(extra[2] & 0xffff) << 16 | (extra[3] & 0xffff), ts);
+            break;
+        case TRC_SCHED_SWITCH_INFPREV:
+            if (c->running == ((int64_t)(extra[0] & 0xffff) << 16 | (extra[1] & 0xffff)))
+                switch_vcpu(cpu, c, -1, ts);
+            break;
+        case TRC_SCHED_SWITCH_INFNEXT:
+            switch_vcpu(cpu, c, (int64_t)(extra[0] & 0xffff) << 16 | (extra[1] & 0xffff), ts);
+            break;
+        case TRC_HVM_VMEXIT:
+        case TRC_HVM_VMEXIT64:
+            end_exit(cpu, c, ts);
+            slice(cpu, ts, TRACK_EXITS, SLICE_BEGIN, "VMEXIT", extra[0]);
+            c->in_exit = true;
+            break;
+        case TRC_HVM_VMENTRY:
+            end_exit(cpu, c, ts);
+            break;
+        case TRC_CSCHED2_CREDIT_BURN:
+            counter(cpu, ts, TRACK_CREDIT, extra[0], (int32_t)extra[1]);
+            break;
+        case TRC_CSCHED2_CREDIT_RESET:
+            counter(cpu, ts, TRACK_CREDIT, extra[0], (int32_t)extra[2]);
+            break;
+        case TRC_CSCHED2_UPDATE_VCPU_LOAD:
+            counter(cpu, ts, TRACK_VCPU_LOAD, extra[2],
+                        load_value(extra[0], extra[1], extra[3] & 0x3f));
+            break;
+        case TRC_CSCHED2_UPDATE_RUNQ_LOAD: {
+            // rq_load[16]:rq_id[8]:shift[8]
+            int rq_id = (extra[4] >> 16) & 0xff,
+                shift = (extra[4] >> 24) & 0x3f;
+            counter(cpu, ts, TRACK_RUNQ_LOAD, rq_id, load_value(extra[0], extra[1], shift));
+            counter(cpu, ts, TRACK_RUNQ_BLOAD, rq_id, load_value(extra[2], extra[3], shift));
+            break;
+        }
+    }
+}
+
+static int convert(const char *in_path, const char *out_path)
+{
+    struct xtr_file file;
+    int ret = xtr_open(&file, in_path);
+    if (ret) {
+        fprintf(stderr, "Cannot open \"%s\": %s\n", in_path, strerror(-ret));
+        return 1;
+    }
+
+    if (!(P.out = fopen(out_path, "wb"))) {
+        fprintf(stderr, "Cannot create \"%s\": %s\n", out_path, strerror(errno));
+        xtr_close(&file);
+        return 1;
+    }
+    setvbuf(P.out, NULL, _IOFBF, 1 << 20);
+
+    struct xtr_cursor cur;
+    struct xtr_record rec;
+    xtr_cursor_init(&cur, &file, 0);
+    while ((ret = xtr_next(&cur, &rec)) > 0)
+        convert_record(&rec);
+    if (ret < 0)
+        fprintf(stderr, "Warning: \"%s\" is truncated or corrupted.\n", in_path);
+
+    // Close the slices still open
+    for (int i = 0; i < P.n_cpus; ++i)
+        switch_vcpu(i, &P.cpus[i], -1, P.cpus[i].last_ts);
+
+    xtr_cursor_free(&cur);
+    xtr_close(&file);
+    free(P.cpus);
+    free(P.tracks);
+
+    if (fclose(P.out)) {
+        fprintf(stderr, "Cannot write \"%s\": %s\n", out_path, strerror(errno));
+        return 1;
+    }
+    return 0;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-c cpu_hz] <trace.xen> <trace.pftrace>\n"
+                    "  -c cpu_hz  CPU frequency (e.g. 2.4G, default 2.4G)\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    P.cpu_hz = DEFAULT_CPU_HZ;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "c:h")) != -1) {
+        switch (opt) {
+            case 'c':
+                if (!(P.cpu_hz = tools_parse_hz(optarg))) {
+                    fprintf(stderr, "Invalid cpu_hz \"%s\".\n", optarg);
+                    return 1;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return opt != 'h';
+        }
+    }
+
+    if (argc - optind != 2) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    return convert(argv[optind], argv[optind + 1]);
+}
@@ -0,0 +1,448 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef _GNU_SOURCE
+/** Use GNU C Library. */
+#define _GNU_SOURCE
+#endif // _GNU_SOURCE
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Xen Project
+#include <trace.h>
+
+#include "tools.h"
+
+/*
+ * Writes a synthetic XenTrace file: per-CPU windows of records drawn
+ * from a configurable mix of event classes, with consistent scheduler
+ * switches (so that the records can be attributed to the domains).
+ */
+
+#define CSCHED2_EVT(_e) TRC_SCHED_CLASS_EVT(CSCHED2, _e)
+
+#define DEFAULT_RECORDS 1000000
+#define DEFAULT_WINDOW (32 * 1024)
+#define MAX_RECORD_SIZE (sizeof(uint32_t) * (3 + TRACE_EXTRA_MAX))
+#define MAX_CPUS 4096
+#define MAX_DOMS 0x7ff0
+#define IDLE_DOM 0x7fff
+
+enum gen_class {
+    GEN_GEN,
+    GEN_SCHED,
+    GEN_DOM0,
+    GEN_HVM,
+    GEN_MEM,
+    GEN_PV,
+    GEN_SHADOW,
+    GEN_HW,
+    GEN_N_CLASSES
+};
+
+static const char *class_names[GEN_N_CLASSES] = {
+    "gen", "sched", "dom0", "hvm", "mem", "pv", "shadow", "hw"
+};
+
+// Per pCPU state
+struct gen_cpu {
+    uint64_t tsc;
+    // Running domain/vCPU (-1 when idle)
+    int dom,
+        vcpu;
+    // Whether the pCPU is in a C-state
+    int idle;
+    uint8_t *buf;
+    size_t len;
+};
+
+static struct {
+    FILE *out;
+    struct gen_cpu *cpus;
+    int n_cpus,
+        n_doms,
+        n_vcpus;
+    size_t window;
+    unsigned weights[GEN_N_CLASSES],
+             total_weight;
+    uint64_t state,
+             records;
+} G;
+
+static uint64_t rnd()
+{
+    // xorshift64*
+    G.state ^= G.state >> 12;
+    G.state ^= G.state << 25;
+    G.state ^= G.state >> 27;
+    return G.state * 0x2545f4914f6cdd1dULL;
+}
+
+static uint32_t rnd_range(uint32_t n)
+{
+    return (rnd() >> 32) % n;
+}
+
+static int flush_window(int cpu)
+{
+    struct gen_cpu *c = &G.cpus[cpu];
+    if (!c->len)
+        return 0;
+
+    uint32_t header[3] = {
+        TRC_TRACE_CPU_CHANGE | 2 << TRACE_EXTRA_SHIFT,
+        cpu,
+        c->len
+    };
+
+    int ret = (fwrite(header, sizeof(header), 1, G.out) != 1 ||
+                fwrite(c->buf, c->len, 1, G.out) != 1) ? -EIO : 0;
+    c->len = 0;
+    return ret;
+}
+
+/**
+ * Appends a record (with TSC) to the window of a pCPU.
+ */
+static int emit(int cpu, uint32_t id, int n_extra, const uint32_t *extra)
+{
+    struct gen_cpu *c = &G.cpus[cpu];
+    if (c->len + MAX_RECORD_SIZE > G.window && flush_window(cpu))
+        return -EIO;
+
+    uint32_t words[3] = {
+        id | (uint32_t)n_extra << TRACE_EXTRA_SHIFT | TRC_HD_CYCLE_FLAG,
+        (uint32_t)c->tsc,
+        (uint32_t)(c->tsc >> 32)
+    };
+
+    memcpy(c->buf + c->len, words, sizeof(words));
+    memcpy(c->buf + c->len + sizeof(words), extra, n_extra * sizeof(uint32_t));
+    c->len += sizeof(words) + n_extra * sizeof(uint32_t);
+    G.records++;
+    return 0;
+}
+
+#define EMIT(_cpu, _id, ...) ({ \
+    uint32_t _extra[] = { __VA_ARGS__ }; \
+    emit(_cpu, _id, sizeof(_extra) / sizeof(uint32_t), _extra); \
+})
+
+static uint32_t dom_vcpu(const struct gen_cpu *c)
+{
+    return (uint32_t)c->dom << 16 | c->vcpu;
+}
+
+/**
+ * Switches a pCPU to a random domain/vCPU (or to idle).
+ */
+static int gen_switch(int cpu)
+{
+    struct gen_cpu *c = &G.cpus[cpu];
+    int prev_dom = (c->dom < 0) ? IDLE_DOM : c->dom,
+        prev_vcpu = (c->dom < 0) ? cpu : c->vcpu;
+
+    if (rnd_range(8)) {
+        c->dom = rnd_range(G.n_doms);
+        c->vcpu = rnd_range(G.n_vcpus);
+    } else {
+        c->dom = c->vcpu = -1;
+    }
+
+    int next_dom = (c->dom < 0) ? IDLE_DOM : c->dom,
+        next_vcpu = (c->dom < 0) ? cpu : c->vcpu;
+
+    return EMIT(cpu, TRC_SCHED_SWITCH_INFPREV, prev_dom, prev_vcpu, rnd_range(1000000)) ||
+            EMIT(cpu, TRC_SCHED_SWITCH_INFNEXT, next_dom, next_vcpu, rnd_range(100000), 1000000) ||
+            EMIT(cpu, TRC_SCHED_SWITCH, prev_dom, prev_vcpu, next_dom, next_vcpu);
+}
+
+static int gen_sched(int cpu)
+{
+    struct gen_cpu *c = &G.cpus[cpu];
+    uint32_t dv = (uint32_t)rnd_range(G.n_doms) << 16 | rnd_range(G.n_vcpus);
+
+    switch (rnd_range(6)) {
+        case 0:
+        case 1:
+            return gen_switch(cpu);
+        case 2:
+            return EMIT(cpu, TRC_SCHED_WAKE, dv >> 16, dv & 0xffff);
+        case 3:
+            return EMIT(cpu, CSCHED2_EVT(3), dv, rnd_range(10000000), 0);
+        case 4:
+            return EMIT(cpu, CSCHED2_EVT(11), rnd_range(1 << 18), 0, dv, 18);
+        default:
+            return (c->dom < 0) ?
+                    EMIT(cpu, CSCHED2_EVT(20), (uint32_t)cpu << 16 | 0) :
+                    EMIT(cpu, TRC_SCHED_SLEEP, c->dom, c->vcpu);
+    }
+}
+
+static int gen_hvm(int cpu)
+{
+    struct gen_cpu *c = &G.cpus[cpu];
+    if (c->dom < 0)
+        return gen_switch(cpu);
+
+    static const uint32_t exits[] = { 0x1e, 0x7b, 0x30, 0x0a, 0x20, 0x01 };
+    uint32_t exit_code = exits[rnd_range(sizeof(exits) / sizeof(*exits))];
+    int ret = EMIT(cpu, TRC_HVM_VMEXIT, exit_code, (uint32_t)rnd());
+    if (ret)
+        return ret;
+
+    switch (exit_code) {
+        case 0x1e:
+            ret = EMIT(cpu, rnd_range(2) ? TRC_HVM_IO_READ : TRC_HVM_IO_WRITE,
+                        0x3f8 + rnd_range(8), 1, rnd_range(256));
+            break;
+        case 0x0a:
+            ret = EMIT(cpu, TRC_HVM_CPUID, rnd_range(0x20), 0, 0, 0, 0);
+            break;
+        case 0x30:
+            ret = EMIT(cpu, TRC_HVM_NPF, (uint32_t)rnd() & ~0xfffu, 0,
+                        (uint32_t)rnd(), 0, 0x181, 0);
+            break;
+    }
+
+    c->tsc += 500 + rnd_range(5000);
+    return ret || EMIT(cpu, TRC_HVM_VMENTRY);
+}
+
+static int gen_hw(int cpu)
+{
+    struct gen_cpu *c = &G.cpus[cpu];
+    uint32_t start;
+
+    switch (rnd_range(4)) {
+        case 0:
+        case 1:
+            start = (uint32_t)c->tsc;
+            c->tsc += 200 + rnd_range(20000);
+            return EMIT(cpu, TRC_HW_IRQ_HANDLED, 16 + rnd_range(48),
+                        start, (uint32_t)c->tsc);
+        case 2:
+            c->idle = !c->idle;
+            return c->idle ? EMIT(cpu, TRC_PM_IDLE_ENTRY, 1 + rnd_range(3), 0) :
+                                EMIT(cpu, TRC_PM_IDLE_EXIT, 1 + rnd_range(3), 0);
+        default:
+            return EMIT(cpu, TRC_PM_FREQ_CHANGE, 1200 + 100 * rnd_range(20),
+                        1200 + 100 * rnd_range(20));
+    }
+}
+
+static int gen_record(int cpu, enum gen_class cls)
+{
+    struct gen_cpu *c = &G.cpus[cpu];
+
+    switch (cls) {
+        case GEN_GEN:
+            return EMIT(cpu, TRC_LOST_RECORDS, 1 + rnd_range(1000),
+                        dom_vcpu(c), (uint32_t)c->tsc, (uint32_t)(c->tsc >> 32));
+        case GEN_SCHED:
+            return gen_sched(cpu);
+        case GEN_DOM0:
+            return EMIT(cpu, rnd_range(2) ? TRC_DOM0_DOM_ADD : TRC_DOM0_DOM_REM,
+                        rnd_range(G.n_doms));
+        case GEN_HVM:
+            return gen_hvm(cpu);
+        case GEN_MEM:
+            return rnd_range(2) ?
+                    EMIT(cpu, TRC_MEM_PAGE_GRANT_MAP, rnd_range(G.n_doms)) :
+                    EMIT(cpu, TRC_MEM_SET_P2M_ENTRY, (uint32_t)rnd(), 0, (uint32_t)rnd(),
+                            0, rnd_range(G.n_doms), 0);
+        case GEN_PV:
+            return rnd_range(4) ?
+                    EMIT(cpu, TRC_PV_HYPERCALL_V2, rnd_range(40), 0, 0) :
+                    EMIT(cpu, TRC_PV_TRAP, (uint32_t)rnd(), rnd_range(20));
+        case GEN_SHADOW:
+            return EMIT(cpu, rnd_range(2) ? TRC_SHADOW_FIXUP : TRC_SHADOW_EMULATE,
+                        (uint32_t)rnd(), (uint32_t)rnd() & ~0xfffu, 0, rnd_range(1 << 20));
+        case GEN_HW:
+            return gen_hw(cpu);
+        default:
+            return 0;
+    }
+}
+
+static enum gen_class pick_class()
+{
+    uint32_t n = rnd_range(G.total_weight);
+    for (int i = 0; i < GEN_N_CLASSES; ++i) {
+        if (n < G.weights[i])
+            return i;
+        n -= G.weights[i];
+    }
+    return GEN_SCHED;
+}
+
+/**
+ * Parses a mix like "hvm=40,sched=20" (classes not listed keep
+ * their weight).
+ */
+static int parse_mix(char *arg)
+{
+    for (char *tok = strtok(arg, ","); tok; tok = strtok(NULL, ",")) {
+        char *eq = strchr(tok, '=');
+        if (!eq)
+            return -EINVAL;
+        *eq = '\0';
+
+        int i = 0;
+        while (i < GEN_N_CLASSES && strcmp(tok, class_names[i]))
+            ++i;
+        if (i == GEN_N_CLASSES)
+            return -EINVAL;
+        G.weights[i] = strtoul(eq + 1, NULL, 0);
+    }
+
+    return 0;
+}
+
+static int generate(uint64_t n_records)
+{
+    for (int i = 0; i < G.n_cpus; ++i) {
+        G.cpus[i] = (struct gen_cpu) {
+            .tsc = 1000000 + rnd_range(1000),
+            .dom = -1,
+            .vcpu = -1,
+            .buf = malloc(G.window)
+        };
+        if (!G.cpus[i].buf)
+            return -ENOMEM;
+    }
+
+    // Start with a switch on each pCPU
+    for (int i = 0; i < G.n_cpus; ++i)
+        if (gen_switch(i))
+            return -EIO;
+
+    while (G.records < n_records) {
+        int cpu = rnd_range(G.n_cpus);
+        G.cpus[cpu].tsc += 1000 + rnd_range(50000);
+        if (gen_record(cpu, pick_class()))
+            return -EIO;
+    }
+
+    for (int i = 0; i < G.n_cpus; ++i)
+        if (flush_window(i))
+            return -EIO;
+
+    return 0;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [options] <trace.xen>\n"
+                    "  -n records  number of records (default %d)\n"
+                    "  -p pcpus    number of pCPUs (default 4)\n"
+                    "  -d doms     number of domains (default 4)\n"
+                    "  -v vcpus    vCPUs per domain (default 2)\n"
+                    "  -m mix      weights of the classes, e.g. hvm=40,sched=20\n"
+                    "              (gen, sched, dom0, hvm, mem, pv, shadow, hw)\n"
+                    "  -w bytes    size of the per-CPU windows (default %d)\n"
+                    "  -s seed     random seed (default 1)\n", name,
+                    DEFAULT_RECORDS, DEFAULT_WINDOW);
+}
+
+int main(int argc, char **argv)
+{
+    static const unsigned default_weights[GEN_N_CLASSES] = {
+        [GEN_SCHED] = 15, [GEN_DOM0] = 1, [GEN_HVM] = 40, [GEN_MEM] = 5,
+        [GEN_PV] = 15, [GEN_SHADOW] = 5, [GEN_HW] = 15
+    };
+    uint64_t n_records = DEFAULT_RECORDS;
+
+    G.n_cpus = G.n_doms = 4;
+    G.n_vcpus = 2;
+    G.window = DEFAULT_WINDOW;
+    G.state = 1;
+    memcpy(G.weights, default_weights, sizeof(G.weights));
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:p:d:v:m:w:s:h")) != -1) {
+        switch (opt) {
+            case 'n':
+                n_records = strtoull(optarg, NULL, 0);
+                break;
+            case 'p':
+                G.n_cpus = atoi(optarg);
+                break;
+            case 'd':
+                G.n_doms = atoi(optarg);
+                break;
+            case 'v':
+                G.n_vcpus = atoi(optarg);
+                break;
+            case 'm':
+                if (parse_mix(optarg)) {
+                    fprintf(stderr, "Invalid mix \"%s\".\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'w':
+                G.window = strtoul(optarg, NULL, 0);
+                break;
+            case 's':
+                G.state = strtoull(optarg, NULL, 0) | 1;
+                break;
+            default:
+                usage(argv[0]);
+                return opt != 'h';
+        }
+    }
+
+    for (int i = 0; i < GEN_N_CLASSES; ++i)
+        G.total_weight += G.weights[i];
+
+    if (argc - optind != 1 || G.n_cpus < 1 || G.n_cpus > MAX_CPUS ||
+            G.n_doms < 1 || G.n_doms > MAX_DOMS || G.n_vcpus < 1 ||
+            G.window < 2 * MAX_RECORD_SIZE || !G.total_weight) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (!(G.out = fopen(argv[optind], "wb"))) {
+        fprintf(stderr, "Cannot create \"%s\": %s\n", argv[optind], strerror(errno));
+        return 1;
+    }
+
+    if (!(G.cpus = calloc(G.n_cpus, sizeof(*G.cpus)))) {
+        fclose(G.out);
+        return 1;
+    }
+
+    int ret = generate(n_records);
+    if (fclose(G.out) && !ret)
+        ret = -errno;
+    if (ret)
+        fprintf(stderr, "Cannot write \"%s\": %s\n", argv[optind], strerror(-ret));
+
+    for (int i = 0; i < G.n_cpus; ++i)
+        free(G.cpus[i].buf);
+    free(G.cpus);
+    return !!ret;
+}
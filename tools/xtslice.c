@@ -0,0 +1,488 @@
+/**
+ * XenTrace data processing interface for KernelShark - Copyright (C) 2021
+ * Giuseppe Eletto <peppe.eletto@gmail.com>
+ * Dario Faggioli  <dfaggioli@suse.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef _GNU_SOURCE
+/** Use GNU C Library. */
+#define _GNU_SOURCE
+#endif // _GNU_SOURCE
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Xen Project
+#include <trace.h>
+// Raw trace reader
+#include "raw/xtraw.h"
+
+#include "tools.h"
+
+/*
+ * Extracts a time window, a set of pCPUs and/or a set of domains
+ * from a XenTrace file into a new, valid XenTrace file.
+ *
+ * The per-CPU windows (TRC_TRACE_CPU_CHANGE + records) are indexed
+ * by walking only their headers, with the TSC of their first record:
+ * the windows out of the time range are skipped without reading them,
+ * those entirely inside it (with no domain filter) are copied as they
+ * are. The others are decoded and rewritten with the kept records.
+ *
+ * The domain of a record is the one running on its pCPU, followed
+ * through the scheduler switches (as the parser does); until the
+ * first switch it is unknown and the records are kept. General and
+ * scheduler records are always kept.
+ */
+
+#define WINDOWS_INIT_SIZE 1024
+#define BUF_INIT_SIZE (64 << 10)
+#define MAX_CPUS 4096
+#define MAX_DOMS 65536
+#define UNKNOWN_DOM -1
+
+// A per-CPU window of the input
+struct window {
+    // Offsets of the TRC_TRACE_CPU_CHANGE record and of the records
+    uint64_t offset,
+             records;
+    uint32_t size;
+    uint16_t cpu;
+    // Whether the first record carries its own TSC
+    bool first_has_tsc;
+    // TSC of its first record and of the next window of the same pCPU
+    uint64_t start_tsc,
+             end_tsc;
+};
+
+// Windows of a pCPU (positions in the file order)
+struct cpu_windows {
+    size_t *pos;
+    size_t size,
+           capacity;
+};
+
+static struct {
+    struct xtr_file file;
+    FILE *out;
+    struct window *windows;
+    size_t n_windows,
+           windows_cap;
+    struct cpu_windows by_cpu[MAX_CPUS];
+    // Selection (NULL for all)
+    uint8_t *cpus,
+            *doms;
+    uint64_t from_tsc,
+             to_tsc;
+    // Per pCPU: running domain, last TSC written (0 if unknown)
+    // and whether the previous window was copied as it is
+    int running[MAX_CPUS];
+    uint64_t last_tsc[MAX_CPUS];
+    bool copied[MAX_CPUS];
+    // Output buffer of a rewritten window
+    uint8_t *buf;
+    size_t buf_len,
+           buf_cap;
+} S;
+
+/**
+ * Parses a list like "0,2-5" into a map of "max" entries.
+ */
+static uint8_t *parse_list(const char *arg, int max)
+{
+    uint8_t *map = calloc(max, 1);
+    if (!map)
+        return NULL;
+
+    while (*arg) {
+        char *end;
+        long first = strtol(arg, &end, 0),
+             last = first;
+        if (end == arg)
+            goto fail;
+        if (*end == '-') {
+            arg = end + 1;
+            last = strtol(arg, &end, 0);
+            if (end == arg)
+                goto fail;
+        }
+        if (first < 0 || last >= max || first > last)
+            goto fail;
+
+        memset(map + first, 1, last - first + 1);
+        if (*end == ',')
+            end++;
+        else if (*end)
+            goto fail;
+        arg = end;
+    }
+
+    return map;
+
+fail:
+    free(map);
+    return NULL;
+}
+
+static int add_window(const struct window *win)
+{
+    if (S.n_windows == S.windows_cap) {
+        size_t cap = S.windows_cap ? S.windows_cap * 2 : WINDOWS_INIT_SIZE;
+        struct window *tmp = realloc(S.windows, cap * sizeof(*tmp));
+        if (!tmp)
+            return -ENOMEM;
+        S.windows = tmp;
+        S.windows_cap = cap;
+    }
+
+    struct cpu_windows *c = &S.by_cpu[win->cpu];
+    if (c->size == c->capacity) {
+        size_t cap = c->capacity ? c->capacity * 2 : WINDOWS_INIT_SIZE;
+        size_t *tmp = realloc(c->pos, cap * sizeof(*tmp));
+        if (!tmp)
+            return -ENOMEM;
+        c->pos = tmp;
+        c->capacity = cap;
+    }
+
+    // The previous window of the pCPU ends where this one starts
+    if (c->size)
+        S.windows[c->pos[c->size - 1]].end_tsc = win->start_tsc;
+
+    c->pos[c->size++] = S.n_windows;
+    S.windows[S.n_windows++] = *win;
+    return 0;
+}
+
+/**
+ * Builds the sparse index, reading only the window headers and
+ * the first records up to one carrying a TSC.
+ */
+static int build_index()
+{
+    static uint64_t last_tsc[MAX_CPUS];
+    struct xtr_cursor cur;
+    struct xtr_window xwin;
+    int ret;
+
+    xtr_cursor_init(&cur, &S.file, 0);
+
+    while ((ret = xtr_next_window(&cur, &xwin)) > 0) {
+        if (xwin.cpu >= MAX_CPUS)
+            return -EINVAL;
+
+        struct window win = {
+            .offset = xwin.offset,
+            .records = cur.pos,
+            .size = cur.window_end - cur.pos,
+            .cpu = xwin.cpu,
+            .start_tsc = last_tsc[xwin.cpu],
+            .end_tsc = UINT64_MAX
+        };
+
+        struct xtr_record rec;
+        for (uint64_t pos = cur.pos; pos < cur.window_end; pos += rec.size) {
+            if (xtr_parse_record(S.file.data + pos, cur.window_end - pos, &rec) < 0)
+                break;
+            if (rec.has_tsc) {
+                win.first_has_tsc = (pos == cur.pos);
+                win.start_tsc = last_tsc[xwin.cpu] = rec.tsc;
+                break;
+            }
+        }
+
+        if (add_window(&win))
+            return -ENOMEM;
+
+        // Jump to the next window
+        cur.pos = cur.window_end;
+    }
+
+    return ret;
+}
+
+static uint64_t first_tsc()
+{
+    uint64_t tsc = UINT64_MAX;
+    for (size_t i = 0; i < S.n_windows; ++i)
+        if (S.windows[i].start_tsc && S.windows[i].start_tsc < tsc)
+            tsc = S.windows[i].start_tsc;
+    return (tsc == UINT64_MAX) ? 0 : tsc;
+}
+
+/**
+ * Returns the first window (file order) that may hold records
+ * of the selected pCPUs in the time range, by binary search on
+ * the windows of each pCPU.
+ */
+static size_t first_window()
+{
+    size_t first = S.n_windows;
+
+    for (int cpu = 0; cpu < MAX_CPUS; ++cpu) {
+        const struct cpu_windows *c = &S.by_cpu[cpu];
+        if (!c->size || (S.cpus && !S.cpus[cpu]))
+            continue;
+
+        // First window of the pCPU ending after the start
+        size_t l = 0,
+               h = c->size;
+        while (l < h) {
+            size_t m = l + (h - l) / 2;
+            if (S.windows[c->pos[m]].end_tsc <= S.from_tsc)
+                l = m + 1;
+            else
+                h = m;
+        }
+
+        if (l < c->size && c->pos[l] < first)
+            first = c->pos[l];
+    }
+
+    return first;
+}
+
+static int buf_append(const void *data, size_t len)
+{
+    if (S.buf_len + len > S.buf_cap) {
+        size_t cap = S.buf_cap ? S.buf_cap * 2 : BUF_INIT_SIZE;
+        while (cap < S.buf_len + len)
+            cap *= 2;
+
+        uint8_t *tmp = realloc(S.buf, cap);
+        if (!tmp)
+            return -ENOMEM;
+        S.buf = tmp;
+        S.buf_cap = cap;
+    }
+
+    memcpy(S.buf + S.buf_len, data, len);
+    S.buf_len += len;
+    return 0;
+}
+
+/**
+ * Appends a record, adding its TSC if it has none and the
+ * previous record written for its pCPU had a different one.
+ */
+static int write_record(const struct xtr_record *rec, const uint8_t *raw)
+{
+    if (rec->has_tsc || S.last_tsc[rec->cpu] == rec->tsc) {
+        S.last_tsc[rec->cpu] = rec->tsc;
+        return buf_append(raw, rec->size);
+    }
+
+    uint32_t words[3] = {
+        rec->id | (uint32_t)rec->n_extra << TRACE_EXTRA_SHIFT | TRC_HD_CYCLE_FLAG,
+        (uint32_t)rec->tsc,
+        (uint32_t)(rec->tsc >> 32)
+    };
+    S.last_tsc[rec->cpu] = rec->tsc;
+    return buf_append(words, sizeof(words)) ||
+            buf_append(rec->extra, rec->n_extra * sizeof(uint32_t));
+}
+
+static bool keep_record(const struct xtr_record *rec)
+{
+    uint32_t cls = rec->id & TRC_ALL;
+
+    // Follow the running domain
+    if (rec->id == TRC_SCHED_SWITCH)
+        S.running[rec->cpu] = rec->extra[2] & 0xffff;
+    else if (rec->id == TRC_SCHED_SWITCH_INFNEXT)
+        S.running[rec->cpu] = rec->extra[0] & 0xffff;
+
+    if (rec->tsc < S.from_tsc || rec->tsc >= S.to_tsc)
+        return false;
+    if (!S.doms || cls == TRC_GEN || cls == TRC_SCHED)
+        return true;
+
+    int dom = S.running[rec->cpu];
+    return dom == UNKNOWN_DOM || S.doms[dom];
+}
+
+static int write_window(const uint8_t *records, uint32_t size, uint16_t cpu)
+{
+    uint32_t header[3] = {
+        TRC_TRACE_CPU_CHANGE | 2 << TRACE_EXTRA_SHIFT,
+        cpu,
+        size
+    };
+
+    return (fwrite(header, sizeof(header), 1, S.out) != 1 ||
+            (size && fwrite(records, size, 1, S.out) != 1)) ? -EIO : 0;
+}
+
+/**
+ * Decodes a window and writes back the kept records.
+ */
+static int rewrite_window(const struct window *win)
+{
+    const uint8_t *data = S.file.data + win->records;
+    uint64_t tsc = win->start_tsc;
+    struct xtr_record rec;
+
+    S.buf_len = 0;
+    for (uint32_t pos = 0; pos < win->size; pos += rec.size) {
+        rec.tsc = tsc;
+        if (xtr_parse_record(data + pos, win->size - pos, &rec) < 0)
+            break;
+        rec.cpu = win->cpu;
+        tsc = rec.tsc;
+
+        if (keep_record(&rec) && write_record(&rec, data + pos))
+            return -ENOMEM;
+    }
+
+    S.copied[win->cpu] = false;
+    return S.buf_len ? write_window(S.buf, S.buf_len, win->cpu) : 0;
+}
+
+/**
+ * Writes the windows that may hold selected records, starting from
+ * the first one found through the index. A window is copied as it is
+ * when it lies inside the time range, no domain filter is set and its
+ * first record does not inherit the TSC from a window left out.
+ */
+static int slice()
+{
+    for (size_t i = first_window(); i < S.n_windows; ++i) {
+        const struct window *win = &S.windows[i];
+        if (S.cpus && !S.cpus[win->cpu])
+            continue;
+        if (win->end_tsc <= S.from_tsc || win->start_tsc >= S.to_tsc) {
+            S.copied[win->cpu] = false;
+            continue;
+        }
+
+        int ret;
+        if (!S.doms && win->start_tsc >= S.from_tsc && win->end_tsc < S.to_tsc &&
+                (win->first_has_tsc || S.copied[win->cpu])) {
+            const uint8_t *data = S.file.data + win->offset;
+            size_t size = win->records + win->size - win->offset;
+            ret = (fwrite(data, size, 1, S.out) != 1) ? -EIO : 0;
+
+            // Its last TSC is not known
+            S.last_tsc[win->cpu] = 0;
+            S.copied[win->cpu] = true;
+        } else {
+            ret = rewrite_window(win);
+        }
+
+        if (ret)
+            return ret;
+    }
+
+    return 0;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [options] <trace.xen> <slice.xen>\n"
+                    "  -f seconds  start of the time window (from the first record)\n"
+                    "  -t seconds  end of the time window\n"
+                    "  -C list     pCPUs to keep (e.g. 0,2-5)\n"
+                    "  -d list     domains to keep (e.g. 0,3)\n"
+                    "  -c cpu_hz   CPU frequency (e.g. 2.4G, default 2.4G)\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t cpu_hz = DEFAULT_CPU_HZ;
+    double from = 0,
+           to = -1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "f:t:C:d:c:h")) != -1) {
+        switch (opt) {
+            case 'f':
+                from = strtod(optarg, NULL);
+                break;
+            case 't':
+                to = strtod(optarg, NULL);
+                break;
+            case 'C':
+                if (!(S.cpus = parse_list(optarg, MAX_CPUS))) {
+                    fprintf(stderr, "Invalid pCPU list \"%s\".\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'd':
+                if (!(S.doms = parse_list(optarg, MAX_DOMS))) {
+                    fprintf(stderr, "Invalid domain list \"%s\".\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'c':
+                if (!(cpu_hz = tools_parse_hz(optarg))) {
+                    fprintf(stderr, "Invalid cpu_hz \"%s\".\n", optarg);
+                    return 1;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return opt != 'h';
+        }
+    }
+
+    if (argc - optind != 2) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int ret = xtr_open(&S.file, argv[optind]);
+    if (ret) {
+        fprintf(stderr, "Cannot open \"%s\": %s\n", argv[optind], strerror(-ret));
+        return 1;
+    }
+
+    if (build_index() < 0)
+        fprintf(stderr, "Warning: \"%s\" is truncated or corrupted.\n", argv[optind]);
+
+    uint64_t base = first_tsc();
+    S.from_tsc = base + (uint64_t)(from * cpu_hz);
+    S.to_tsc = (to < 0) ? UINT64_MAX : base + (uint64_t)(to * cpu_hz);
+    for (int i = 0; i < MAX_CPUS; ++i)
+        S.running[i] = UNKNOWN_DOM;
+
+    if (!(S.out = fopen(argv[optind + 1], "wb"))) {
+        fprintf(stderr, "Cannot create \"%s\": %s\n", argv[optind + 1], strerror(errno));
+        xtr_close(&S.file);
+        return 1;
+    }
+
+    ret = slice();
+    if (fclose(S.out) && !ret)
+        ret = -errno;
+    if (ret)
+        fprintf(stderr, "Cannot write \"%s\": %s\n", argv[optind + 1], strerror(-ret));
+
+    xtr_close(&S.file);
+    for (int i = 0; i < MAX_CPUS; ++i)
+        free(S.by_cpu[i].pos);
+    free(S.windows);
+    free(S.cpus);
+    free(S.doms);
+    free(S.buf);
+    return !!ret;
+}